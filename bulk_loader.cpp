@@ -0,0 +1,359 @@
+#include "bulk_loader.h"
+#include "obfuscation.h"
+
+#include <algorithm>
+#include <fstream>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace garmin
+{
+  enum : uint8_t
+  {
+    OpenFile = 0,
+    ReadFile,
+    CloseFile,
+  };
+
+  bulk_loader_t::bulk_loader_t(std::vector<std::filesystem::path> paths, uint32_t queue_depth, size_t buffer_size)
+    : paths(std::move(paths)),
+      buffer_size(buffer_size ? buffer_size : 1),
+      started(0),
+      handed_out(0),
+      failed(false),
+      ring_fd(-1),
+      outstanding(0),
+      prepared(0),
+      sq_entries(0),
+      sq_ring(nullptr),
+      cq_ring(nullptr),
+      sqes(nullptr),
+      sq_ring_size(0),
+      cq_ring_size(0),
+      sqes_size(0),
+      sq_tail(nullptr),
+      sq_mask(nullptr),
+      sq_array(nullptr),
+      cq_head(nullptr),
+      cq_tail(nullptr),
+      cq_mask(nullptr),
+      cqes(nullptr)
+  {
+    if(!queue_depth)
+      queue_depth = 1;
+    if(queue_depth > this->paths.size())
+      queue_depth = uint32_t(this->paths.size());
+
+    // every file holds one operation at a time plus possibly its close
+    if(queue_depth && setup_ring(queue_depth * 2))
+    {
+      slots.resize(queue_depth);
+      for(auto& slot : slots)
+      {
+        slot.buffer.reserve(this->buffer_size);
+        slot.index = 0;
+        slot.size = 0;
+        slot.fd = -1;
+        slot.busy = false;
+      }
+    }
+  }
+
+  bulk_loader_t::~bulk_loader_t(void)
+  {
+    close_ring();
+  }
+
+  bool bulk_loader_t::next(loaded_file_t& file)
+  {
+    if(handed_out == paths.size() || failed)
+      return false;
+    if(ring_fd < 0)
+      return read_next(file);
+    return ring_next(file);
+  }
+
+  // portable path
+  bool bulk_loader_t::read_next(loaded_file_t& file)
+  {
+    file.index = handed_out++;
+    file.data.clear();
+    file.good = false;
+
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(paths[file.index], error);
+    std::ifstream input(paths[file.index], std::ios_base::in | std::ios_base::binary);
+    if(!error && input.is_open())
+    {
+      file.data.resize(size);
+      input.read(reinterpret_cast<char*>(file.data.data()), std::streamsize(size));
+      file.good = !input.bad() && size_t(input.gcount()) == size;
+      file.data.resize(size_t(input.gcount()));
+      if(file.good)
+        deobfuscate(file.data.data(), file.data.size());
+    }
+    return true;
+  }
+
+#ifdef __linux__
+  template<typename T>
+  static inline T* ring_field(void* ring, uint32_t offset)
+  {
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(ring) + offset);
+  }
+
+  // opening, reading and closing through the ring came with Linux 5.6, older rings fail them with EINVAL
+  static bool ring_supports_files(int fd)
+  {
+    constexpr uint32_t op_count = 64;
+    alignas(io_uring_probe) uint8_t buffer[sizeof(io_uring_probe) + op_count * sizeof(io_uring_probe_op)] = {};
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer);
+    if(syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, op_count) < 0) // also before 5.6
+      return false;
+    for(uint8_t opcode : { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE })
+      if(opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+        return false;
+    return true;
+  }
+
+  bool bulk_loader_t::setup_ring(uint32_t entries)
+  {
+    io_uring_params params = {};
+    int fd = int(syscall(__NR_io_uring_setup, entries, &params));
+    if(fd < 0)
+      return false;
+    if(!ring_supports_files(fd))
+    {
+      ::close(fd);
+      return false;
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+      sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(sq_ring == MAP_FAILED)
+      sq_ring = nullptr;
+    else if(params.features & IORING_FEAT_SINGLE_MMAP)
+      cq_ring = sq_ring;
+    else if((cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING)) == MAP_FAILED)
+      cq_ring = nullptr;
+    if(sq_ring && cq_ring &&
+       (sqes = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES)) == MAP_FAILED)
+      sqes = nullptr;
+
+    ring_fd = fd;
+    if(!sq_ring || !cq_ring || !sqes)
+    {
+      close_ring();
+      return false;
+    }
+
+    sq_entries = params.sq_entries;
+    sq_tail = ring_field<uint32_t>(sq_ring, params.sq_off.tail);
+    sq_mask = ring_field<uint32_t>(sq_ring, params.sq_off.ring_mask);
+    sq_array = ring_field<uint32_t>(sq_ring, params.sq_off.array);
+    cq_head = ring_field<uint32_t>(cq_ring, params.cq_off.head);
+    cq_tail = ring_field<uint32_t>(cq_ring, params.cq_off.tail);
+    cq_mask = ring_field<uint32_t>(cq_ring, params.cq_off.ring_mask);
+    cqes = ring_field<io_uring_cqe>(cq_ring, params.cq_off.cqes);
+    return true;
+  }
+
+  void bulk_loader_t::close_ring(void)
+  {
+    if(ring_fd < 0)
+      return;
+
+    // the kernel may still write into the buffers, wait for everything in flight
+    if(prepared)
+      submit(0);
+    while(outstanding && submit(1))
+    {
+      uint32_t head = *cq_head;
+      while(head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+      {
+        const io_uring_cqe& cqe = static_cast<io_uring_cqe*>(cqes)[head & *cq_mask];
+        if((cqe.user_data & 3) == OpenFile && cqe.res >= 0)
+          ::close(cqe.res);
+        --outstanding;
+        ++head;
+      }
+      __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+    for(auto& slot : slots)
+      if(slot.fd >= 0)
+        ::close(slot.fd);
+
+    if(sqes)
+      munmap(sqes, sqes_size);
+    if(cq_ring && cq_ring != sq_ring)
+      munmap(cq_ring, cq_ring_size);
+    if(sq_ring)
+      munmap(sq_ring, sq_ring_size);
+    ::close(ring_fd);
+    ring_fd = -1;
+    sq_ring = cq_ring = sqes = nullptr;
+  }
+
+  // queues an operation of a slot, user data holds the slot and the operation
+  void bulk_loader_t::prepare(uint8_t operation, size_t slot_index)
+  {
+    slot_t& slot = slots[slot_index];
+    uint32_t tail = *sq_tail;
+    uint32_t index = tail & *sq_mask;
+    io_uring_sqe& sqe = static_cast<io_uring_sqe*>(sqes)[index];
+    sqe = {};
+    sqe.opcode = operation == OpenFile ? IORING_OP_OPENAT : operation == ReadFile ? IORING_OP_READ : IORING_OP_CLOSE;
+    switch(operation)
+    {
+      case OpenFile:
+        sqe.fd = AT_FDCWD;
+        sqe.addr = uint64_t(uintptr_t(paths[slot.index].c_str()));
+        sqe.open_flags = O_RDONLY | O_CLOEXEC;
+        break;
+      case ReadFile:
+        sqe.fd = slot.fd;
+        sqe.off = slot.size;
+        sqe.addr = uint64_t(uintptr_t(slot.buffer.data() + slot.size));
+        sqe.len = uint32_t(slot.buffer.size() - slot.size);
+        break;
+      case CloseFile:
+        sqe.fd = slot.fd;
+        slot.fd = -1;
+        break;
+    }
+    sqe.user_data = (uint64_t(slot_index) << 2) | operation;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++prepared;
+    ++outstanding;
+  }
+
+  // submits the queued entries and waits for the given number of completions
+  bool bulk_loader_t::submit(uint32_t wait)
+  {
+    for(;;)
+    {
+      int result = int(syscall(__NR_io_uring_enter, ring_fd, prepared, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+      if(result >= 0)
+      {
+        prepared -= uint32_t(result);
+        if(!prepared || wait)
+          return true;
+      }
+      else if(errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      {
+        failed = true;
+        return false;
+      }
+    }
+  }
+
+  // starts files on the idle slots
+  bool bulk_loader_t::start_files(void)
+  {
+    for(size_t i = 0; i < slots.size() && started < paths.size(); ++i)
+    {
+      slot_t& slot = slots[i];
+      if(slot.busy || outstanding >= sq_entries) // a pending close already holds the descriptor it closes
+        continue;
+      slot.busy = true;
+      slot.index = started++;
+      slot.size = 0;
+      slot.buffer.resize(std::max(slot.buffer.capacity(), buffer_size));
+      prepare(OpenFile, i);
+    }
+    return !prepared || submit(0);
+  }
+
+  bool bulk_loader_t::ring_next(loaded_file_t& file)
+  {
+    while(start_files())
+    {
+      uint32_t head = *cq_head;
+      if(head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+      {
+        if(!submit(1))
+          break;
+        continue;
+      }
+
+      const io_uring_cqe& cqe = static_cast<io_uring_cqe*>(cqes)[head & *cq_mask];
+      uint64_t user_data = cqe.user_data;
+      int32_t result = cqe.res;
+      __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+      --outstanding;
+
+      if(completion(user_data, result, file))
+        return true;
+    }
+    return false;
+  }
+
+  // advances a slot after one of its operations completed, returns true when a file was handed out
+  bool bulk_loader_t::completion(uint64_t user_data, int32_t result, loaded_file_t& file)
+  {
+    uint8_t operation = uint8_t(user_data & 3);
+    slot_t& slot = slots[size_t(user_data >> 2)];
+    switch(operation)
+    {
+      case OpenFile:
+        if(result < 0)
+        {
+          finish(slot, false, file);
+          return true;
+        }
+        slot.fd = result;
+        prepare(ReadFile, size_t(user_data >> 2));
+        return false;
+
+      case ReadFile:
+        if(result > 0)
+        {
+          size_t requested = slot.buffer.size() - slot.size;
+          slot.size += size_t(result);
+          if(size_t(result) == requested) // the file may be larger than the buffer
+          {
+            slot.buffer.resize(slot.buffer.size() * 2);
+            prepare(ReadFile, size_t(user_data >> 2));
+            return false;
+          }
+        }
+        // a short read of a regular file is its end
+        prepare(CloseFile, size_t(user_data >> 2));
+        finish(slot, result >= 0, file);
+        return true;
+
+      default: // CloseFile
+        return false;
+    }
+  }
+
+  void bulk_loader_t::finish(slot_t& slot, bool good, loaded_file_t& file)
+  {
+    slot.buffer.resize(good ? slot.size : 0);
+    file.index = slot.index;
+    file.good = good;
+    file.data.swap(slot.buffer); // the caller's previous buffer serves the next file of this slot
+    if(good)
+      deobfuscate(file.data.data(), file.data.size());
+    slot.busy = false;
+    ++handed_out;
+  }
+#else
+  bool bulk_loader_t::setup_ring(uint32_t) { return false; }
+  void bulk_loader_t::close_ring(void) { }
+  bool bulk_loader_t::ring_next(loaded_file_t&) { return false; }
+#endif
+} // namespace garmin
@@ -0,0 +1,84 @@
+#ifndef BULK_LOADER_H
+#define BULK_LOADER_H
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Loads many whole files with few system calls. On Linux the opens, reads and closes of up to
+// queue_depth files are queued on an io_uring and submitted together, otherwise (or when the kernel
+// refuses the ring or does not support these operations on it) the files are read one after another.
+// Obfuscated files are handed out deobfuscated.
+
+namespace garmin
+{
+  struct loaded_file_t
+  {
+    size_t index;               // position of the file in the path list
+    std::vector<uint8_t> data;  // whole file
+    bool good;                  // false when the file could not be opened or read
+  };
+
+  class bulk_loader_t
+  {
+  public:
+    bulk_loader_t(std::vector<std::filesystem::path> paths, uint32_t queue_depth = 64, size_t buffer_size = 128 << 10);
+    ~bulk_loader_t(void);
+
+    // Hands out the next loaded file in completion order, returns false after the last one. The
+    // buffer previously held in file.data is reused for a later file, so passing the same
+    // loaded_file_t back keeps the number of allocations at queue_depth.
+    bool next(loaded_file_t& file);
+
+    const std::filesystem::path& path(size_t index) const { return paths[index]; }
+    bool uses_ring(void) const { return ring_fd >= 0; }
+    bool good(void) const { return !failed; }
+
+  private:
+    struct slot_t
+    {
+      std::vector<uint8_t> buffer;
+      size_t index;
+      size_t size;
+      int fd;
+      bool busy;
+    };
+
+    bool setup_ring(uint32_t entries);
+    void close_ring(void);
+    bool read_next(loaded_file_t& file);
+    bool ring_next(loaded_file_t& file);
+    bool start_files(void);
+    void prepare(uint8_t operation, size_t slot);
+    bool submit(uint32_t wait);
+    bool completion(uint64_t user_data, int32_t result, loaded_file_t& file);
+    void finish(slot_t& slot, bool good, loaded_file_t& file);
+
+    std::vector<std::filesystem::path> paths;
+    std::vector<slot_t> slots;
+    size_t buffer_size;
+    size_t started;     // files submitted to the ring or read
+    size_t handed_out;
+    bool failed;
+
+    int ring_fd;
+    uint32_t outstanding; // operations submitted or prepared and not yet completed
+    uint32_t prepared;    // queued entries not yet submitted
+    uint32_t sq_entries;
+    void* sq_ring;
+    void* cq_ring;
+    void* sqes;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    uint32_t* sq_tail;
+    uint32_t* sq_mask;
+    uint32_t* sq_array;
+    uint32_t* cq_head;
+    uint32_t* cq_tail;
+    uint32_t* cq_mask;
+    void* cqes;
+  };
+} // namespace garmin
+
+#endif // BULK_LOADER_H
@@ -0,0 +1,453 @@
+#include "codepage.h"
+#include "record_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+
+#include <iconv.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace garmin
+{
+  // code points of the bytes 0x80 to 0xFF, the bytes below are ASCII
+  static constexpr uint16_t thai_table[128] = // cp874, 0x80 to 0xFF
+  {
+    0x20AC, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0x2026, 0xFFFD, 0xFFFD,
+    0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD,
+    0xFFFD, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD,
+    0x00A0, 0x0E01, 0x0E02, 0x0E03, 0x0E04, 0x0E05, 0x0E06, 0x0E07,
+    0x0E08, 0x0E09, 0x0E0A, 0x0E0B, 0x0E0C, 0x0E0D, 0x0E0E, 0x0E0F,
+    0x0E10, 0x0E11, 0x0E12, 0x0E13, 0x0E14, 0x0E15, 0x0E16, 0x0E17,
+    0x0E18, 0x0E19, 0x0E1A, 0x0E1B, 0x0E1C, 0x0E1D, 0x0E1E, 0x0E1F,
+    0x0E20, 0x0E21, 0x0E22, 0x0E23, 0x0E24, 0x0E25, 0x0E26, 0x0E27,
+    0x0E28, 0x0E29, 0x0E2A, 0x0E2B, 0x0E2C, 0x0E2D, 0x0E2E, 0x0E2F,
+    0x0E30, 0x0E31, 0x0E32, 0x0E33, 0x0E34, 0x0E35, 0x0E36, 0x0E37,
+    0x0E38, 0x0E39, 0x0E3A, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0x0E3F,
+    0x0E40, 0x0E41, 0x0E42, 0x0E43, 0x0E44, 0x0E45, 0x0E46, 0x0E47,
+    0x0E48, 0x0E49, 0x0E4A, 0x0E4B, 0x0E4C, 0x0E4D, 0x0E4E, 0x0E4F,
+    0x0E50, 0x0E51, 0x0E52, 0x0E53, 0x0E54, 0x0E55, 0x0E56, 0x0E57,
+    0x0E58, 0x0E59, 0x0E5A, 0x0E5B, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD,
+  };
+
+  static constexpr uint16_t central_european_table[128] = // cp1250, 0x80 to 0xFF
+  {
+    0x20AC, 0xFFFD, 0x201A, 0xFFFD, 0x201E, 0x2026, 0x2020, 0x2021,
+    0xFFFD, 0x2030, 0x0160, 0x2039, 0x015A, 0x0164, 0x017D, 0x0179,
+    0xFFFD, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0xFFFD, 0x2122, 0x0161, 0x203A, 0x015B, 0x0165, 0x017E, 0x017A,
+    0x00A0, 0x02C7, 0x02D8, 0x0141, 0x00A4, 0x0104, 0x00A6, 0x00A7,
+    0x00A8, 0x00A9, 0x015E, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x017B,
+    0x00B0, 0x00B1, 0x02DB, 0x0142, 0x00B4, 0x00B5, 0x00B6, 0x00B7,
+    0x00B8, 0x0105, 0x015F, 0x00BB, 0x013D, 0x02DD, 0x013E, 0x017C,
+    0x0154, 0x00C1, 0x00C2, 0x0102, 0x00C4, 0x0139, 0x0106, 0x00C7,
+    0x010C, 0x00C9, 0x0118, 0x00CB, 0x011A, 0x00CD, 0x00CE, 0x010E,
+    0x0110, 0x0143, 0x0147, 0x00D3, 0x00D4, 0x0150, 0x00D6, 0x00D7,
+    0x0158, 0x016E, 0x00DA, 0x0170, 0x00DC, 0x00DD, 0x0162, 0x00DF,
+    0x0155, 0x00E1, 0x00E2, 0x0103, 0x00E4, 0x013A, 0x0107, 0x00E7,
+    0x010D, 0x00E9, 0x0119, 0x00EB, 0x011B, 0x00ED, 0x00EE, 0x010F,
+    0x0111, 0x0144, 0x0148, 0x00F3, 0x00F4, 0x0151, 0x00F6, 0x00F7,
+    0x0159, 0x016F, 0x00FA, 0x0171, 0x00FC, 0x00FD, 0x0163, 0x02D9,
+  };
+
+  static constexpr uint16_t cyrillic_table[128] = // cp1251, 0x80 to 0xFF
+  {
+    0x0402, 0x0403, 0x201A, 0x0453, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x20AC, 0x2030, 0x0409, 0x2039, 0x040A, 0x040C, 0x040B, 0x040F,
+    0x0452, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0xFFFD, 0x2122, 0x0459, 0x203A, 0x045A, 0x045C, 0x045B, 0x045F,
+    0x00A0, 0x040E, 0x045E, 0x0408, 0x00A4, 0x0490, 0x00A6, 0x00A7,
+    0x0401, 0x00A9, 0x0404, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x0407,
+    0x00B0, 0x00B1, 0x0406, 0x0456, 0x0491, 0x00B5, 0x00B6, 0x00B7,
+    0x0451, 0x2116, 0x0454, 0x00BB, 0x0458, 0x0405, 0x0455, 0x0457,
+    0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
+    0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,
+    0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
+    0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,
+    0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+    0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,
+    0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+    0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F,
+  };
+
+  static constexpr uint16_t western_european_table[128] = // cp1252, 0x80 to 0xFF
+  {
+    0x20AC, 0xFFFD, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0xFFFD, 0x017D, 0xFFFD,
+    0xFFFD, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0xFFFD, 0x017E, 0x0178,
+    0x00A0, 0x00A1, 0x00A2, 0x00A3, 0x00A4, 0x00A5, 0x00A6, 0x00A7,
+    0x00A8, 0x00A9, 0x00AA, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x00AF,
+    0x00B0, 0x00B1, 0x00B2, 0x00B3, 0x00B4, 0x00B5, 0x00B6, 0x00B7,
+    0x00B8, 0x00B9, 0x00BA, 0x00BB, 0x00BC, 0x00BD, 0x00BE, 0x00BF,
+    0x00C0, 0x00C1, 0x00C2, 0x00C3, 0x00C4, 0x00C5, 0x00C6, 0x00C7,
+    0x00C8, 0x00C9, 0x00CA, 0x00CB, 0x00CC, 0x00CD, 0x00CE, 0x00CF,
+    0x00D0, 0x00D1, 0x00D2, 0x00D3, 0x00D4, 0x00D5, 0x00D6, 0x00D7,
+    0x00D8, 0x00D9, 0x00DA, 0x00DB, 0x00DC, 0x00DD, 0x00DE, 0x00DF,
+    0x00E0, 0x00E1, 0x00E2, 0x00E3, 0x00E4, 0x00E5, 0x00E6, 0x00E7,
+    0x00E8, 0x00E9, 0x00EA, 0x00EB, 0x00EC, 0x00ED, 0x00EE, 0x00EF,
+    0x00F0, 0x00F1, 0x00F2, 0x00F3, 0x00F4, 0x00F5, 0x00F6, 0x00F7,
+    0x00F8, 0x00F9, 0x00FA, 0x00FB, 0x00FC, 0x00FD, 0x00FE, 0x00FF,
+  };
+
+  static const uint16_t* single_byte_table(codepage_t codepage)
+  {
+    switch(codepage)
+    {
+      case Thai:             return thai_table;
+      case CentralEuropean:  return central_european_table;
+      case Cyrillic:         return cyrillic_table;
+      case WesternEuropean:  return western_european_table;
+      default:               return nullptr;
+    }
+  }
+
+  bool supported_codepage(codepage_t codepage)
+  {
+    return codepage == Unicode || codepage == ChineseTraditional || single_byte_table(codepage);
+  }
+
+  // length of the leading run of ASCII bytes
+  static size_t ascii_length(const uint8_t* data, size_t size)
+  {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for(; i + 16 <= size; i += 16)
+    {
+      int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+      if(mask)
+        return i + size_t(__builtin_ctz(unsigned(mask)));
+    }
+#endif
+    while(i < size && data[i] < 0x80)
+      ++i;
+    return i;
+  }
+
+  void append_utf8(std::string& out, uint32_t code_point)
+  {
+    if(code_point > 0x10FFFF || (code_point >= 0xD800 && code_point < 0xE000))
+      code_point = 0xFFFD;
+    if(code_point < 0x80)
+      out.push_back(char(code_point));
+    else if(code_point < 0x800)
+      out.append({ char(0xC0 | (code_point >> 6)), char(0x80 | (code_point & 0x3F)) });
+    else if(code_point < 0x10000)
+      out.append({ char(0xE0 | (code_point >> 12)), char(0x80 | ((code_point >> 6) & 0x3F)), char(0x80 | (code_point & 0x3F)) });
+    else
+      out.append({ char(0xF0 | (code_point >> 18)), char(0x80 | ((code_point >> 12) & 0x3F)),
+                   char(0x80 | ((code_point >> 6) & 0x3F)), char(0x80 | (code_point & 0x3F)) });
+  }
+
+  uint32_t next_code_point(const uint8_t* data, size_t size, size_t& pos)
+  {
+    uint8_t lead = data[pos++];
+    if(lead < 0x80)
+      return lead;
+
+    size_t length = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : 0;
+    if(!length || lead > 0xF4 || pos + length > size)
+      return 0xFFFD;
+    uint32_t code_point = lead & (0x3F >> length);
+    for(size_t i = 0; i < length; ++i)
+    {
+      if((data[pos + i] & 0xC0) != 0x80)
+        return 0xFFFD;
+      code_point = (code_point << 6) | (data[pos + i] & 0x3F);
+    }
+    pos += length;
+    return code_point;
+  }
+
+  struct reverse_entry_t
+  {
+    uint16_t code_point;
+    uint8_t byte;
+  };
+
+  using reverse_table_t = std::array<reverse_entry_t, 128>;
+
+  // the entries of a codepage table sorted by code point
+  static constexpr reverse_table_t reverse(const uint16_t (&table)[128])
+  {
+    reverse_table_t entries {};
+    for(size_t i = 0; i < entries.size(); ++i) // insertion sort, there is no constexpr std::sort in C++17
+    {
+      reverse_entry_t entry { table[i], uint8_t(0x80 + i) };
+      size_t pos = i;
+      for(; pos && entries[pos - 1].code_point > entry.code_point; --pos)
+        entries[pos] = entries[pos - 1];
+      entries[pos] = entry;
+    }
+    return entries;
+  }
+
+  // built at compile time, so concurrent first uses do not race on their initialisation
+  static constexpr reverse_table_t reversed_tables[] =
+  {
+    reverse(thai_table), reverse(central_european_table),
+    reverse(cyrillic_table), reverse(western_european_table),
+  };
+
+  // byte of a code point in a single byte codepage, 0 when there is none
+  static uint8_t single_byte(const uint16_t* table, uint32_t code_point)
+  {
+    const reverse_table_t& entries = reversed_tables[table == thai_table ? 0 :
+                                                     table == central_european_table ? 1 :
+                                                     table == cyrillic_table ? 2 : 3];
+    auto pos = std::lower_bound(entries.begin(), entries.end(), code_point,
+                                [](const reverse_entry_t& entry, uint32_t value) { return entry.code_point < value; });
+    return code_point != 0xFFFD && pos != entries.end() && pos->code_point == code_point ? pos->byte : 0;
+  }
+
+  // one descriptor per direction and thread, opening them costs far more than converting a string
+  struct iconv_descriptor_t
+  {
+    iconv_descriptor_t(const char* to, const char* from) : handle(iconv_open(to, from)) { }
+    ~iconv_descriptor_t(void)
+    {
+      if(handle != iconv_t(-1))
+        iconv_close(handle);
+    }
+    iconv_t handle;
+  };
+
+  // converts text that does not start with ASCII, unconvertible input becomes replacement
+  static bool iconv_append(iconv_t handle, const uint8_t* data, size_t size, std::string& out,
+                           const char* replacement, bool utf8_input)
+  {
+    if(handle == iconv_t(-1))
+      return false;
+    iconv(handle, nullptr, nullptr, nullptr, nullptr); // initial shift state
+
+    char* in = const_cast<char*>(reinterpret_cast<const char*>(data));
+    size_t in_left = size;
+    while(in_left)
+    {
+      size_t used = out.size();
+      out.resize(used + in_left * 2 + 4);
+      char* target = &out[used];
+      size_t target_left = out.size() - used;
+      size_t result = iconv(handle, &in, &in_left, &target, &target_left);
+      out.resize(out.size() - target_left);
+      if(result == size_t(-1) && errno != E2BIG)
+      {
+        size_t pos = 0; // skip the whole character that could not be converted
+        if(utf8_input)
+          next_code_point(reinterpret_cast<const uint8_t*>(in), in_left, pos);
+        else
+          pos = 1;
+        in += pos;
+        in_left -= pos;
+        out += replacement;
+      }
+    }
+    return true;
+  }
+
+  bool to_utf8(codepage_t codepage, const uint8_t* data, size_t size, std::string& out)
+  {
+    if(codepage == Unicode)
+    {
+      out.append(reinterpret_cast<const char*>(data), size);
+      return true;
+    }
+
+    const uint16_t* table = single_byte_table(codepage);
+    if(!table && codepage != ChineseTraditional)
+    {
+      out.append(reinterpret_cast<const char*>(data), size);
+      return false;
+    }
+
+    out.reserve(out.size() + size);
+    for(size_t pos = 0; pos < size;)
+    {
+      size_t ascii = ascii_length(data + pos, size - pos);
+      out.append(reinterpret_cast<const char*>(data + pos), ascii);
+      pos += ascii;
+      if(pos == size)
+        break;
+
+      if(table)
+        append_utf8(out, table[data[pos++] - 0x80]);
+      else
+      {
+        thread_local iconv_descriptor_t big5("UTF-8", "BIG5");
+        if(!iconv_append(big5.handle, data + pos, size - pos, out, "\xEF\xBF\xBD", false))
+        {
+          out.append(reinterpret_cast<const char*>(data + pos), size - pos);
+          return false;
+        }
+        break;
+      }
+    }
+    return true;
+  }
+
+  std::string to_utf8(codepage_t codepage, const vector16_t& text)
+  {
+    std::string out;
+    to_utf8(codepage, text.data(), text.size(), out);
+    return out;
+  }
+
+  bool from_utf8(codepage_t codepage, std::string_view text, vector16_t& out)
+  {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(text.data());
+    size_t size = text.size();
+    size_t ascii = ascii_length(data, size);
+    if(codepage == Unicode || ascii == size)
+    {
+      out.assign(data, data + size);
+      return true;
+    }
+
+    const uint16_t* table = single_byte_table(codepage);
+    if(table)
+    {
+      out.assign(data, data + ascii);
+      for(size_t pos = ascii; pos < size;)
+      {
+        size_t run = ascii_length(data + pos, size - pos);
+        out.insert(out.end(), data + pos, data + pos + run);
+        pos += run;
+        if(pos < size)
+        {
+          uint8_t byte = single_byte(table, next_code_point(data, size, pos));
+          out.push_back(byte ? byte : '?');
+        }
+      }
+      return true;
+    }
+
+    if(codepage == ChineseTraditional)
+    {
+      thread_local iconv_descriptor_t big5("BIG5", "UTF-8");
+      std::string converted(text.substr(0, ascii));
+      if(iconv_append(big5.handle, data + ascii, size - ascii, converted, "?", true))
+      {
+        out.assign(std::begin(converted), std::end(converted));
+        return true;
+      }
+    }
+    out.assign(data, data + size);
+    return false;
+  }
+
+  struct transcoder_t
+  {
+    codepage_t codepage;
+    codepage_t from;
+    bool started;
+    bool good;
+    std::string scratch;
+
+    void text(vector16_t& data)
+    {
+      scratch.clear();
+      to_utf8(from, data.data(), data.size(), scratch);
+      from_utf8(codepage, scratch, data);
+    }
+
+    void text(lstring_t& data)
+    {
+      for(auto& pair : data)
+        text(pair.second);
+    }
+
+    template<typename T>
+    void text(std::optional<T>& data)
+    {
+      if(data)
+        text(*data);
+    }
+
+    void fields(poi_header_t& data)
+    {
+      from = data.codepage;
+      started = from != codepage;
+      good = supported_codepage(from) && supported_codepage(codepage);
+      if(started && good)
+        data.codepage = codepage;
+    }
+
+    void fields(point_t& data)       { text(data.shortname); }
+    void fields(category_t& data)    { text(data.name); }
+    void fields(comment_t& data)     { text(data.text); }
+    void fields(description_t& data) { text(data.text); }
+
+    void fields(poi_group_t& data)
+    {
+      text(data.source);
+      for(area_t& area : data.areas)
+        walk(area);
+    }
+
+    void fields(address_t& data)
+    {
+      text(data.city);
+      text(data.country);
+      text(data.state);
+      text(data.postal_code);
+      text(data.street_name);
+      text(data.building_id);
+    }
+
+    void fields(contact_t& data)
+    {
+      text(data.phone1);
+      text(data.phone2);
+      text(data.fax);
+      text(data.email);
+      text(data.URL);
+    }
+
+    void fields(copyright_t& data)
+    {
+      text(data.data_source);
+      text(data.copyright_notice);
+      text(data.device_model);
+    }
+
+    void fields(record_header_t&) { }
+
+    template<typename T>
+    void walk(T& data)
+    {
+      if constexpr(std::is_same_v<T, poi_header_t>)
+      {
+        fields(data); // its copyright record is after the codepage
+      }
+      else if(!started || !good)
+        return;
+      else
+        fields(data);
+
+      for(any_record_t& child : data.child_records)
+        record(child);
+    }
+
+    void record(any_record_t& data)
+    {
+      visit_record([this](auto& record) { walk(record); }, data);
+    }
+  };
+
+  bool transcode_records(std::vector<any_record_t>& records, codepage_t codepage)
+  {
+    for(const any_record_t& record : records)
+      if(auto header = get_record_if<poi_header_t>(&record))
+        if(!supported_codepage(header->codepage) || !supported_codepage(codepage))
+          return false;
+
+    transcoder_t transcoder { codepage, Unicode, false, true, std::string() };
+    for(any_record_t& record : records)
+      transcoder.record(record);
+    return true;
+  }
+} // namespace garmin
@@ -0,0 +1,37 @@
+#ifndef CODEPAGE_H
+#define CODEPAGE_H
+
+#include "record_types.h"
+
+#include <string>
+#include <string_view>
+
+// Conversion of the text in records between the codepage of a file (poi_header_t::codepage) and
+// UTF-8. Single byte codepages go through tables, Big5 through iconv, and runs of ASCII are copied
+// as they are, so most strings never reach a table or iconv.
+
+namespace garmin
+{
+  bool supported_codepage(codepage_t codepage);
+
+  // surrogates and values beyond U+10FFFF are appended as U+FFFD
+  void append_utf8(std::string& out, uint32_t code_point);
+
+  // decodes the UTF-8 character at pos and moves past it, invalid sequences decode as one byte of U+FFFD
+  uint32_t next_code_point(const uint8_t* data, size_t size, size_t& pos);
+
+  // appends text converted to UTF-8, bytes without a character become U+FFFD
+  // returns false for codepages that are not supported, text is appended unchanged then
+  bool to_utf8(codepage_t codepage, const uint8_t* data, size_t size, std::string& out);
+  std::string to_utf8(codepage_t codepage, const vector16_t& text);
+
+  // characters the codepage does not have become '?'
+  bool from_utf8(codepage_t codepage, std::string_view text, vector16_t& out);
+
+  // Converts every string of the records of a file after its POI header to codepage and sets
+  // poi_header_t::codepage. The record sizes are recomputed on write. Returns false and leaves
+  // the records unchanged when either codepage is not supported.
+  bool transcode_records(std::vector<any_record_t>& records, codepage_t codepage);
+} // namespace garmin
+
+#endif // CODEPAGE_H
@@ -0,0 +1,304 @@
+#include "dedup.h"
+#include "codepage.h"
+#include "parallel.h"
+#include "record_dispatch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace garmin
+{
+  static constexpr double earth_radius = 6371008.8; // meters
+  static constexpr double degree_length = earth_radius * M_PI / 180;
+
+  struct located_point_t
+  {
+    uint64_t cell;
+    point_handle_t handle;
+    double latitude;
+    double longitude;
+    uint32_t first_name; // in the names of its file
+
+    bool operator<(const located_point_t& other) const
+      { return cell < other.cell || (cell == other.cell && handle < other.handle); }
+  };
+
+  // Cells are distance high and at least distance wide at their latitude, longitudes are scaled
+  // by the cosine of the row latitude so cells keep their width towards the poles.
+  struct grid_t
+  {
+    double cell_size; // degrees of latitude
+
+    int64_t row(double latitude) const { return int64_t(std::floor((latitude + 90) / cell_size)); }
+
+    int64_t column(int64_t row, double longitude) const
+    {
+      double latitude = (double(row) + 0.5) * cell_size - 90;
+      double scale = std::max(std::cos(latitude * M_PI / 180), 1e-3);
+      return int64_t(std::floor((longitude + 180) * scale / cell_size));
+    }
+
+    static uint64_t key(int64_t row, int64_t column) { return (uint64_t(row) << 32) | uint32_t(column); }
+  };
+
+  static double distance(const located_point_t& a, const located_point_t& b)
+  {
+    double x = (b.longitude - a.longitude) * std::cos((a.latitude + b.latitude) * M_PI / 360);
+    double y = b.latitude - a.latitude;
+    return std::sqrt(x * x + y * y) * degree_length;
+  }
+
+  // trigrams of the name padded with spaces, sorted and distinct
+  static void padded_trigrams(const std::string& name, std::vector<uint32_t>& result)
+  {
+    std::string padded = " " + name + " ";
+    size_t first = result.size();
+    for(size_t i = 0; i + 3 <= padded.size(); ++i)
+      result.push_back((uint32_t(uint8_t(padded[i])) << 16) | (uint32_t(uint8_t(padded[i + 1])) << 8) | uint8_t(padded[i + 2]));
+    std::sort(result.begin() + ptrdiff_t(first), result.end());
+    result.erase(std::unique(result.begin() + ptrdiff_t(first), result.end()), result.end());
+  }
+
+  static double similarity(const uint32_t* a, const uint32_t* a_end, const uint32_t* b, const uint32_t* b_end)
+  {
+    size_t sizes = size_t(a_end - a) + size_t(b_end - b);
+    if(!sizes)
+      return 1;
+    size_t common = 0;
+    while(a != a_end && b != b_end)
+    {
+      if(*a < *b)
+        ++a;
+      else if(*b < *a)
+        ++b;
+      else
+      {
+        ++common;
+        ++a;
+        ++b;
+      }
+    }
+    return 2.0 * double(common) / double(sizes);
+  }
+
+  // the trigrams of all names of the points of a file, in point order
+  struct file_names_t
+  {
+    std::vector<uint32_t> trigrams;    // sorted and distinct per name
+    std::vector<uint32_t> name_starts; // first trigram of each name, one more for the end
+  };
+
+  std::vector<duplicate_t> find_duplicates(const std::vector<const std::vector<any_record_t>*>& files, const dedup_options_t& options)
+  {
+    grid_t grid { std::max(options.distance, 1e-3) / degree_length };
+
+    // points with the trigrams of the names of every locale, per file, a point without names has
+    // one empty name
+    std::vector<std::vector<located_point_t>> file_points(files.size());
+    std::vector<file_names_t> file_names(files.size());
+    run_parallel(files.size(), options.threads, [&](size_t i)
+    {
+      std::string text;
+      uint32_t number = 0;
+      file_names_t& names = file_names[i];
+      visit_points(*files[i], [&](const point_t& point, codepage_t codepage)
+      {
+        double latitude = point.coordinates.latitude;
+        double longitude = point.coordinates.longitude;
+        int64_t row = grid.row(latitude);
+        file_points[i].push_back(located_point_t { grid_t::key(row, grid.column(row, longitude)),
+                                                   point_handle_t { uint32_t(i), number++ },
+                                                   latitude, longitude, uint32_t(names.name_starts.size()) });
+        if(point.shortname.empty())
+          names.name_starts.push_back(uint32_t(names.trigrams.size()));
+        for(const auto& pair : point.shortname)
+        {
+          text.clear();
+          to_utf8(codepage, pair.second.data(), pair.second.size(), text);
+          names.name_starts.push_back(uint32_t(names.trigrams.size()));
+          padded_trigrams(normalize_name(text), names.trigrams);
+        }
+      });
+      names.name_starts.push_back(uint32_t(names.trigrams.size()));
+    });
+
+    // The names of a point end where those of the next point of its file start. Feeds in several
+    // languages name a point differently per locale, so the most alike pair of names counts.
+    auto name_range = [&](const located_point_t& point)
+    {
+      const std::vector<located_point_t>& points = file_points[point.handle.file];
+      uint32_t end = point.handle.point + 1 < points.size() ? points[point.handle.point + 1].first_name
+                                                            : uint32_t(file_names[point.handle.file].name_starts.size() - 1);
+      return std::make_pair(point.first_name, end);
+    };
+    auto best_similarity = [&](const located_point_t& a, const located_point_t& b)
+    {
+      const file_names_t& a_names = file_names[a.handle.file];
+      const file_names_t& b_names = file_names[b.handle.file];
+      auto a_range = name_range(a);
+      auto b_range = name_range(b);
+      double best = 0;
+      for(uint32_t x = a_range.first; x < a_range.second && best < 1; ++x)
+        for(uint32_t y = b_range.first; y < b_range.second && best < 1; ++y)
+          best = std::max(best, similarity(a_names.trigrams.data() + a_names.name_starts[x],
+                                           a_names.trigrams.data() + a_names.name_starts[x + 1],
+                                           b_names.trigrams.data() + b_names.name_starts[y],
+                                           b_names.trigrams.data() + b_names.name_starts[y + 1]));
+      return best;
+    };
+
+    std::vector<located_point_t> points;
+    for(const auto& file : file_points)
+      points.insert(points.end(), file.begin(), file.end());
+    std::sort(points.begin(), points.end());
+
+    // first point of every occupied cell, one more for the end
+    std::vector<size_t> cells;
+    for(size_t i = 0; i < points.size(); ++i)
+      if(!i || points[i].cell != points[i - 1].cell)
+        cells.push_back(i);
+    size_t cell_count = cells.size();
+    cells.push_back(points.size());
+
+    auto find_cell = [&](uint64_t key) -> size_t
+    {
+      auto pos = std::lower_bound(cells.begin(), cells.begin() + ptrdiff_t(cell_count), key,
+                                  [&](size_t first, uint64_t wanted) { return points[first].cell < wanted; });
+      return pos != cells.begin() + ptrdiff_t(cell_count) && points[*pos].cell == key ? size_t(pos - cells.begin()) : SIZE_MAX;
+    };
+
+    // each pair is found from both of its points, the lower handle comes first in the result
+    size_t slices = std::min<size_t>(cell_count, 256);
+    std::vector<std::vector<duplicate_t>> found(slices);
+    run_parallel(slices, options.threads, [&](size_t slice)
+    {
+      for(size_t cell = cell_count * slice / slices; cell < cell_count * (slice + 1) / slices; ++cell)
+        for(size_t i = cells[cell]; i < cells[cell + 1]; ++i)
+        {
+          const located_point_t& point = points[i];
+          int64_t row = int64_t(point.cell >> 32);
+
+          for(int64_t near_row = row - 1; near_row <= row + 1; ++near_row)
+          {
+            int64_t column = grid.column(near_row, point.longitude);
+            for(int64_t near_column = column - 1; near_column <= column + 1; ++near_column)
+            {
+              size_t near = find_cell(grid_t::key(near_row, near_column));
+              if(near == SIZE_MAX)
+                continue;
+              for(size_t j = cells[near]; j < cells[near + 1]; ++j)
+              {
+                const located_point_t& other = points[j];
+                if(j == i || (options.across_files_only && other.handle.file == point.handle.file))
+                  continue;
+                double meters = distance(point, other);
+                if(meters > options.distance)
+                  continue;
+                double alike = options.similarity > 0 ? best_similarity(point, other) : 1;
+                if(alike < options.similarity)
+                  continue;
+
+                bool lower = point.handle < other.handle;
+                found[slice].push_back(duplicate_t { lower ? point.handle : other.handle,
+                                                     lower ? other.handle : point.handle,
+                                                     float(meters), float(alike) });
+              }
+            }
+          }
+        }
+    });
+
+    std::vector<duplicate_t> duplicates;
+    for(auto& slice : found)
+      duplicates.insert(duplicates.end(), slice.begin(), slice.end());
+    auto order = [](const duplicate_t& a, const duplicate_t& b)
+      { return a.first < b.first || (a.first == b.first && a.second < b.second); };
+    std::sort(duplicates.begin(), duplicates.end(), order);
+    duplicates.erase(std::unique(duplicates.begin(), duplicates.end(), [](const duplicate_t& a, const duplicate_t& b)
+      { return a.first == b.first && a.second == b.second; }), duplicates.end());
+    return duplicates;
+  }
+
+  // drops the marked points from the child records, counting points in the order of visit_points
+  struct point_remover_t
+  {
+    const std::vector<bool>& removed;
+    size_t next;
+    size_t count;
+
+    template<typename T>
+    void walk(T& data)
+    {
+      if constexpr(std::is_same_v<T, poi_group_t>)
+        for(area_t& area : data.areas)
+          walk(area);
+
+      std::vector<bool> drop(data.child_records.size());
+      size_t dropped = 0;
+      for(size_t i = 0; i < data.child_records.size(); ++i)
+      {
+        if(!holds_record<point_t>(data.child_records[i]))
+          record(data.child_records[i]);
+        else if(removed[next++])
+        {
+          drop[i] = true;
+          ++dropped;
+        }
+      }
+
+      if(dropped) // records can not be assigned, the kept ones go to a new list
+      {
+        std::vector<any_record_t> kept;
+        kept.reserve(data.child_records.size() - dropped);
+        for(size_t i = 0; i < data.child_records.size(); ++i)
+          if(!drop[i])
+            kept.emplace_back(std::move(data.child_records[i]));
+        data.child_records.swap(kept);
+        count += dropped;
+      }
+    }
+
+    void record(any_record_t& data)
+    {
+      visit_record([this](auto& record) { walk(record); }, data);
+    }
+  };
+
+  size_t remove_duplicates(const std::vector<std::vector<any_record_t>*>& files, const std::vector<duplicate_t>& duplicates)
+  {
+    // points are numbered across all files for the union find
+    std::vector<size_t> first_point(files.size() + 1, 0);
+    for(size_t i = 0; i < files.size(); ++i)
+    {
+      size_t count = 0;
+      visit_points(*files[i], [&count](const point_t&, codepage_t) { ++count; });
+      first_point[i + 1] = first_point[i] + count;
+    }
+
+    std::vector<size_t> parent(first_point.back());
+    std::iota(parent.begin(), parent.end(), 0);
+    auto root = [&parent](size_t point)
+    {
+      while(parent[point] != point)
+        point = parent[point] = parent[parent[point]];
+      return point;
+    };
+    for(const duplicate_t& duplicate : duplicates)
+    {
+      size_t a = root(first_point[duplicate.first.file] + duplicate.first.point);
+      size_t b = root(first_point[duplicate.second.file] + duplicate.second.point);
+      parent[std::max(a, b)] = std::min(a, b); // the lowest point of a group stays its root
+    }
+
+    std::vector<bool> removed(parent.size());
+    for(size_t point = 0; point < parent.size(); ++point)
+      removed[point] = root(point) != point;
+
+    point_remover_t remover { removed, 0, 0 };
+    for(std::vector<any_record_t>* file : files)
+      for(any_record_t& record : *file)
+        remover.record(record);
+    return remover.count;
+  }
+} // namespace garmin
@@ -0,0 +1,37 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include "name_index.h"
+
+// Near duplicate points across files, as when merged feeds list the same camera a few meters apart
+// under slightly different names. Points are bucketed in a grid with cells as large as the distance
+// limit, so only points of neighboring cells are compared, and cells are worked on in parallel.
+
+namespace garmin
+{
+  struct dedup_options_t
+  {
+    double distance = 30;           // meters
+    double similarity = 0.5;        // of the names, 0 to decide by distance alone
+    bool across_files_only = false; // leave duplicates within one file alone
+    uint32_t threads = 0;           // 0 for the hardware concurrency
+  };
+
+  struct duplicate_t
+  {
+    point_handle_t first;  // the lower handle
+    point_handle_t second;
+    float distance;        // meters
+    float similarity;      // best Dice coefficient of the trigrams of the normalized names over all locales
+  };
+
+  // pairs in handle order
+  std::vector<duplicate_t> find_duplicates(const std::vector<const std::vector<any_record_t>*>& files, const dedup_options_t& options);
+
+  // Removes all but the lowest handle of each group of points linked by duplicates and returns the
+  // number removed. Handles are those of find_duplicates, which the removal invalidates. Index
+  // records and the index table of a file are not updated.
+  size_t remove_duplicates(const std::vector<std::vector<any_record_t>*>& files, const std::vector<duplicate_t>& duplicates);
+} // namespace garmin
+
+#endif // DEDUP_H
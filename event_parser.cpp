@@ -0,0 +1,113 @@
+#include "event_parser.h"
+#include "parsers.h"
+#include "record_dispatch.h"
+#include "skim.h"
+
+namespace garmin
+{
+  void record_handler_t::record_content(any_record_t& data, uint32_t depth)
+  {
+    visit_record([this, depth](const auto& record) { record_data(record, depth); }, data);
+  }
+
+  event_parser_t::event_parser_t(std::istream& is, record_handler_t& handler)
+    : is(is),
+      handler(handler),
+      done(false)
+  {
+  }
+
+  bool event_parser_t::fail(void)
+  {
+    is.setstate(std::ios_base::failbit);
+    done = true;
+    return false;
+  }
+
+  bool event_parser_t::step(void)
+  {
+    if(done)
+      return false;
+
+    if(stack.empty())
+    {
+      if(!is.good() || is.peek() == EOF) // input ended without an End record
+      {
+        done = true;
+        return false;
+      }
+      uint32_t unlimited = UINT32_MAX;
+      return next_record(unlimited);
+    }
+
+    frame_t& top = stack.back();
+    if(top.main_remaining)
+      return next_record(top.main_remaining);
+
+    if(top.extra_remaining)
+    {
+      if(top.extra_records)
+        return next_record(top.extra_remaining);
+      skip_bytes(is, top.extra_remaining);
+      top.extra_remaining = 0;
+      return is.good() || fail();
+    }
+
+    bool end = top.header.type == End && stack.size() == 1;
+    handler.leave_record(top.header, uint32_t(stack.size() - 1));
+    stack.pop_back();
+    if(end)
+      done = true;
+    return !end;
+  }
+
+  // reads the next record within remaining bytes, reports it and opens it for its subordinated records
+  bool event_parser_t::next_record(uint32_t& remaining)
+  {
+    record_header_t header;
+    if(!(is >> header).good())
+      return fail();
+
+    uint32_t record_size = header.header_size() + header.end_of_record;
+    if(!known_record_type(header.type) ||
+       header.data_size() > header.end_of_record ||
+       record_size > remaining)
+      return fail();
+    remaining -= record_size; // before the stack grows and moves the frame holding it
+
+    uint32_t depth = uint32_t(stack.size());
+    if(!handler.enter_record(header, depth))
+    {
+      skip_bytes(is, header.end_of_record);
+      return is.good() || fail();
+    }
+
+    any_record_t data;
+    uint32_t consumed = read_record_data(is, data, header);
+    if(!is.good() || consumed > header.end_of_record)
+      return fail();
+
+    handler.record_content(data, depth);
+
+    frame_t& frame = stack.emplace_back(frame_t { header, 0, 0, allowed_children(header.type) != 0 });
+    if(header.type == POIGroup)
+    {
+      frame.main_remaining = header.data_size() - consumed;
+      frame.extra_remaining = header.end_of_record - header.data_size();
+    }
+    else
+      frame.extra_remaining = header.end_of_record - consumed;
+    return true;
+  }
+
+  std::istream& event_parser_t::run(void)
+  {
+    while(step());
+    return is;
+  }
+
+  std::istream& parse_events(std::istream& is, record_handler_t& handler)
+  {
+    return event_parser_t(is, handler).run();
+  }
+} // namespace garmin
@@ -0,0 +1,93 @@
+#ifndef EVENT_PARSER_H
+#define EVENT_PARSER_H
+
+#include "record_types.h"
+
+#include <iostream>
+#include <vector>
+
+// Streaming parse that reports records as events instead of building a tree. Only the records that
+// enclose the current one are kept, so memory depends on the nesting depth and not on the file size.
+
+namespace garmin
+{
+  struct record_handler_t
+  {
+    virtual ~record_handler_t(void) = default;
+
+    // return false to skip the record including its subordinated records, it is not left then
+    virtual bool enter_record(const record_header_t&, uint32_t) { return true; }
+
+    // the record that was entered, without its subordinated records. The default hands it to the
+    // typed overload below, handlers that keep records may take it over here instead.
+    virtual void record_content(any_record_t& data, uint32_t depth);
+
+    virtual void record_data(const record_header_t&,      uint32_t) { } // End
+    virtual void record_data(const garmin_header_t&,      uint32_t) { }
+    virtual void record_data(const poi_header_t&,         uint32_t) { }
+    virtual void record_data(const point_t&,              uint32_t) { }
+    virtual void record_data(const alert_t&,              uint32_t) { }
+    virtual void record_data(const bitmap_reference_t&,   uint32_t) { }
+    virtual void record_data(const bitmap_t&,             uint32_t) { }
+    virtual void record_data(const category_reference_t&, uint32_t) { }
+    virtual void record_data(const category_t&,           uint32_t) { }
+    virtual void record_data(const area_t&,               uint32_t) { }
+    virtual void record_data(const poi_group_t&,          uint32_t) { } // areas follow as subordinated records
+    virtual void record_data(const comment_t&,            uint32_t) { }
+    virtual void record_data(const address_t&,            uint32_t) { }
+    virtual void record_data(const contact_t&,            uint32_t) { }
+    virtual void record_data(const image_file_t&,         uint32_t) { }
+    virtual void record_data(const description_t&,        uint32_t) { }
+    virtual void record_data(const record15_t&,           uint32_t) { }
+    virtual void record_data(const record16_t&,           uint32_t) { }
+    virtual void record_data(const copyright_t&,          uint32_t) { }
+    virtual void record_data(const audio_file_t&,         uint32_t) { }
+    virtual void record_data(const speed_camera_t&,       uint32_t) { }
+    virtual void record_data(const record20_t&,           uint32_t) { }
+    virtual void record_data(const index_t&,              uint32_t) { }
+    virtual void record_data(const record22_t&,           uint32_t) { }
+    virtual void record_data(const record23_t&,           uint32_t) { }
+    virtual void record_data(const record24_t&,           uint32_t) { }
+    virtual void record_data(const record25_t&,           uint32_t) { }
+    virtual void record_data(const record26_t&,           uint32_t) { }
+    virtual void record_data(const record27_t&,           uint32_t) { }
+
+    // after all subordinated records of the record
+    virtual void leave_record(const record_header_t&, uint32_t) { }
+  };
+
+  // Walks the records with an explicit stack of the enclosing records. Every step handles one record
+  // header or leaves one record, so parsing can be stopped between any two steps.
+  class event_parser_t
+  {
+  public:
+    event_parser_t(std::istream& is, record_handler_t& handler);
+
+    bool step(void); // false once the End record was left, the input ended or failed
+    std::istream& run(void);
+
+    bool finished(void) const { return done; }
+    uint32_t depth(void) const { return uint32_t(stack.size()); }
+
+  private:
+    struct frame_t
+    {
+      record_header_t header;
+      uint32_t main_remaining;  // subordinated records in the main data (areas of POI groups)
+      uint32_t extra_remaining;
+      bool extra_records;       // extra data is made of records
+    };
+
+    bool next_record(uint32_t& remaining);
+    bool fail(void);
+
+    std::istream& is;
+    record_handler_t& handler;
+    std::vector<frame_t> stack;
+    bool done;
+  };
+
+  std::istream& parse_events(std::istream& is, record_handler_t& handler);
+} // namespace garmin
+
+#endif // EVENT_PARSER_H
@@ -0,0 +1,221 @@
+#include "generator.h"
+#include "parsers.h"
+#include "record_dispatch.h"
+#include "record_writer.h"
+
+#include <algorithm>
+#include <string>
+
+#include <cassert>
+
+namespace garmin
+{
+  static constexpr const char* locales[] = { "EN", "DE", "FR", "NL", "IT", "ES", "PT", "DA", "SV", "NO", "FI", "PL", "CS", "RU" };
+  static constexpr uint32_t locale_count = sizeof(locales) / sizeof(*locales);
+  static constexpr uint16_t media_count = 8;
+
+  // splitmix64: the standard distributions differ between library implementations
+  struct generator_rng_t
+  {
+    generator_rng_t(uint64_t seed) : state(seed) { }
+
+    uint64_t next(void)
+    {
+      uint64_t z = (state += 0x9E3779B97F4A7C15);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+      return z ^ (z >> 31);
+    }
+
+    double unit(void) { return double(next() >> 11) / double(uint64_t(1) << 53); } // [0, 1)
+    uint32_t below(uint32_t limit) { return uint32_t(unit() * limit); }
+    bool chance(double ratio) { return unit() < ratio; }
+
+    uint64_t state;
+  };
+
+  struct point_spec_t
+  {
+    double latitude;
+    double longitude;
+    uint32_t index;
+  };
+
+  // text in the first language_count locales, prefixed by the locale after the first
+  static lstring_t make_localized(const std::string& text, uint32_t language_count)
+  {
+    lstring_t lstring;
+    for(uint32_t i = 0; i < language_count; ++i)
+      lstring.merge(make_lstring(i ? std::string(locales[i]) + ' ' + text : text,
+                                 uint16_t((locales[i][0] << 8) | locales[i][1])));
+    return lstring;
+  }
+
+  template<typename T>
+  static T& add_child(record_header_t& parent)
+    { return add_record<T>(parent.child_records); }
+
+  static void make_point(point_t& point, const point_spec_t& spec, const generator_options_t& options)
+  {
+    generator_rng_t rng(options.seed ^ (uint64_t(spec.index) * 0xD6E8FEB86659FD93));
+    uint16_t category_id = uint16_t(rng.below(options.category_count));
+
+    point.coordinates.latitude = spec.latitude;
+    point.coordinates.longitude = spec.longitude;
+    point.reserved = 1;
+    point.flags = flags_t();
+    point.flags.bit8 = 1;
+    point.shortname = make_localized("POI " + std::to_string(spec.index), options.language_count);
+
+    add_child<category_reference_t>(point).category_id = category_id;
+
+    if(options.bitmap_density > 0 && rng.chance(options.bitmap_density))
+      add_child<bitmap_reference_t>(point).bitmap_id = category_id;
+
+    if(rng.chance(options.alert_ratio))
+    {
+      alert_t& alert = add_child<alert_t>(point);
+      alert.proximity = uint16_t(100 + rng.below(900));
+      alert.velocity = uint16_t((30 + rng.below(101)) * 100 * 1000 / 3600); // 30 .. 130 km/h
+      alert.Unknown6 = 0x100;
+      alert.Unknown7 = 0x100;
+      alert.enabled = True;
+      alert.trigger = rng.chance(0.5) ? along_road : proximity;
+      if(options.audio_density > 0 && rng.chance(options.audio_density))
+      {
+        alert.source = media;
+        alert.media_id = uint8_t(rng.below(media_count));
+      }
+      else
+      {
+        alert.source = internal;
+        alert.internal_id = audio_clips_t(rng.below(double_plonk + 1));
+      }
+    }
+  }
+
+  // areas split down to the given depth, built in the POI group
+  struct generated_areas_t : vector_area_builder_t<point_spec_t>
+  {
+    generated_areas_t(poi_group_t& poi_group, std::vector<point_spec_t>& specs, const generator_options_t& options)
+      : vector_area_builder_t(specs, 1, std::max(options.area_depth, uint32_t(1)) - 1),
+        poi_group(poi_group),
+        options(options)
+    {
+    }
+
+    double latitude(const point_spec_t& spec) const { return spec.latitude; }
+    double longitude(const point_spec_t& spec) const { return spec.longitude; }
+
+    void open_area(const area_bounds_t& bounds)
+    {
+      area_t& area = open.empty() ? poi_group.areas.emplace_back() : add_child<area_t>(*open.back());
+      area = make_area(bounds);
+      open.push_back(&area);
+    }
+
+    void points(void)
+    {
+      for(auto pos = first(); pos != last(); ++pos)
+        make_point(add_child<point_t>(*open.back()), *pos, options);
+    }
+
+    void close_area(void) { open.pop_back(); }
+
+    poi_group_t& poi_group;
+    const generator_options_t& options;
+    std::vector<area_t*> open; // records are only added to the innermost, so the others stay in place
+  };
+
+  static void make_bitmap(bitmap_t& bitmap, uint16_t bitmap_id, generator_rng_t& rng)
+  {
+    constexpr uint16_t size = 16;
+    bitmap.bitmap_id = bitmap_id;
+    bitmap.height = size;
+    bitmap.width = size;
+    bitmap.line_length = size;
+    bitmap.bits_per_pixel = 8;
+    bitmap.reserved0 = 0;
+    bitmap.image_offset = 44;
+    bitmap.transparent_color = 0x00FF00FF;
+    bitmap.reserved1 = 0;
+    bitmap.flags = flags_t();
+    bitmap.palette_offset = size * size + 44;
+    bitmap.image_data.resize(size * size);
+    for(auto& pixel : bitmap.image_data)
+      pixel = uint8_t(rng.next());
+    bitmap.palette_data.resize(256);
+    for(auto& color : bitmap.palette_data)
+      color = uint32_t(rng.next() & 0x00FFFFFF);
+  }
+
+  static void make_media(audio_file_t& audio, uint16_t audio_id, const generator_options_t& options, generator_rng_t& rng)
+  {
+    audio.audio_id = audio_id;
+    audio.format = audio_id & 1 ? MP3 : WAV;
+    for(uint32_t i = 0; i < options.language_count; ++i)
+    {
+      vector32_t& clip = audio.audio_data[uint16_t((locales[i][0] << 8) | locales[i][1])];
+      clip.resize(options.audio_size);
+      for(auto& sample : clip)
+        sample = uint8_t(rng.next());
+    }
+  }
+
+  std::vector<any_record_t> generate_records(const generator_options_t& options)
+  {
+    assert(options.language_count >= 1 && options.language_count <= locale_count);
+    assert(options.category_count >= 1);
+    assert(options.version[0] == '0' && (options.version[1] == '0' || options.version[1] == '1'));
+
+    generator_rng_t rng(options.seed);
+    std::vector<any_record_t> records;
+    records.reserve(4);
+
+    file_description_t description;
+    std::copy(options.version, options.version + 2, description.version);
+    description.timestamp = 1577836800; // 2020-01-01
+    description.name = "synthetic.gpi";
+    description.codepage = WesternEuropean;
+    description.source = make_localized("Synthetic", options.language_count);
+    description.copyright_notice = make_localized("Generated test data", options.language_count);
+    make_file_records(description, records);
+    poi_group_t& poi_group = get_record<poi_group_t>(records.back());
+
+    if(options.point_count)
+    {
+      // spread points over europe
+      std::vector<point_spec_t> specs(options.point_count);
+      for(uint32_t i = 0; i < options.point_count; ++i)
+        specs[i] = { 35.0 + rng.unit() * 35.0, -10.0 + rng.unit() * 50.0, i };
+      generated_areas_t(poi_group, specs, options).build();
+    }
+
+    for(uint16_t i = 0; i < options.category_count; ++i)
+    {
+      category_t& category = add_child<category_t>(poi_group);
+      category.category_id = i;
+      category.name = make_localized("Category " + std::to_string(i), options.language_count);
+      if(options.bitmap_density > 0)
+        add_child<bitmap_reference_t>(category).bitmap_id = i;
+    }
+
+    if(options.bitmap_density > 0)
+      for(uint16_t i = 0; i < options.category_count; ++i)
+        make_bitmap(add_child<bitmap_t>(poi_group), i, rng);
+
+    if(options.audio_density > 0)
+      for(uint16_t i = 0; i < media_count; ++i)
+        make_media(add_child<audio_file_t>(poi_group), i, options, rng);
+
+    records.emplace_back(std::in_place_type<record_header_t>, End);
+    return records;
+  }
+
+  std::ostream& generate_file(std::ostream& os, const generator_options_t& options)
+  {
+    for(const auto& record : generate_records(options))
+      os << record;
+    return os;
+  }
+} // namespace garmin
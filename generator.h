@@ -0,0 +1,27 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include "record_types.h"
+
+namespace garmin
+{
+  // knobs for deterministic synthetic files, the same options always produce the same bytes
+  struct generator_options_t
+  {
+    uint32_t point_count    = 10000;
+    uint32_t area_depth     = 3;    // levels of nested areas, 1 = a single area holding every point
+    uint32_t language_count = 1;    // locales per localized string (1 .. 14)
+    uint16_t category_count = 16;
+    double   bitmap_density = 0.0;  // share of points with a bitmap reference, a bitmap is generated per category when > 0
+    double   audio_density  = 0.0;  // share of alerts playing a custom media clip, media records are generated when > 0
+    double   alert_ratio    = 0.5;  // share of points with an alert record
+    uint32_t audio_size     = 4096; // bytes of media content per locale
+    char     version[2]     = { '0', '1' }; // "00" or "01"
+    uint64_t seed           = 1;
+  };
+
+  std::vector<any_record_t> generate_records(const generator_options_t& options);
+  std::ostream& generate_file(std::ostream& os, const generator_options_t& options);
+} // namespace garmin
+
+#endif // GENERATOR_H
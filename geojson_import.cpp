@@ -0,0 +1,516 @@
+#include "geojson_import.h"
+#include "codepage.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+namespace garmin
+{
+  static constexpr uint32_t max_property_depth = 32; // deeper objects are skipped, nesting is not bounded otherwise
+
+  struct json_reader_t
+  {
+    const char* pos;
+    const char* end;
+    bool good;
+    std::string key_text;   // unescaped strings
+    std::string value_text;
+
+    json_reader_t(const char* first, const char* last)
+      : pos(first),
+        end(last),
+        good(true)
+    {
+    }
+
+    bool fail(void)
+    {
+      good = false;
+      return false;
+    }
+
+    void whitespace(void)
+    {
+      while(pos < end && std::isspace(static_cast<unsigned char>(*pos)))
+        ++pos;
+    }
+
+    bool next(char c)
+    {
+      whitespace();
+      if(pos < end && *pos == c)
+      {
+        ++pos;
+        return true;
+      }
+      return false;
+    }
+
+    bool hex4(uint32_t& code)
+    {
+      if(end - pos < 4)
+        return false;
+      code = 0;
+      for(int i = 0; i < 4; ++i, ++pos)
+      {
+        char c = *pos;
+        code <<= 4;
+        if(c >= '0' && c <= '9') code |= uint32_t(c - '0');
+        else if(c >= 'a' && c <= 'f') code |= uint32_t(c - 'a' + 10);
+        else if(c >= 'A' && c <= 'F') code |= uint32_t(c - 'A' + 10);
+        else return false;
+      }
+      return true;
+    }
+
+    // reads a string, value refers to the input unless escapes had to be undone into buffer
+    bool string(std::string_view& value, std::string& buffer)
+    {
+      if(!next('"'))
+        return fail();
+      const char* start = pos;
+      while(pos < end && *pos != '"' && *pos != '\\')
+        ++pos;
+      if(pos < end && *pos == '"')
+      {
+        value = std::string_view(start, size_t(pos++ - start));
+        return true;
+      }
+
+      buffer.assign(start, pos);
+      while(pos < end && *pos != '"')
+      {
+        if(*pos != '\\')
+        {
+          buffer.push_back(*pos++);
+          continue;
+        }
+        if(++pos == end)
+          break;
+        switch(*pos++)
+        {
+          case 'b': buffer.push_back('\b'); break;
+          case 'f': buffer.push_back('\f'); break;
+          case 'n': buffer.push_back('\n'); break;
+          case 'r': buffer.push_back('\r'); break;
+          case 't': buffer.push_back('\t'); break;
+          case 'u':
+          {
+            uint32_t code = 0;
+            if(!hex4(code))
+              return fail();
+            uint32_t low = 0;
+            if(code >= 0xD800 && code < 0xDC00 && end - pos >= 6 && pos[0] == '\\' && pos[1] == 'u')
+            {
+              pos += 2;
+              if(!hex4(low))
+                return fail();
+              code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            }
+            append_utf8(buffer, code);
+            break;
+          }
+          default: buffer.push_back(pos[-1]); break; // quote, backslash and slash
+        }
+      }
+      if(pos == end)
+        return fail();
+      ++pos;
+      value = buffer;
+      return true;
+    }
+
+    // the text of a number, true, false or null
+    std::string_view literal(void)
+    {
+      whitespace();
+      const char* start = pos;
+      while(pos < end && (std::isalnum(static_cast<unsigned char>(*pos)) || *pos == '-' || *pos == '+' || *pos == '.'))
+        ++pos;
+      return std::string_view(start, size_t(pos - start));
+    }
+
+    bool skip_value(void)
+    {
+      whitespace();
+      if(pos >= end)
+        return fail();
+      if(*pos == '"')
+      {
+        std::string_view ignored;
+        return string(ignored, value_text);
+      }
+      if(*pos != '{' && *pos != '[')
+        return !literal().empty() || fail();
+
+      // nesting of objects and arrays alike, only strings need care
+      uint32_t depth = 0;
+      do
+      {
+        if(*pos == '"')
+        {
+          std::string_view ignored;
+          if(!string(ignored, value_text))
+            return false;
+          continue;
+        }
+        if(*pos == '{' || *pos == '[')
+          ++depth;
+        else if(*pos == '}' || *pos == ']')
+          --depth;
+        ++pos;
+      } while(depth && pos < end);
+      return !depth || fail();
+    }
+
+    // iterates the members of an object, member reads the value of each key
+    template<typename function_t>
+    bool object(function_t member)
+    {
+      if(!next('{'))
+        return fail();
+      if(next('}'))
+        return true;
+      do
+      {
+        std::string_view key;
+        if(!string(key, key_text) || !next(':') || !member(key))
+          return fail();
+      } while(next(','));
+      return next('}') || fail();
+    }
+
+    // a point without coordinates keeps NaN and is skipped
+    bool geometry(imported_point_t& point, bool& is_point)
+    {
+      return object([&](std::string_view key)
+      {
+        if(key == "type")
+        {
+          std::string_view type;
+          if(!string(type, value_text))
+            return false;
+          is_point = type == "Point";
+          return true;
+        }
+        if(key != "coordinates")
+          return skip_value();
+
+        // [longitude, latitude, altitude]
+        whitespace();
+        const char* value = pos;
+        if(next('['))
+        {
+          whitespace();
+          if(pos < end && *pos == '[') // not a single position
+          {
+            pos = value;
+            return skip_value();
+          }
+          double values[2] = { NAN, NAN };
+          size_t count = 0;
+          do
+          {
+            std::string_view number = literal();
+            if(count < 2)
+            {
+              auto result = std::from_chars(number.data(), number.data() + number.size(), values[count]);
+              if(result.ec != std::errc())
+                values[count] = NAN;
+            }
+            ++count;
+          } while(next(','));
+          point.longitude = values[0];
+          point.latitude = values[1];
+          return next(']');
+        }
+        return skip_value();
+      });
+    }
+
+    // properties and the members of nested objects, mapped by their own names
+    bool properties(import_batch_t& batch, uint32_t depth = 0)
+    {
+      return object([&](std::string_view key)
+      {
+        whitespace();
+        if(pos >= end)
+          return false;
+
+        import_field_t field;
+        bool mapped = import_field(key, field);
+        if(*pos == '{')
+          return depth + 1 < max_property_depth ? properties(batch, depth + 1) : skip_value();
+        if(!mapped)
+          return skip_value();
+        if(*pos == '"')
+        {
+          std::string_view value;
+          if(!string(value, value_text))
+            return false;
+          if(!value.empty())
+            batch.set_field(field, value);
+          return true;
+        }
+        if(*pos == '[')
+          return skip_value();
+        std::string_view value = literal();
+        if(value.empty())
+          return false;
+        if(value != "null" && value != "true" && value != "false")
+          batch.set_field(field, value);
+        return true;
+      });
+    }
+
+    bool feature(import_batch_t& batch)
+    {
+      batch.begin_point();
+      bool is_point = false;
+      bool read = object([&](std::string_view key)
+      {
+        if(key == "geometry")
+        {
+          whitespace();
+          if(pos < end && *pos == 'n') // null
+            return !literal().empty();
+          return geometry(batch.points.back(), is_point);
+        }
+        if(key == "properties")
+        {
+          whitespace();
+          if(pos < end && *pos == 'n')
+            return !literal().empty();
+          return properties(batch);
+        }
+        return skip_value();
+      });
+
+      if(read && is_point)
+        batch.end_point();
+      else
+      {
+        batch.points.pop_back();
+        ++batch.skipped;
+      }
+      return read;
+    }
+
+    // Moves to the next element of the features array by the nesting of the document, the way
+    // feature_scanner_t finds them, so a chunk resynchronizes where a chunk boundary would be.
+    // Returns false at the end of the array.
+    bool element(void)
+    {
+      while(pos < end)
+      {
+        if(*pos == '{' || *pos == '[')
+          return true;
+        if(*pos == '}' || *pos == ']')
+          return false;
+        if(*pos == '"')
+          skip_element();
+        else
+          ++pos;
+      }
+      return false;
+    }
+
+    // moves past the element or string at pos, by nesting only
+    void skip_element(void)
+    {
+      uint32_t depth = 0;
+      bool in_string = false;
+      for(; pos < end; ++pos)
+      {
+        char c = *pos;
+        if(in_string)
+        {
+          if(c == '\\')
+            ++pos;
+          else if(c == '"')
+            in_string = false;
+        }
+        else if(c == '"')
+          in_string = true;
+        else if(c == '{' || c == '[')
+          ++depth;
+        else if(c == '}' || c == ']')
+          --depth;
+        if(!depth && !in_string)
+        {
+          ++pos;
+          return;
+        }
+      }
+      pos = end;
+    }
+
+    // features of a chunk, which starts at a feature and ends after one
+    void features(import_batch_t& batch)
+    {
+      while(element())
+      {
+        // a feature that fails to parse is counted as skipped by feature(), other elements are no features
+        const char* start = pos;
+        if(*pos == '{' && feature(batch))
+          continue;
+        pos = start;
+        skip_element();
+      }
+    }
+  };
+
+  enum json_string_state_t : uint8_t
+  {
+    OutsideString = 0,
+    InString,
+    Escaped, // in a string after a backslash
+    JSONStringStateCount,
+  };
+
+  // Nesting of a piece of the document: the string state at its end, the change of depth of objects
+  // and arrays and the lowest depth on the way, relative to its start.
+  struct json_nesting_t
+  {
+    json_string_state_t state;
+    int64_t depth;
+    int64_t lowest;
+  };
+
+  // nesting of a piece for each string state at its start, the pieces of a large document are
+  // summarized in parallel and combined in order afterwards
+  using json_summary_t = std::array<json_nesting_t, JSONStringStateCount>;
+
+  static json_summary_t json_summary(const char* pos, const char* end)
+  {
+    json_summary_t summary = { { { OutsideString, 0, 0 }, { InString, 0, 0 }, { Escaped, 0, 0 } } };
+    for(; pos < end; ++pos)
+      for(auto& nesting : summary)
+        switch(nesting.state)
+        {
+          case Escaped:
+            nesting.state = InString;
+            break;
+          case InString:
+            nesting.state = *pos == '\\' ? Escaped : *pos == '"' ? OutsideString : InString;
+            break;
+          default:
+            if(*pos == '"')
+              nesting.state = InString;
+            else if(*pos == '{' || *pos == '[')
+              ++nesting.depth;
+            else if(*pos == '}' || *pos == ']')
+              nesting.lowest = std::min(nesting.lowest, --nesting.depth);
+            break;
+        }
+    return summary;
+  }
+
+  // Tracks the nesting of the document to find where the features array starts and where its
+  // elements begin.
+  struct feature_scanner_t
+  {
+    static constexpr int64_t features_depth = 2; // inside the features array of the top level object
+
+    const char* data;
+    size_t size;
+
+    // finds the features array of the top level object and returns the offset of its first element
+    size_t begin(void) const
+    {
+      json_reader_t reader(data, data + size);
+      if(!reader.next('{'))
+        return size;
+      do
+      {
+        std::string_view key;
+        if(!reader.string(key, reader.key_text) || !reader.next(':'))
+          return size;
+        if(key == "features")
+          return reader.next('[') ? size_t(reader.pos - data) : size;
+        if(!reader.skip_value())
+          return size;
+      } while(reader.next(','));
+      return size;
+    }
+
+    // first feature starting at or after pos, which has the given nesting, size after the features array
+    size_t next(size_t pos, json_string_state_t state, int64_t depth) const
+    {
+      for(; pos < size; ++pos)
+      {
+        char c = data[pos];
+        if(state != OutsideString)
+        {
+          state = state == Escaped ? InString : c == '\\' ? Escaped : c == '"' ? OutsideString : InString;
+          continue;
+        }
+        if(c == '"')
+          state = InString;
+        else if(c == '{' || c == '[')
+        {
+          if(depth == features_depth)
+            return pos;
+          ++depth;
+        }
+        else if(c == '}' || c == ']')
+        {
+          if(depth-- == features_depth) // end of the features array
+            return size;
+        }
+      }
+      return size;
+    }
+
+    // moves the chunk starts, which are offsets from first, to the features following them
+    void find_boundaries(size_t first, std::vector<size_t>& bounds, uint32_t threads) const
+    {
+      size_t chunks = bounds.size() - 1;
+      std::vector<json_summary_t> summaries(chunks);
+      run_parallel(chunks, threads, [&](size_t i)
+      {
+        summaries[i] = json_summary(data + first + bounds[i], data + first + bounds[i + 1]);
+      });
+
+      // nesting at the chunk starts, a chunk after the end of the features array has no features
+      std::vector<json_nesting_t> nesting(chunks, json_nesting_t { OutsideString, features_depth, features_depth });
+      for(size_t i = 1; i < chunks; ++i)
+      {
+        const json_nesting_t& summary = summaries[i - 1][nesting[i - 1].state];
+        nesting[i].state = summary.state;
+        nesting[i].depth = nesting[i - 1].depth + summary.depth;
+        nesting[i].lowest = std::min(nesting[i - 1].lowest, nesting[i - 1].depth + summary.lowest);
+      }
+
+      run_parallel(chunks - 1, threads, [&](size_t i)
+      {
+        const json_nesting_t& start = nesting[i + 1];
+        bounds[i + 1] = start.lowest < features_depth ? size - first :
+                        next(first + bounds[i + 1], start.state, start.depth) - first;
+      });
+    }
+  };
+
+  std::vector<import_batch_t> import_geojson(const char* data, size_t size, const import_options_t& options)
+  {
+    feature_scanner_t scanner { data, size };
+    size_t first = scanner.begin();
+    if(first >= size)
+      return std::vector<import_batch_t>(1);
+
+    return parse_chunks(data + first, size - first, options,
+                        [&scanner, first, &options](std::vector<size_t>& bounds)
+                        {
+                          scanner.find_boundaries(first, bounds, options.threads);
+                        },
+                        [](const char* begin, const char* end, import_batch_t& batch)
+                        {
+                          json_reader_t(begin, end).features(batch);
+                        });
+  }
+} // namespace garmin
@@ -0,0 +1,16 @@
+#ifndef GEOJSON_IMPORT_H
+#define GEOJSON_IMPORT_H
+
+#include "point_import.h"
+
+// Reader for GeoJSON FeatureCollections. Point features become points, their properties (including
+// those of nested objects up to 32 levels) are mapped by name with import_field. Other geometries are
+// skipped.
+// The features array is split into chunks on feature boundaries that are parsed on several threads.
+
+namespace garmin
+{
+  std::vector<import_batch_t> import_geojson(const char* data, size_t size, const import_options_t& options);
+} // namespace garmin
+
+#endif // GEOJSON_IMPORT_H
@@ -0,0 +1,84 @@
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+
+#include "generator.h"
+
+static void usage(const char* name)
+{
+  std::cerr << "usage: " << name << " [options] output.gpi" << std::endl
+            << "  --points N      number of points (10000)" << std::endl
+            << "  --depth N       levels of nested areas (3)" << std::endl
+            << "  --languages N   locales per string, 1 .. 14 (1)" << std::endl
+            << "  --categories N  number of categories (16)" << std::endl
+            << "  --bitmaps R     share of points with a bitmap reference (0)" << std::endl
+            << "  --audio R       share of alerts with a custom media clip (0)" << std::endl
+            << "  --alerts R      share of points with an alert (0.5)" << std::endl
+            << "  --audio-size N  bytes per media clip and locale (4096)" << std::endl
+            << "  --version V     file format version, 00 or 01 (01)" << std::endl
+            << "  --seed N        random seed (1)" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  garmin::generator_options_t options;
+  const char* output = nullptr;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if(arg[0] != '-')
+    {
+      output = arg;
+      continue;
+    }
+    if(value == nullptr)
+    {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+    ++i;
+
+    if(!std::strcmp(arg, "--points"))
+      options.point_count = uint32_t(std::strtoul(value, nullptr, 0));
+    else if(!std::strcmp(arg, "--depth"))
+      options.area_depth = uint32_t(std::strtoul(value, nullptr, 0));
+    else if(!std::strcmp(arg, "--languages"))
+      options.language_count = uint32_t(std::strtoul(value, nullptr, 0));
+    else if(!std::strcmp(arg, "--categories"))
+      options.category_count = uint16_t(std::strtoul(value, nullptr, 0));
+    else if(!std::strcmp(arg, "--bitmaps"))
+      options.bitmap_density = std::strtod(value, nullptr);
+    else if(!std::strcmp(arg, "--audio"))
+      options.audio_density = std::strtod(value, nullptr);
+    else if(!std::strcmp(arg, "--alerts"))
+      options.alert_ratio = std::strtod(value, nullptr);
+    else if(!std::strcmp(arg, "--audio-size"))
+      options.audio_size = uint32_t(std::strtoul(value, nullptr, 0));
+    else if(!std::strcmp(arg, "--version") && std::strlen(value) == 2)
+      std::memcpy(options.version, value, 2);
+    else if(!std::strcmp(arg, "--seed"))
+      options.seed = std::strtoull(value, nullptr, 0);
+    else
+    {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if(output == nullptr ||
+     options.language_count < 1 || options.language_count > 14 ||
+     options.category_count < 1 ||
+     options.version[0] != '0' || (options.version[1] != '0' && options.version[1] != '1'))
+  {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::ofstream file(output, std::ios::binary | std::ios::out | std::ios::trunc);
+  if(!file.is_open() || !garmin::generate_file(file, options).good())
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,37 @@
+TEMPLATE = app
+TARGET = gpigen
+CONFIG += console
+CONFIG += c++17
+CONFIG += strict_c++
+
+CONFIG -= app_bundle
+CONFIG -= qt
+
+QMAKE_CXXFLAGS_DEBUG += -O0
+QMAKE_CXXFLAGS_RELEASE += -O2
+QMAKE_CXXFLAGS += -fno-threadsafe-statics
+
+SOURCES += \
+        endian_types.cpp \
+        generator.cpp \
+        gpigen.cpp \
+        obfuscation.cpp \
+        parsers.cpp \
+        record_types.cpp \
+        record_writer.cpp \
+        skim.cpp \
+        spatial_order.cpp \
+        trace.cpp
+
+HEADERS += \
+  endian_types.h \
+  generator.h \
+  obfuscation.h \
+  parsers.h \
+  record_dispatch.h \
+  record_types.h \
+  record_writer.h \
+  skim.h \
+  spatial_order.h \
+  trace.h \
+  wire_types.h
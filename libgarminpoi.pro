@@ -2,6 +2,7 @@ TEMPLATE = app
 CONFIG += console
 CONFIG += c++17
 CONFIG += strict_c++
+CONFIG += thread
 #CONFIG += exceptions_off
 #CONFIG += rtti_off
 
@@ -11,6 +12,7 @@ CONFIG -= qt
 #clang:CONFIG += win32
 
 #QMAKE_CXXFLAGS_DEBUG += -DDEBUG_BUILD
+#QMAKE_CXXFLAGS += -DGARMIN_TRACE
 QMAKE_CXXFLAGS_DEBUG += -O0
 QMAKE_CXXFLAGS_RELEASE += -Os
 #QMAKE_CXXFLAGS += -Os
@@ -28,19 +30,70 @@ PKGCONFIG += sqlite3
 
 
 SOURCES += \
+        bulk_loader.cpp \
+        codepage.cpp \
+        dedup.cpp \
         endian_types.cpp \
+        event_parser.cpp \
+        generator.cpp \
+        geojson_import.cpp \
         main.cpp \
+        mapped_file.cpp \
+        memory_usage.cpp \
+        merkle_diff.cpp \
+        name_index.cpp \
+        obfuscation.cpp \
         parsers.cpp \
+        point_import.cpp \
+        readahead.cpp \
+        record_filter.cpp \
         record_types.cpp \
-        simplified/simple_sqlite.cpp
+        record_writer.cpp \
+        resumable_parser.cpp \
+        simplified/simple_sqlite.cpp \
+        skim.cpp \
+        snapshot.cpp \
+        spatial_order.cpp \
+        sqlite_export.cpp \
+        sqlite_import.cpp \
+        text_export.cpp \
+        text_import.cpp \
+        trace.cpp
 
 HEADERS += \
+  bulk_loader.h \
+  codepage.h \
+  dedup.h \
   endian_types.h \
+  event_parser.h \
+  generator.h \
+  geojson_import.h \
+  mapped_file.h \
+  memory_usage.h \
+  merkle_diff.h \
+  name_index.h \
+  obfuscation.h \
+  parallel.h \
   parsers.h \
+  point_import.h \
+  readahead.h \
+  record_dispatch.h \
+  record_filter.h \
   record_types.h \
+  record_writer.h \
+  resumable_parser.h \
   scrapers/utilities.h \
   scrapers/scraper_base.h \
   scrapers/chargehub_scraper.h \
   shortjson/shortjson.h \
   simplified/simple_curl.h \
-  simplified/simple_sqlite.h
+  simplified/simple_sqlite.h \
+  skim.h \
+  snapshot.h \
+  spatial_order.h \
+  sqlite_export.h \
+  sqlite_import.h \
+  text_export.h \
+  text_import.h \
+  trace.h \
+  wire_types.h
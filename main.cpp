@@ -14,6 +14,7 @@
 
 #include <record_types.h>
 #include <parsers.h>
+#include <obfuscation.h>
 
 
 int main(int argc, char* argv[])
@@ -38,9 +39,12 @@ int main(int argc, char* argv[])
 
       std::cout << std::setfill('0') << std::hex;
 
+      garmin::deobfuscating_buffer_t plain(*file.rdbuf());
+      std::istream input(&plain);
+
       std::vector<garmin::any_record_t> records;
-      while(file.good())
-        file >> records.emplace_back();
+      while(input.good())
+        input >> records.emplace_back();
       // ignore index if there is one
       /*
       if(file.fail())
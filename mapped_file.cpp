@@ -0,0 +1,67 @@
+#include "mapped_file.h"
+
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace garmin
+{
+  mapped_file_t::mapped_file_t(const std::filesystem::path& path)
+    : view(nullptr),
+      length(0),
+      opened(false),
+      mapped(false)
+  {
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if(fd >= 0 && !fstat(fd, &status) && S_ISREG(status.st_mode))
+    {
+      length = size_t(status.st_size);
+      opened = true;
+      if(length)
+      {
+        void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(address != MAP_FAILED)
+        {
+          madvise(address, length, MADV_SEQUENTIAL);
+          view = static_cast<const char*>(address);
+          mapped = true;
+        }
+        else
+          opened = false;
+      }
+    }
+    if(fd >= 0)
+      ::close(fd);
+    if(opened)
+      return;
+#endif
+
+    std::ifstream file(path, std::ios_base::in | std::ios_base::binary);
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(path, error);
+    if(file.is_open() && !error)
+    {
+      buffer.resize(size);
+      file.read(buffer.data(), std::streamsize(size));
+      buffer.resize(size_t(file.gcount()));
+      view = buffer.data();
+      length = buffer.size();
+      opened = !file.bad();
+    }
+  }
+
+  mapped_file_t::~mapped_file_t(void)
+  {
+#if defined(__unix__) || defined(__APPLE__)
+    if(mapped)
+      munmap(const_cast<char*>(view), length);
+#endif
+  }
+} // namespace garmin
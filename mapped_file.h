@@ -0,0 +1,32 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <filesystem>
+#include <vector>
+
+namespace garmin
+{
+  // Read only view of a whole file, memory mapped where possible
+  class mapped_file_t
+  {
+  public:
+    mapped_file_t(const std::filesystem::path& path);
+    ~mapped_file_t(void);
+
+    bool is_open(void) const { return opened; }
+    const char* data(void) const { return view; }
+    size_t size(void) const { return length; }
+
+  private:
+    mapped_file_t(const mapped_file_t&) = delete;
+    mapped_file_t& operator=(const mapped_file_t&) = delete;
+
+    const char* view;
+    size_t length;
+    bool opened;
+    bool mapped;
+    std::vector<char> buffer; // when mapping is not available
+  };
+} // namespace garmin
+
+#endif // MAPPED_FILE_H
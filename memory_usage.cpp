@@ -0,0 +1,158 @@
+#include "memory_usage.h"
+
+#include <iomanip>
+
+namespace garmin
+{
+  memory_entry_t& memory_entry_t::operator+=(const memory_entry_t& other)
+  {
+    count += other.count;
+    inline_bytes += other.inline_bytes;
+    payload_bytes += other.payload_bytes;
+    map_bytes += other.map_bytes;
+    slack_bytes += other.slack_bytes;
+    return *this;
+  }
+
+  memory_entry_t memory_usage_t::total(void) const
+  {
+    memory_entry_t sum;
+    for(const memory_entry_t& entry : types)
+      sum += entry;
+    sum.slack_bytes += list_slack_bytes;
+    return sum;
+  }
+
+  struct memory_counter_t
+  {
+    memory_usage_t& usage;
+
+    template<typename T>
+    static void vector(const std::vector<T>& data, memory_entry_t& entry)
+    {
+      entry.payload_bytes += data.size() * sizeof(T);
+      entry.slack_bytes += (data.capacity() - data.size()) * sizeof(T);
+    }
+
+    template<typename size_type, typename data_type>
+    static void payload(const vector_t<size_type, data_type>& data, memory_entry_t& entry)
+      { vector(data, entry); }
+
+    template<typename T>
+    static void payload(const std::vector<T>& data, memory_entry_t& entry)
+      { vector(data, entry); }
+
+    // a node holds the color, three links and the value
+    template<typename T>
+    static void payload(const localized_t<T>& data, memory_entry_t& entry)
+    {
+      constexpr size_t node_size = 4 * sizeof(void*) + sizeof(typename localized_t<T>::value_type);
+      entry.map_bytes += data.size() * node_size;
+      for(const auto& pair : data)
+        payload(pair.second, entry);
+    }
+
+    template<typename T>
+    static void payload(const std::optional<T>& data, memory_entry_t& entry)
+    {
+      if(data)
+        payload(*data, entry);
+    }
+
+    template<typename... T>
+    static void payloads(memory_entry_t& entry, const T&... data)
+      { (payload(data, entry), ...); }
+
+    static void fields(const garmin_header_t& data, memory_entry_t& entry) { payloads(entry, data.name); }
+    static void fields(const point_t& data, memory_entry_t& entry)         { payloads(entry, data.shortname); }
+    static void fields(const bitmap_t& data, memory_entry_t& entry)        { payloads(entry, data.image_data, data.palette_data, data.mask_data); }
+    static void fields(const category_t& data, memory_entry_t& entry)      { payloads(entry, data.name); }
+    static void fields(const comment_t& data, memory_entry_t& entry)       { payloads(entry, data.text); }
+    static void fields(const description_t& data, memory_entry_t& entry)   { payloads(entry, data.text); }
+    static void fields(const image_file_t& data, memory_entry_t& entry)    { payloads(entry, data.image_data); }
+    static void fields(const record16_t& data, memory_entry_t& entry)      { payloads(entry, data.points); }
+    static void fields(const audio_file_t& data, memory_entry_t& entry)    { payloads(entry, data.audio_data); }
+
+    static void fields(const address_t& data, memory_entry_t& entry)
+      { payloads(entry, data.city, data.country, data.state, data.postal_code, data.street_name, data.building_id); }
+    static void fields(const contact_t& data, memory_entry_t& entry)
+      { payloads(entry, data.phone1, data.phone2, data.fax, data.email, data.URL); }
+    static void fields(const copyright_t& data, memory_entry_t& entry)
+      { payloads(entry, data.data_source, data.copyright_notice, data.device_model, data.image_files); }
+
+    // the areas are held as area_t, their used slots are counted with them
+    static void fields(const poi_group_t& data, memory_entry_t& entry)
+    {
+      payloads(entry, data.source);
+      entry.slack_bytes += (data.areas.capacity() - data.areas.size()) * sizeof(area_t);
+    }
+
+    static void fields(const record_header_t&, memory_entry_t&) { }
+
+    template<typename T>
+    void walk(const T& data, size_t slot_size)
+    {
+      memory_entry_t& entry = usage.types[record_index(data.type)];
+      ++entry.count;
+      entry.inline_bytes += slot_size;
+      entry.slack_bytes += (data.child_records.capacity() - data.child_records.size()) * sizeof(any_record_t);
+      fields(data, entry);
+
+      if constexpr(std::is_same_v<T, poi_group_t>)
+        for(const area_t& area : data.areas)
+          walk(area, sizeof(area_t));
+      for(const any_record_t& child : data.child_records)
+        record(child);
+    }
+
+    void record(const any_record_t& data)
+    {
+      visit_record([this](const auto& record)
+      {
+        using record_t = std::decay_t<decltype(record)>;
+        walk(record, sizeof(any_record_t));
+        if constexpr(!std::is_same_v<record_storage_t<record_t>, record_t>) // the slot only points to it
+          usage.types[record_index(record.type)].payload_bytes += sizeof(record_t);
+      }, data);
+    }
+  };
+
+  memory_usage_t memory_usage(const std::vector<any_record_t>& records)
+  {
+    memory_usage_t usage;
+    usage.list_slack_bytes = (records.capacity() - records.size()) * sizeof(any_record_t);
+    memory_counter_t counter { usage };
+    for(const any_record_t& record : records)
+      counter.record(record);
+    return usage;
+  }
+
+  std::ostream& operator<<(std::ostream& os, const memory_usage_t& usage)
+  {
+    auto line = [&os](const char* name, const memory_entry_t& entry)
+    {
+      os << std::left << std::setw(18) << name << std::right
+         << std::setw(10) << entry.count
+         << std::setw(12) << entry.inline_bytes
+         << std::setw(12) << entry.payload_bytes
+         << std::setw(12) << entry.map_bytes
+         << std::setw(12) << entry.slack_bytes
+         << std::setw(12) << entry.total() << '\n';
+    };
+
+    std::ios_base::fmtflags flags = os.flags();
+    os << std::left << std::setw(18) << "record" << std::right
+       << std::setw(10) << "count"
+       << std::setw(12) << "inline"
+       << std::setw(12) << "payload"
+       << std::setw(12) << "map nodes"
+       << std::setw(12) << "slack"
+       << std::setw(12) << "total" << '\n';
+    for(size_t i = 0; i < usage.types.size(); ++i)
+      if(usage.types[i].count)
+        line(i ? record_name(record_id_t(i - 1)) : "End", usage.types[i]);
+    line("total", usage.total());
+    os.flags(flags);
+    return os;
+  }
+} // namespace garmin
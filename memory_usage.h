@@ -0,0 +1,42 @@
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include "record_dispatch.h"
+
+#include <array>
+#include <iostream>
+
+// Accounting of the memory held by parsed record trees, per record type. Heap sizes are the sizes
+// requested from the allocator, without its own overhead. Map nodes are estimated from the node
+// layout of the usual red black tree implementations.
+
+namespace garmin
+{
+  struct memory_entry_t
+  {
+    uint64_t count = 0;
+    uint64_t inline_bytes = 0;   // slots of the records in child_records, or in areas for area_t
+    uint64_t payload_bytes = 0;  // used bytes of text, image and other data vectors, and of boxed records
+    uint64_t map_bytes = 0;      // nodes of the localized_t maps
+    uint64_t slack_bytes = 0;    // allocated but unused capacity of all vectors of the records
+
+    uint64_t total(void) const
+      { return inline_bytes + payload_bytes + map_bytes + slack_bytes; }
+    memory_entry_t& operator+=(const memory_entry_t& other);
+  };
+
+  struct memory_usage_t
+  {
+    std::array<memory_entry_t, record_type_count> types; // indexed by record_index()
+    uint64_t list_slack_bytes = 0; // unused capacity of the list of top level records
+
+    memory_entry_t total(void) const;
+  };
+
+  memory_usage_t memory_usage(const std::vector<any_record_t>& records);
+
+  // one line per record type present and a total
+  std::ostream& operator<<(std::ostream& os, const memory_usage_t& usage);
+} // namespace garmin
+
+#endif // MEMORY_USAGE_H
@@ -0,0 +1,265 @@
+#include "merkle_diff.h"
+#include "parsers.h"
+#include "readahead.h"
+#include "wire_types.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace garmin
+{
+  static constexpr uint64_t golden_ratio = 0x9E3779B97F4A7C15;
+
+  // finalizer of MurmurHash3
+  static uint64_t mix(uint64_t value)
+  {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCD;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53;
+    value ^= value >> 33;
+    return value;
+  }
+
+  uint64_t content_hash(const uint8_t* data, size_t size, uint64_t seed)
+  {
+    uint64_t hash = seed ^ (size * golden_ratio);
+    for(; size >= sizeof(uint64_t); data += sizeof(uint64_t), size -= sizeof(uint64_t))
+    {
+      uint64_t word;
+      std::memcpy(&word, data, sizeof(word));
+      hash = (hash ^ mix(wire::from_le(word))) * golden_ratio;
+    }
+    uint8_t tail[sizeof(uint64_t)] = {};
+    std::memcpy(tail, data, size);
+    uint64_t word;
+    std::memcpy(&word, tail, sizeof(word));
+    return mix(hash ^ wire::from_le(word));
+  }
+
+  // order dependent
+  static uint64_t combine(uint64_t hash, uint64_t child)
+    { return mix(hash ^ (child + golden_ratio + (hash << 6) + (hash >> 2))); }
+
+  merkle_tree_t merkle_tree(const uint8_t* data, size_t size)
+  {
+    merkle_tree_t tree;
+    skim_result_t skimmed = skim(data, size, true);
+    tree.error = skimmed.error;
+    if(!skimmed.good())
+      return tree;
+
+    std::vector<merkle_node_t>& nodes = tree.nodes;
+    uint32_t count = uint32_t(skimmed.contents.size());
+    nodes.resize(count);
+
+    // subtrees end where a record of the same or a lower depth follows
+    std::vector<uint32_t> open;
+    for(uint32_t i = 0; i < count; ++i)
+    {
+      const skim_entry_t& entry = skimmed.contents[i];
+      for(; !open.empty() && nodes[open.back()].depth >= entry.depth; open.pop_back())
+        nodes[open.back()].subtree_size = i - open.back();
+      nodes[i] = merkle_node_t { 0, 0, entry.offset, entry.record_size, 1, entry.type, entry.depth, entry.header_size };
+      open.push_back(i);
+    }
+    for(; !open.empty(); open.pop_back())
+      nodes[open.back()].subtree_size = count - open.back();
+
+    // subordinated records follow their parent, so going backwards finds them hashed. The own bytes
+    // are the gaps between the subordinated records.
+    for(uint32_t i = count; i-- > 0;)
+    {
+      merkle_node_t& node = nodes[i];
+      uint32_t end = i + node.subtree_size;
+      uint32_t cursor = node.offset + node.header_size;
+      uint64_t own = mix(node.type);
+      for(uint32_t child = i + 1; child < end; child += nodes[child].subtree_size)
+      {
+        own = content_hash(data + cursor, nodes[child].offset - cursor, own);
+        cursor = nodes[child].offset + nodes[child].record_size;
+      }
+      own = content_hash(data + cursor, node.offset + node.record_size - cursor, own);
+
+      uint64_t hash = own;
+      for(uint32_t child = i + 1; child < end; child += nodes[child].subtree_size)
+        hash = combine(hash, nodes[child].hash);
+      node.own_hash = own;
+      node.hash = hash;
+    }
+
+    for(uint32_t i = 0; i < count; i += nodes[i].subtree_size)
+      tree.hash = combine(tree.hash, nodes[i].hash);
+    return tree;
+  }
+
+  struct tree_differ_t
+  {
+    const merkle_tree_t& before;
+    const uint8_t* before_data;
+    const merkle_tree_t& after;
+    const uint8_t* after_data;
+    merkle_diff_t& result;
+
+    std::vector<uint32_t> before_points; // points without an identical counterpart so far
+    std::vector<uint32_t> after_points;
+
+    static std::vector<uint32_t> children(const merkle_tree_t& tree, uint32_t begin, uint32_t end)
+    {
+      std::vector<uint32_t> list;
+      for(uint32_t i = begin; i < end; i += tree.nodes[i].subtree_size)
+        list.push_back(i);
+      return list;
+    }
+
+    static std::vector<uint32_t> children(const merkle_tree_t& tree, uint32_t node)
+      { return children(tree, node + 1, node + tree.nodes[node].subtree_size); }
+
+    static void collect_points(const merkle_tree_t& tree, uint32_t node, std::vector<uint32_t>& points)
+    {
+      for(uint32_t i = node; i < node + tree.nodes[node].subtree_size; ++i)
+        if(tree.nodes[i].type == Point)
+          points.push_back(i);
+    }
+
+    // raw coordinates, 0 for a point too short to hold them
+    static uint64_t location(const merkle_tree_t& tree, const uint8_t* data, uint32_t node)
+    {
+      const merkle_node_t& point = tree.nodes[node];
+      if(point.record_size < point.header_size + sizeof(wire::coords32_t))
+        return 0;
+      wire::coords32_t coordinates;
+      std::memcpy(&coordinates, data + point.offset + point.header_size, sizeof(coordinates));
+      return uint64_t(wire::from_le(coordinates.latitude)) << 32 | wire::from_le(coordinates.longitude);
+    }
+
+    // Pairs the entries of equal keys in order and leaves the others in the lists, sorted by key.
+    template<typename before_key_t, typename after_key_t, typename pair_t>
+    static void pair_by(std::vector<uint32_t>& before_list, std::vector<uint32_t>& after_list,
+                        const before_key_t& before_key, const after_key_t& after_key, const pair_t& pair)
+    {
+      std::stable_sort(before_list.begin(), before_list.end(),
+                       [&before_key](uint32_t a, uint32_t b) { return before_key(a) < before_key(b); });
+      std::stable_sort(after_list.begin(), after_list.end(),
+                       [&after_key](uint32_t a, uint32_t b) { return after_key(a) < after_key(b); });
+
+      std::vector<uint32_t> before_rest;
+      std::vector<uint32_t> after_rest;
+      size_t i = 0;
+      size_t j = 0;
+      while(i < before_list.size() && j < after_list.size())
+      {
+        auto key = before_key(before_list[i]);
+        auto other = after_key(after_list[j]);
+        if(key < other)
+          before_rest.push_back(before_list[i++]);
+        else if(other < key)
+          after_rest.push_back(after_list[j++]);
+        else
+          pair(before_list[i++], after_list[j++]);
+      }
+      before_rest.insert(before_rest.end(), before_list.begin() + i, before_list.end());
+      after_rest.insert(after_rest.end(), after_list.begin() + j, after_list.end());
+      before_list.swap(before_rest);
+      after_list.swap(after_rest);
+    }
+
+    static void move_points(const merkle_tree_t& tree, std::vector<uint32_t>& list, std::vector<uint32_t>& points)
+    {
+      auto containers = std::stable_partition(list.begin(), list.end(),
+                                              [&tree](uint32_t node) { return tree.nodes[node].type != Point; });
+      points.insert(points.end(), containers, list.end());
+      list.erase(containers, list.end());
+    }
+
+    // compares two lists of sibling subtrees
+    void compare(std::vector<uint32_t> before_list, std::vector<uint32_t> after_list)
+    {
+      result.nodes_compared += uint32_t(before_list.size() + after_list.size());
+      auto ignore = [](uint32_t, uint32_t) { };
+      auto descend = [this](uint32_t a, uint32_t b) { compare(children(before, a), children(after, b)); };
+
+      pair_by(before_list, after_list,
+              [this](uint32_t node) { return before.nodes[node].hash; },
+              [this](uint32_t node) { return after.nodes[node].hash; }, ignore);
+
+      // points are matched once all are known, they may have moved to another area
+      move_points(before, before_list, before_points);
+      move_points(after, after_list, after_points);
+
+      // containers of the same type are paired by their own content first, then in file order
+      pair_by(before_list, after_list,
+              [this](uint32_t node) { return std::make_pair(before.nodes[node].type, before.nodes[node].own_hash); },
+              [this](uint32_t node) { return std::make_pair(after.nodes[node].type, after.nodes[node].own_hash); }, descend);
+      pair_by(before_list, after_list,
+              [this](uint32_t node) { return before.nodes[node].type; },
+              [this](uint32_t node) { return after.nodes[node].type; }, descend);
+
+      for(uint32_t node : before_list)
+        collect_points(before, node, before_points);
+      for(uint32_t node : after_list)
+        collect_points(after, node, after_points);
+    }
+
+    point_change_t change(point_change_kind_t kind, uint32_t before_node, uint32_t after_node)
+    {
+      uint64_t raw = after_node != UINT32_MAX ? location(after, after_data, after_node) : location(before, before_data, before_node);
+      return point_change_t { kind,
+                              before_node != UINT32_MAX ? before.nodes[before_node].offset : UINT32_MAX,
+                              after_node != UINT32_MAX ? after.nodes[after_node].offset : UINT32_MAX,
+                              wire::coord32_degrees(uint32_t(raw >> 32)),
+                              wire::coord32_degrees(uint32_t(raw)) };
+    }
+
+    void points(void)
+    {
+      pair_by(before_points, after_points,
+              [this](uint32_t node) { return before.nodes[node].hash; },
+              [this](uint32_t node) { return after.nodes[node].hash; },
+              [](uint32_t, uint32_t) { });
+      result.nodes_compared += uint32_t(before_points.size() + after_points.size());
+
+      pair_by(before_points, after_points,
+              [this](uint32_t node) { return location(before, before_data, node); },
+              [this](uint32_t node) { return location(after, after_data, node); },
+              [this](uint32_t a, uint32_t b) { result.points.push_back(change(PointChanged, a, b)); });
+      for(uint32_t node : before_points)
+        result.points.push_back(change(PointRemoved, node, UINT32_MAX));
+
+      std::sort(result.points.begin(), result.points.end(),
+                [](const point_change_t& a, const point_change_t& b) { return a.before_offset < b.before_offset; });
+      for(uint32_t node : after_points)
+        result.points.push_back(change(PointAdded, UINT32_MAX, node));
+      std::sort(result.points.end() - after_points.size(), result.points.end(),
+                [](const point_change_t& a, const point_change_t& b) { return a.after_offset < b.after_offset; });
+    }
+  };
+
+  merkle_diff_t merkle_diff(const merkle_tree_t& before, const uint8_t* before_data,
+                            const merkle_tree_t& after, const uint8_t* after_data)
+  {
+    merkle_diff_t result;
+    if(!before.good() || !after.good())
+      return result;
+
+    result.identical = before.hash == after.hash;
+    if(result.identical)
+      return result;
+
+    tree_differ_t differ { before, before_data, after, after_data, result, { }, { } };
+    differ.compare(tree_differ_t::children(before, 0, uint32_t(before.nodes.size())),
+                   tree_differ_t::children(after, 0, uint32_t(after.nodes.size())));
+    differ.points();
+    return result;
+  }
+
+  bool read_record_at(const uint8_t* data, size_t size, uint32_t offset, any_record_t& record)
+  {
+    if(offset >= size)
+      return false;
+    span_buffer_t buffer(data + offset, size - offset);
+    std::istream is(&buffer);
+    is >> record;
+    return !is.fail();
+  }
+} // namespace garmin
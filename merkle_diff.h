@@ -0,0 +1,76 @@
+#ifndef MERKLE_DIFF_H
+#define MERKLE_DIFF_H
+
+#include "skim.h"
+
+#include <vector>
+
+// Content hashes of every record subtree of a file image, taken in one pass over the table of
+// contents of skim, and a diff of two such trees. The diff descends only into subtrees whose hashes
+// differ, so its work follows the size of the change and not the size of the files. Hashes are taken
+// over the encoded bytes, a record written differently with the same content counts as changed.
+
+namespace garmin
+{
+  struct merkle_node_t
+  {
+    uint64_t hash;         // type, own bytes and the hashes of the subordinated records in order
+    uint64_t own_hash;     // type and own bytes, the data without the subordinated records
+    uint32_t offset;       // of the record header
+    uint32_t record_size;  // header, main data and extra data
+    uint32_t subtree_size; // nodes of the subtree including this one, the next sibling follows them
+    record_id_t type;
+    uint8_t depth;
+    uint8_t header_size;
+  };
+  static_assert(sizeof(merkle_node_t) == 32, "packing failure");
+
+  struct merkle_tree_t
+  {
+    bool good(void) const { return error == SkimOk; }
+
+    skim_error_t error = SkimOk;
+    uint64_t hash = 0;                 // of the top level records in order
+    std::vector<merkle_node_t> nodes;  // all records in file order
+  };
+
+  // obfuscated images have to go through deobfuscate() first, as bulk_loader_t and file_prefetcher_t
+  // hand them out, they fail with Obfuscated otherwise
+  merkle_tree_t merkle_tree(const uint8_t* data, size_t size);
+
+  enum point_change_kind_t : uint8_t
+  {
+    PointAdded = 0,
+    PointRemoved,
+    PointChanged, // same coordinates, different content including the subordinated records
+  };
+
+  struct point_change_t
+  {
+    point_change_kind_t kind;
+    uint32_t before_offset; // of the point record in the images, UINT32_MAX where it does not exist
+    uint32_t after_offset;
+    double latitude;
+    double longitude;
+  };
+
+  struct merkle_diff_t
+  {
+    bool identical = false;
+    uint32_t nodes_compared = 0;
+    std::vector<point_change_t> points; // removed and changed in the order of before, then added
+  };
+
+  // Points are matched by subtree hash first, so points that only moved to another area are not
+  // reported, then by coordinates. Changes to records other than points only clear identical.
+  merkle_diff_t merkle_diff(const merkle_tree_t& before, const uint8_t* before_data,
+                            const merkle_tree_t& after, const uint8_t* after_data);
+
+  // 64 bit hash the trees are built with, not cryptographic
+  uint64_t content_hash(const uint8_t* data, size_t size, uint64_t seed = 0);
+
+  // decodes the record at offset of an image including its subordinated records
+  bool read_record_at(const uint8_t* data, size_t size, uint32_t offset, any_record_t& record);
+} // namespace garmin
+
+#endif // MERKLE_DIFF_H
@@ -0,0 +1,354 @@
+#include "name_index.h"
+#include "codepage.h"
+#include "parallel.h"
+#include "record_dispatch.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cctype>
+#include <queue>
+
+namespace garmin
+{
+  static constexpr char latin_letters[] = // base letters of 0xC0 to 0x17F, 0 where there is none
+    "aaaaaa\0ceeeeiiii\0nooooo\0\0uuuuy\0\0"
+    "aaaaaa\0ceeeeiiii\0nooooo\0\0uuuuy\0y"
+    "aaaaaaccccccccdd\0\0eeeeeeeeeegggg"
+    "gggghh\0\0iiiiiiiii\0\0\0jjkk\0llllll\0"
+    "\0\0\0nnnnnn\0\0\0oooooo\0\0rrrrrrssssss"
+    "sstttt\0\0uuuuuuuuuuuuwwyyyzzzzzz\0"
+    ;
+
+  static uint32_t fold(uint32_t code_point)
+  {
+    if(code_point < 0x80)
+      return code_point >= 'A' && code_point <= 'Z' ? code_point + 0x20 : code_point;
+    if(code_point >= 0xC0 && code_point < 0x180 && latin_letters[code_point - 0xC0])
+      return uint8_t(latin_letters[code_point - 0xC0]);
+    if(code_point >= 0xC0 && code_point <= 0xDE && code_point != 0xD7)
+      return code_point + 0x20;
+    if(code_point >= 0x100 && code_point < 0x180) // upper and lower case alternate
+    {
+      bool odd_upper = (code_point >= 0x139 && code_point <= 0x148) || code_point >= 0x179;
+      if((code_point & 1) == (odd_upper ? 1 : 0) && code_point != 0x138 && code_point != 0x149 && code_point != 0x17F)
+        return code_point + 1;
+      return code_point;
+    }
+    if((code_point >= 0x391 && code_point <= 0x3A9 && code_point != 0x3A2) || (code_point >= 0x410 && code_point <= 0x42F))
+      return code_point + 0x20; // Greek and Cyrillic
+    if(code_point >= 0x400 && code_point <= 0x40F)
+      return code_point + 0x50;
+    return code_point;
+  }
+
+  std::string normalize_name(std::string_view text)
+  {
+    std::string result;
+    result.reserve(text.size());
+    bool separator = false;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(text.data());
+    for(size_t pos = 0; pos < text.size();)
+    {
+      uint32_t code_point = next_code_point(data, text.size(), pos);
+      if(code_point < 0x80 && !std::isalnum(int(code_point)))
+        separator = !result.empty(); // punctuation and spaces separate words
+      else
+      {
+        if(separator)
+          result.push_back(' ');
+        separator = false;
+        append_utf8(result, fold(code_point));
+      }
+    }
+    return result;
+  }
+
+  // distinct trigrams of a normalized name, as three bytes
+  static void name_trigrams(std::string_view name, std::vector<uint32_t>& result)
+  {
+    result.clear();
+    for(size_t i = 0; i + 3 <= name.size(); ++i)
+      result.push_back((uint32_t(uint8_t(name[i])) << 16) | (uint32_t(uint8_t(name[i + 1])) << 8) | uint8_t(name[i + 2]));
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+  }
+
+  struct name_index_t::named_point_t
+  {
+    std::string name;
+    point_handle_t handle;
+
+    bool operator<(const named_point_t& other) const
+      { return name < other.name || (name == other.name && handle < other.handle); }
+  };
+
+  struct point_visit_t
+  {
+    const std::function<void(const point_t&, codepage_t)>& visitor;
+    codepage_t codepage;
+
+    template<typename T>
+    void walk(const T& data)
+    {
+      if constexpr(std::is_same_v<T, poi_header_t>)
+        codepage = data.codepage;
+      else if constexpr(std::is_same_v<T, point_t>)
+        visitor(data, codepage);
+      else if constexpr(std::is_same_v<T, poi_group_t>)
+        for(const area_t& area : data.areas)
+          walk(area);
+
+      for(const any_record_t& child : data.child_records)
+        record(child);
+    }
+
+    void record(const any_record_t& data)
+    {
+      visit_record([this](const auto& record) { walk(record); }, data);
+    }
+  };
+
+  void visit_points(const std::vector<any_record_t>& records, const std::function<void(const point_t&, codepage_t)>& visitor)
+  {
+    point_visit_t visit { visitor, Unicode };
+    for(const any_record_t& record : records)
+      visit.record(record);
+  }
+
+  void name_index_t::build(const std::vector<const std::vector<any_record_t>*>& files, uint32_t threads)
+  {
+    points.assign(files.size(), {});
+    std::vector<std::vector<named_point_t>> file_names(files.size());
+    run_parallel(files.size(), threads, [&](size_t i)
+    {
+      std::string text;
+      visit_points(*files[i], [&](const point_t& point, codepage_t codepage)
+      {
+        point_handle_t handle { uint32_t(i), uint32_t(points[i].size()) };
+        points[i].push_back(&point);
+        for(const auto& pair : point.shortname)
+        {
+          text.clear();
+          to_utf8(codepage, pair.second.data(), pair.second.size(), text);
+          std::string name = normalize_name(text);
+          if(!name.empty())
+            file_names[i].push_back(named_point_t { std::move(name), handle });
+        }
+      });
+      std::sort(file_names[i].begin(), file_names[i].end());
+    });
+    index(file_names, threads);
+  }
+
+  void name_index_t::attach(const snapshot_t& snapshot)
+  {
+    *this = name_index_t();
+    points.resize(snapshot.file_count());
+    arrays = snapshot.name_index_arrays();
+  }
+
+  // Merges sorted runs in one pass with a heap over the heads of the runs, which are emptied. Each
+  // element is moved once, instead of once per run as when merging the runs one after another.
+  template<typename T>
+  static std::vector<T> merge_runs(std::vector<std::vector<T>>& runs)
+  {
+    size_t total = 0;
+    for(const auto& run : runs)
+      total += run.size();
+    std::vector<T> merged;
+    merged.reserve(total);
+
+    using head_t = std::pair<size_t, size_t>; // run and position in it
+    auto later = [&runs](const head_t& a, const head_t& b) { return runs[b.first][b.second] < runs[a.first][a.second]; };
+    std::priority_queue<head_t, std::vector<head_t>, decltype(later)> heads(later);
+    for(size_t i = 0; i < runs.size(); ++i)
+      if(!runs[i].empty())
+        heads.emplace(i, 0);
+
+    while(!heads.empty())
+    {
+      head_t head = heads.top();
+      heads.pop();
+      merged.push_back(std::move(runs[head.first][head.second]));
+      if(++head.second < runs[head.first].size())
+        heads.push(head);
+      else
+        runs[head.first] = std::vector<T>();
+    }
+    return merged;
+  }
+
+  // pool, handles and trigram postings of the sorted names of every file
+  void name_index_t::index(std::vector<std::vector<named_point_t>>& file_names, uint32_t threads)
+  {
+    // merge the sorted names of the files, equal names share one pool entry
+    std::vector<named_point_t> names = merge_runs(file_names);
+
+    pool.clear();
+    name_offsets.clear();
+    handle_offsets.clear();
+    handles.clear();
+    handles.reserve(names.size());
+    for(size_t i = 0; i < names.size(); ++i)
+    {
+      if(!i || names[i].name != names[i - 1].name)
+      {
+        name_offsets.push_back(uint32_t(pool.size()));
+        handle_offsets.push_back(uint32_t(handles.size()));
+        pool.insert(pool.end(), names[i].name.begin(), names[i].name.end());
+      }
+      if(!i || !(names[i].handle == names[i - 1].handle) || names[i].name != names[i - 1].name)
+        handles.push_back(names[i].handle);
+    }
+    name_offsets.push_back(uint32_t(pool.size()));
+    handle_offsets.push_back(uint32_t(handles.size()));
+    names = std::vector<named_point_t>();
+
+    pool.shrink_to_fit();
+    handles.shrink_to_fit();
+    arrays.pool = { pool.data(), pool.size() };
+    arrays.name_offsets = { name_offsets.data(), name_offsets.size() };
+    arrays.handle_offsets = { handle_offsets.data(), handle_offsets.size() };
+    arrays.handles = { handles.data(), handles.size() };
+
+    // trigram postings, collected per slice of names and sorted as trigram and name id pairs
+    size_t count = name_count();
+    size_t slices = std::max<size_t>(1, std::min<size_t>(64, count / 4096));
+    std::vector<std::vector<uint64_t>> slice_pairs(slices);
+    run_parallel(slices, threads, [&](size_t slice)
+    {
+      std::vector<uint32_t> found;
+      for(size_t id = count * slice / slices; id < count * (slice + 1) / slices; ++id)
+      {
+        name_trigrams(name(uint32_t(id)), found);
+        for(uint32_t trigram : found)
+          slice_pairs[slice].push_back((uint64_t(trigram) << 32) | id);
+      }
+      std::sort(slice_pairs[slice].begin(), slice_pairs[slice].end());
+    });
+
+    std::vector<uint64_t> pairs = merge_runs(slice_pairs);
+
+    trigrams.clear();
+    trigram_offsets.clear();
+    postings.clear();
+    postings.reserve(pairs.size());
+    for(size_t i = 0; i < pairs.size(); ++i)
+    {
+      uint32_t trigram = uint32_t(pairs[i] >> 32);
+      if(trigrams.empty() || trigrams.back() != trigram)
+      {
+        trigrams.push_back(trigram);
+        trigram_offsets.push_back(uint32_t(postings.size()));
+      }
+      postings.push_back(uint32_t(pairs[i]));
+    }
+    trigram_offsets.push_back(uint32_t(postings.size()));
+
+    trigrams.shrink_to_fit();
+    trigram_offsets.shrink_to_fit();
+    arrays.trigrams = { trigrams.data(), trigrams.size() };
+    arrays.trigram_offsets = { trigram_offsets.data(), trigram_offsets.size() };
+    arrays.postings = { postings.data(), postings.size() };
+  }
+
+  void name_index_t::add_points(uint32_t id, std::vector<point_handle_t>& result) const
+  {
+    result.insert(result.end(), arrays.handles.begin() + arrays.handle_offsets[id], arrays.handles.begin() + arrays.handle_offsets[id + 1]);
+  }
+
+  // points in handle order, each once
+  std::vector<point_handle_t> name_index_t::finish(std::vector<point_handle_t>& result, size_t limit) const
+  {
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    if(result.size() > limit)
+      result.resize(limit);
+    return std::move(result);
+  }
+
+  std::vector<point_handle_t> name_index_t::prefix(std::string_view query, size_t limit) const
+  {
+    std::string normalized = normalize_name(query);
+    std::vector<point_handle_t> result;
+    if(!name_count())
+      return result;
+
+    // the names starting with the query form one range of the sorted names
+    uint32_t first = 0;
+    uint32_t last = uint32_t(name_count());
+    while(first < last)
+    {
+      uint32_t middle = first + (last - first) / 2;
+      if(name(middle) < normalized)
+        first = middle + 1;
+      else
+        last = middle;
+    }
+    for(uint32_t id = first; id < name_count() && name(id).substr(0, normalized.size()) == normalized; ++id)
+      add_points(id, result);
+    return finish(result, limit);
+  }
+
+  std::vector<point_handle_t> name_index_t::contains(std::string_view query, size_t limit) const
+  {
+    std::string normalized = normalize_name(query);
+    std::vector<point_handle_t> result;
+
+    std::vector<uint32_t> found;
+    name_trigrams(normalized, found);
+    if(found.empty()) // too short for trigrams, every name is a candidate
+    {
+      for(uint32_t id = 0; id < name_count(); ++id)
+        if(name(id).find(normalized) != std::string_view::npos)
+          add_points(id, result);
+      return finish(result, limit);
+    }
+
+    // posting ranges of the trigrams, shortest first
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    for(uint32_t trigram : found)
+    {
+      auto pos = std::lower_bound(arrays.trigrams.begin(), arrays.trigrams.end(), trigram);
+      if(pos == arrays.trigrams.end() || *pos != trigram)
+        return result;
+      size_t index = size_t(pos - arrays.trigrams.begin());
+      ranges.emplace_back(arrays.trigram_offsets[index], arrays.trigram_offsets[index + 1]);
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const auto& a, const auto& b) { return a.second - a.first < b.second - b.first; });
+
+    std::vector<uint32_t> candidates(arrays.postings.begin() + ranges[0].first, arrays.postings.begin() + ranges[0].second);
+    std::vector<uint32_t> remaining;
+    for(size_t i = 1; i < ranges.size() && !candidates.empty(); ++i)
+    {
+      remaining.clear();
+      std::set_intersection(candidates.begin(), candidates.end(),
+                            arrays.postings.begin() + ranges[i].first, arrays.postings.begin() + ranges[i].second,
+                            std::back_inserter(remaining));
+      candidates.swap(remaining);
+    }
+
+    // trigrams may match out of order, the name itself decides
+    for(uint32_t id : candidates)
+      if(name(id).find(normalized) != std::string_view::npos)
+        add_points(id, result);
+    return finish(result, limit);
+  }
+
+  const point_t* name_index_t::point(point_handle_t handle) const
+  {
+    if(handle.file >= points.size() || handle.point >= points[handle.file].size())
+      return nullptr;
+    return points[handle.file][handle.point];
+  }
+
+  size_t name_index_t::memory_usage(void) const
+  {
+    size_t total = pool.capacity() + sizeof(point_handle_t) * handles.capacity() +
+                   sizeof(uint32_t) * (name_offsets.capacity() + handle_offsets.capacity() +
+                                       trigrams.capacity() + trigram_offsets.capacity() + postings.capacity());
+    for(const auto& file : points)
+      total += sizeof(const point_t*) * file.capacity();
+    return total;
+  }
+} // namespace garmin
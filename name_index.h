@@ -0,0 +1,112 @@
+#ifndef NAME_INDEX_H
+#define NAME_INDEX_H
+
+#include "record_types.h"
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Search of point names across loaded files. Names of all locales are converted to UTF-8, case
+// folded, stripped of Latin diacritics and reduced to single spaces between words. Each distinct
+// name is stored once in a sorted pool for prefix search, with a trigram list for substring search.
+
+namespace garmin
+{
+  struct point_handle_t
+  {
+    uint32_t file;  // position in the list the index was built from
+    uint32_t point; // points of a file counted in file order
+
+    bool operator<(const point_handle_t& other) const
+      { return file < other.file || (file == other.file && point < other.point); }
+    bool operator==(const point_handle_t& other) const
+      { return file == other.file && point == other.point; }
+  };
+
+  // the form names and queries are compared in
+  std::string normalize_name(std::string_view text);
+
+  // the points of a file in point handle order, with the codepage of their text
+  void visit_points(const std::vector<any_record_t>& records, const std::function<void(const point_t&, codepage_t)>& visitor);
+
+  // a read only array, in memory of its owner or in a mapped image
+  template<typename T>
+  struct array_view_t
+  {
+    const T* data = nullptr;
+    size_t size = 0;
+
+    const T* begin(void) const { return data; }
+    const T* end(void) const { return data + size; }
+    const T& operator[](size_t index) const { return data[index]; }
+    bool empty(void) const { return !size; }
+  };
+
+  // the arrays of a name index, which snapshots store as they are
+  struct name_index_arrays_t
+  {
+    array_view_t<char> pool;                     // distinct names in sorted order
+    array_view_t<uint32_t> name_offsets;         // name id to its start in pool, one more for the end
+    array_view_t<uint32_t> handle_offsets;       // name id to its first handle, one more for the end
+    array_view_t<point_handle_t> handles;
+    array_view_t<uint32_t> trigrams;             // distinct trigrams in sorted order
+    array_view_t<uint32_t> trigram_offsets;      // trigram position to its first posting, one more for the end
+    array_view_t<uint32_t> postings;             // name ids in increasing order per trigram
+  };
+
+  class snapshot_t;
+
+  class name_index_t
+  {
+  public:
+    // moves keep the arrays of a built index valid, copies would not
+    name_index_t(void) = default;
+    name_index_t(name_index_t&&) = default;
+    name_index_t& operator=(name_index_t&&) = default;
+    name_index_t(const name_index_t&) = delete;
+    name_index_t& operator=(const name_index_t&) = delete;
+
+    // the records of the files must stay unchanged while the index is used
+    void build(const std::vector<const std::vector<any_record_t>*>& files, uint32_t threads = 0);
+
+    // Uses the index stored in a snapshot in place, the snapshot must stay open while the index is
+    // used. There are no records then, snapshot_t::row() finds the point of a handle.
+    void attach(const snapshot_t& snapshot);
+
+    // points with a name starting with query, or containing it
+    std::vector<point_handle_t> prefix(std::string_view query, size_t limit = SIZE_MAX) const;
+    std::vector<point_handle_t> contains(std::string_view query, size_t limit = SIZE_MAX) const;
+
+    const point_t* point(point_handle_t handle) const; // nullptr when attached to a snapshot
+    size_t name_count(void) const { return arrays.name_offsets.empty() ? 0 : arrays.name_offsets.size - 1; }
+    const name_index_arrays_t& data(void) const { return arrays; }
+    size_t memory_usage(void) const; // heap memory, without an attached snapshot
+
+  private:
+    struct named_point_t;
+
+    std::string_view name(uint32_t id) const
+    {
+      return std::string_view(arrays.pool.data + arrays.name_offsets[id],
+                              arrays.name_offsets[id + 1] - arrays.name_offsets[id]);
+    }
+    void add_points(uint32_t id, std::vector<point_handle_t>& result) const;
+    std::vector<point_handle_t> finish(std::vector<point_handle_t>& result, size_t limit) const;
+    void index(std::vector<std::vector<named_point_t>>& file_names, uint32_t threads);
+
+    std::vector<std::vector<const point_t*>> points; // per file, by point number
+
+    name_index_arrays_t arrays; // of the storage below or of a snapshot
+
+    std::vector<char> pool;
+    std::vector<uint32_t> name_offsets;
+    std::vector<uint32_t> handle_offsets;
+    std::vector<point_handle_t> handles;
+    std::vector<uint32_t> trigrams;
+    std::vector<uint32_t> trigram_offsets;
+    std::vector<uint32_t> postings;
+  };
+} // namespace garmin
+
+#endif // NAME_INDEX_H
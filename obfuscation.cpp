@@ -0,0 +1,323 @@
+#include "obfuscation.h"
+#include "record_types.h"
+#include "wire_types.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace garmin
+{
+  static constexpr uint16_t extra_data_flag = 0x0008; // header flags bit3
+  static constexpr uint16_t obfuscated_flag = 0x0100; // garmin header flags bit8
+
+  // nibble wise: encode_key adds 0x48 0x06 0xB3 0x00, decode_key holds their nibble wise negations
+  // so adding it subtracts them
+  static constexpr uint8_t encode_key[4] = { 0x48, 0x06, 0xB3, 0x00 };
+  static constexpr uint8_t decode_key[4] = { 0xC8, 0x0A, 0x5D, 0x00 };
+
+  template<typename T>
+  static T load(const uint8_t* pos)
+  {
+    T value;
+    std::memcpy(&value, pos, sizeof(T));
+    return wire::from_le(value);
+  }
+
+  bool obfuscation_start(const uint8_t* data, size_t size, uint64_t& start)
+  {
+    if(size < 8)
+      return false;
+    uint64_t header_size = load<uint16_t>(data + 2) & extra_data_flag ? 12 : 8;
+    if(load<uint16_t>(data) != GarminHeader)
+    {
+      start = 0; // not a GPI file, nothing to change
+      return true;
+    }
+
+    uint64_t flags_offset = header_size + offsetof(wire::garmin_header_t, flags);
+    uint64_t next = header_size + load<uint32_t>(data + 4);
+    if(size < flags_offset + sizeof(uint16_t) || size < next + 8)
+      return false;
+    bool obfuscated = load<uint16_t>(data + flags_offset) & obfuscated_flag;
+
+    header_size = load<uint16_t>(data + next + 2) & extra_data_flag ? 12 : 8;
+    start = obfuscated ? next + header_size + load<uint32_t>(data + next + 4) : 0;
+    return true;
+  }
+
+  // offset of the byte of the garmin header flags that holds the obfuscation flag, as bit0
+  static inline uint64_t flag_byte(const uint8_t* data)
+  {
+    uint64_t header_size = load<uint16_t>(data + 2) & extra_data_flag ? 12 : 8;
+    return header_size + offsetof(wire::garmin_header_t, flags) + 1;
+  }
+
+  // Adds key to each nibble without carries between them. The low three bits of every nibble are
+  // added with room to spare and the top bit is fixed up by exclusive or, so 8 bytes go at once.
+  static constexpr uint64_t add_nibbles(uint64_t value, uint64_t key)
+  {
+    constexpr uint64_t low_bits = 0x7777777777777777;
+    return ((value & low_bits) + (key & low_bits)) ^ ((value ^ key) & ~low_bits);
+  }
+
+  // known answers from the start of an obfuscated Index record, one for each phase:
+  // plain 15 00 00 00 3A 00 is stored as 5D 06 B3 00 72 06
+  static_assert(add_nibbles(0x15, encode_key[0]) == 0x5D && add_nibbles(0x5D, decode_key[0]) == 0x15);
+  static_assert(add_nibbles(0x00, encode_key[1]) == 0x06 && add_nibbles(0x06, decode_key[1]) == 0x00);
+  static_assert(add_nibbles(0x00, encode_key[2]) == 0xB3 && add_nibbles(0xB3, decode_key[2]) == 0x00);
+  static_assert(add_nibbles(0x00, encode_key[3]) == 0x00 && add_nibbles(0x00, decode_key[3]) == 0x00);
+  static_assert(add_nibbles(0x3A, encode_key[0]) == 0x72 && add_nibbles(0x72, decode_key[0]) == 0x3A);
+  static_assert(add_nibbles(0x58, encode_key[0]) == 0x90); // no carry from the low nibble, a byte sum is 0xA0
+
+  static void add_key(uint8_t* data, size_t size, uint64_t position, const uint8_t (&key)[4])
+  {
+    uint8_t phased[8];
+    for(size_t i = 0; i < sizeof(phased); ++i)
+      phased[i] = key[(position + i) % 4];
+    uint64_t word_key;
+    std::memcpy(&word_key, phased, sizeof(word_key));
+
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i vector_key = _mm_set1_epi64x(int64_t(word_key));
+    const __m128i low_bits = _mm_set1_epi8(0x77);
+    for(; i + 16 <= size; i += 16)
+    {
+      __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      __m128i sum = _mm_add_epi64(_mm_and_si128(value, low_bits), _mm_and_si128(vector_key, low_bits));
+      __m128i top = _mm_andnot_si128(low_bits, _mm_xor_si128(value, vector_key));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_xor_si128(sum, top));
+    }
+#endif
+    for(; i + 8 <= size; i += 8)
+    {
+      uint64_t value;
+      std::memcpy(&value, data + i, sizeof(value));
+      value = add_nibbles(value, word_key);
+      std::memcpy(data + i, &value, sizeof(value));
+    }
+    for(; i < size; ++i)
+      data[i] = uint8_t(add_nibbles(data[i], phased[i % 8]));
+  }
+
+  void deobfuscate(uint8_t* data, size_t size, uint64_t position)
+  {
+    add_key(data, size, position, decode_key);
+  }
+
+  void obfuscate(uint8_t* data, size_t size, uint64_t position)
+  {
+    add_key(data, size, position, encode_key);
+  }
+
+  bool deobfuscate(uint8_t* data, size_t size)
+  {
+    uint64_t start = 0;
+    if(!obfuscation_start(data, size, start) || !start || start >= size)
+      return false;
+    deobfuscate(data + start, size - start, 0);
+    data[flag_byte(data)] &= uint8_t(~(obfuscated_flag >> 8));
+    return true;
+  }
+
+  // changes the bytes of a buffer at position in the file that lie past start
+  template<void (*transform)(uint8_t*, size_t, uint64_t)>
+  static void transform_range(char* data, size_t size, uint64_t position, uint64_t start)
+  {
+    if(!start || position + size <= start)
+      return;
+    uint64_t skip = position < start ? start - position : 0;
+    transform(reinterpret_cast<uint8_t*>(data) + skip, size - skip, position + skip - start);
+  }
+
+
+  deobfuscating_buffer_t::deobfuscating_buffer_t(std::streambuf& source, size_t buffer_size)
+    : source(source),
+      buffer(buffer_size),
+      origin(source.pubseekoff(0, std::ios_base::cur, std::ios_base::in)),
+      position(0),
+      start(0),
+      flag_position(0),
+      headers_read(false)
+  {
+    setg(buffer.data(), buffer.data(), buffer.data());
+  }
+
+  bool deobfuscating_buffer_t::obfuscated(void)
+  {
+    if(!headers_read && gptr() == egptr())
+      underflow();
+    return start != 0;
+  }
+
+  deobfuscating_buffer_t::int_type deobfuscating_buffer_t::underflow(void)
+  {
+    if(gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+
+    position += uint64_t(egptr() - eback());
+    size_t size = 0;
+    if(headers_read)
+      size = size_t(std::max<std::streamsize>(source.sgetn(buffer.data(), std::streamsize(buffer.size())), 0));
+    else
+    {
+      // the first fill holds both header records, the buffer grows for unusually large ones
+      while(!headers_read)
+      {
+        if(size == buffer.size())
+          buffer.resize(buffer.size() * 2);
+        std::streamsize count = source.sgetn(buffer.data() + size, std::streamsize(buffer.size() - size));
+        if(count > 0)
+          size += size_t(count);
+        headers_read = obfuscation_start(reinterpret_cast<uint8_t*>(buffer.data()), size, start);
+        if(count <= 0)
+          headers_read = true; // too short for a GPI file, pass it through
+      }
+      if(start)
+        flag_position = flag_byte(reinterpret_cast<uint8_t*>(buffer.data()));
+    }
+
+    transform_range<deobfuscate>(buffer.data(), size, position, start);
+    if(start && flag_position >= position && flag_position < position + size) // also when read again after a seek
+      buffer[size_t(flag_position - position)] &= char(~(obfuscated_flag >> 8));
+    setg(buffer.data(), buffer.data(), buffer.data() + size);
+    return size ? traits_type::to_int_type(*gptr()) : traits_type::eof();
+  }
+
+  deobfuscating_buffer_t::pos_type deobfuscating_buffer_t::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode)
+  {
+    const pos_type failed = pos_type(off_type(-1));
+    if(!(mode & std::ios_base::in) || origin == std::streamoff(-1))
+      return failed;
+    if(!headers_read)
+      obfuscated();
+
+    off_type target = offset;
+    if(direction == std::ios_base::end)
+    {
+      pos_type end = source.pubseekoff(0, std::ios_base::end, std::ios_base::in);
+      if(end == failed)
+        return failed;
+      target += off_type(end) - origin;
+    }
+    else
+    {
+      if(direction == std::ios_base::cur)
+        target += off_type(position) + (gptr() - eback());
+
+      // within the get area, as for short skips
+      if(target >= 0 && uint64_t(target) >= position && uint64_t(target) <= position + uint64_t(egptr() - eback()))
+      {
+        setg(eback(), eback() + (uint64_t(target) - position), egptr());
+        return pos_type(target);
+      }
+    }
+
+    if(target < 0)
+      return failed;
+    if(source.pubseekpos(pos_type(origin + target), std::ios_base::in) == failed)
+      return failed;
+    position = uint64_t(target);
+    setg(buffer.data(), buffer.data(), buffer.data());
+    return pos_type(target);
+  }
+
+  deobfuscating_buffer_t::pos_type deobfuscating_buffer_t::seekpos(pos_type position, std::ios_base::openmode mode)
+  {
+    return seekoff(off_type(position), std::ios_base::beg, mode);
+  }
+
+
+  obfuscating_buffer_t::obfuscating_buffer_t(std::streambuf& sink, size_t buffer_size)
+    : sink(sink),
+      buffer(buffer_size),
+      origin(sink.pubseekoff(0, std::ios_base::cur, std::ios_base::out)),
+      position(0),
+      start(0),
+      headers_read(false)
+  {
+    setp(buffer.data(), buffer.data() + buffer.size());
+  }
+
+  obfuscating_buffer_t::~obfuscating_buffer_t(void)
+  {
+    sync();
+  }
+
+  bool obfuscating_buffer_t::flush(void)
+  {
+    size_t size = size_t(pptr() - pbase());
+    if(!size)
+      return true;
+
+    if(!headers_read)
+    {
+      // all bytes before the headers are complete precede the obfuscated part
+      headers.insert(headers.end(), pbase(), pptr());
+      headers_read = obfuscation_start(headers.data(), headers.size(), start);
+      if(headers_read)
+        headers = std::vector<uint8_t>();
+    }
+
+    transform_range<obfuscate>(pbase(), size, position, start);
+    bool written = sink.sputn(pbase(), std::streamsize(size)) == std::streamsize(size);
+    position += size;
+    setp(buffer.data(), buffer.data() + buffer.size());
+    return written;
+  }
+
+  obfuscating_buffer_t::int_type obfuscating_buffer_t::overflow(int_type c)
+  {
+    if(!flush())
+      return traits_type::eof();
+    if(!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  int obfuscating_buffer_t::sync(void)
+  {
+    return flush() && sink.pubsync() == 0 ? 0 : -1;
+  }
+
+  obfuscating_buffer_t::pos_type obfuscating_buffer_t::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode)
+  {
+    const pos_type failed = pos_type(off_type(-1));
+    if(!(mode & std::ios_base::out) || !flush())
+      return failed;
+    if(direction == std::ios_base::cur && !offset)
+      return pos_type(off_type(position)); // tellp
+
+    // patches must not change the headers before it is known where obfuscation starts
+    if(origin == std::streamoff(-1) || !headers_read)
+      return failed;
+
+    off_type target = offset;
+    if(direction == std::ios_base::cur)
+      target += off_type(position);
+    else if(direction == std::ios_base::end)
+    {
+      pos_type end = sink.pubseekoff(0, std::ios_base::end, std::ios_base::out);
+      if(end == failed)
+        return failed;
+      target += off_type(end) - origin;
+    }
+    if(target < 0 || sink.pubseekpos(pos_type(origin + target), std::ios_base::out) == failed)
+      return failed;
+    position = uint64_t(target);
+    return pos_type(target);
+  }
+
+  obfuscating_buffer_t::pos_type obfuscating_buffer_t::seekpos(pos_type position, std::ios_base::openmode mode)
+  {
+    return seekoff(off_type(position), std::ios_base::beg, mode);
+  }
+} // namespace garmin
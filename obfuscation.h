@@ -0,0 +1,80 @@
+#ifndef OBFUSCATION_H
+#define OBFUSCATION_H
+
+#include <cstdint>
+#include <streambuf>
+#include <vector>
+
+// Obfuscated files (garmin_header_t::flags bit8) have every byte after the POI header record changed
+// by a nibble wise addition of 0x48, 0x06, 0xB3 and 0x00 in turn, up to the end of the file, so a
+// reader undoes it by a nibble wise subtraction of the same values (record type 0x15 is stored as
+// 0x5D). The stages below undo or apply it while bytes pass through, so the record parsers and
+// writers see plain records. Files that are not obfuscated pass through unchanged.
+
+namespace garmin
+{
+  // offset of the first obfuscated byte, 0 if the file is not obfuscated
+  // returns false when data does not hold both header records yet
+  bool obfuscation_start(const uint8_t* data, size_t size, uint64_t& start);
+
+  // In place on a whole file image, returns whether it was obfuscated. The flag in the garmin header
+  // is cleared, so the image is a plain file afterwards.
+  bool deobfuscate(uint8_t* data, size_t size);
+
+  // data is at offset position from the first obfuscated byte
+  void deobfuscate(uint8_t* data, size_t size, uint64_t position);
+  void obfuscate(uint8_t* data, size_t size, uint64_t position);
+
+  // Reads a file from source, which must be positioned at the start of the file. Positions are
+  // relative to that start. Obfuscated files are read as plain files, with the flag in the garmin
+  // header cleared like deobfuscate() does on an image.
+  class deobfuscating_buffer_t : public std::streambuf
+  {
+  public:
+    deobfuscating_buffer_t(std::streambuf& source, size_t buffer_size = 1 << 16);
+
+    bool obfuscated(void); // reads the headers if that did not happen yet
+
+  protected:
+    int_type underflow(void);
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode);
+    pos_type seekpos(pos_type position, std::ios_base::openmode mode);
+
+  private:
+    std::streambuf& source;
+    std::vector<char> buffer;
+    std::streamoff origin;   // of the file in source
+    uint64_t position;       // of the get area in the file
+    uint64_t start;
+    uint64_t flag_position;  // of the byte with the obfuscation flag, once start is known
+    bool headers_read;
+  };
+
+  // Writes a file to sink, obfuscated when the garmin header written first asks for it. Seeking
+  // back to patch earlier bytes works when the sink can seek.
+  class obfuscating_buffer_t : public std::streambuf
+  {
+  public:
+    obfuscating_buffer_t(std::streambuf& sink, size_t buffer_size = 1 << 16);
+    ~obfuscating_buffer_t(void);
+
+  protected:
+    int_type overflow(int_type c);
+    int sync(void);
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode);
+    pos_type seekpos(pos_type position, std::ios_base::openmode mode);
+
+  private:
+    bool flush(void);
+
+    std::streambuf& sink;
+    std::vector<char> buffer;
+    std::vector<uint8_t> headers; // first bytes of the file until both header records are complete
+    std::streamoff origin;
+    uint64_t position;       // of the put area in the file
+    uint64_t start;
+    bool headers_read;
+  };
+} // namespace garmin
+
+#endif // OBFUSCATION_H
@@ -0,0 +1,32 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace garmin
+{
+  // runs work(i) for every i below count on up to threads threads, 0 for the hardware concurrency
+  template<typename work_t>
+  void run_parallel(size_t count, uint32_t threads, const work_t& work)
+  {
+    size_t thread_count = std::min<size_t>(threads ? threads : std::max(std::thread::hardware_concurrency(), 1u), count);
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+      for(size_t i; (i = next++) < count;)
+        work(i);
+    };
+
+    std::vector<std::thread> workers;
+    for(size_t i = 1; i < thread_count; ++i)
+      workers.emplace_back(worker);
+    worker();
+    for(auto& thread : workers)
+      thread.join();
+  }
+} // namespace garmin
+
+#endif // PARALLEL_H
@@ -1,70 +1,78 @@
 #include "parsers.h"
+#include "record_dispatch.h"
+#include "wire_types.h"
+#include "trace.h"
 
 #include <type_traits>
-#include <iomanip>
+#include <algorithm>
+#include <cmath>
 
 #include <cassert>
 
-#define ISTREAM_DEBUG_START \
-  assert(is.good()); \
-  size_t start = input_pos(is); \
-  size_t end = start + data.data_size();
-
-#define ISTREAM_DEBUG_START_AUX \
-  assert(is.good()); \
-  size_t start = input_pos(is); \
-  size_t end = start + data.end_of_record;
-
-#define ISTREAM_DEBUG_END \
-  size_t pos = input_pos(is); \
-  if(pos < end) \
-  { \
-    std::cout << std::hex \
-              << "record start: 0x" << std::setw(8) << start << std::endl \
-              << "record pos:   0x" << std::setw(8) << pos << std::endl \
-              << "record end:   0x" << std::setw(8) << end << std::endl \
-              << std::dec << uint32_t(end - pos) << " bytes not parsed in type " << uint32_t(data.type) << std::endl << std::hex; \
-    is.seekg(end - pos, std::ios_base::cur); \
-  } \
-  else { assert(pos == end); }
-
 namespace garmin
 {
 // generic Read/Write function pairs
 
-  static size_t input_pos (std::istream& is) { return size_t(is.tellg()); }
-  static size_t output_pos(std::ostream& os) { return size_t(os.tellp()); }
+  // bytes taken by a record as given by its header, the readers always consume exactly this much
+  static uint32_t read_size(const any_record_t& data)
+  {
+    const record_header_t& header = record_header(data);
+    return header.header_size() + header.end_of_record;
+  }
+
+  // skips data a record reader did not interpret
+  static std::istream& skip_unparsed(std::istream& is, uint32_t parsed_size, uint32_t expected_size)
+  {
+    if(parsed_size > expected_size)
+      is.setstate(std::ios_base::failbit);
+    else if(parsed_size < expected_size)
+    {
+      record_trace_t::unparsed(expected_size - parsed_size);
+      is.ignore(expected_size - parsed_size);
+    }
+    return is;
+  }
+
+  template<typename T>
+  static std::istream& skip_unparsed(std::istream& is, const T& data)
+    { return skip_unparsed(is, data.calc_data_size(), data.data_size()); }
+
+  std::istream& skip_bytes(std::istream& is, uint32_t count)
+  {
+    if(count && is.good())
+    {
+      // seeking avoids copying through the stream buffer, streams that can not seek fall back to reading
+      if(is.rdbuf()->pubseekoff(count, std::ios_base::cur, std::ios_base::in) == std::streampos(std::streamoff(-1)))
+        is.ignore(count);
+    }
+    return is;
+  }
 
-  void read_child_records(std::istream& is, record_header_t& data, ssize_t bytes_remaining)
+  ssize_t read_child_records(std::istream& is, record_header_t& data, ssize_t bytes_remaining)
   {
-    static uint32_t read_depth = 0;
-    ++read_depth;
-//    std::cout << "lowering to depth: " << std::to_string(depth) << std::endl;
-    while(bytes_remaining > 0)
+    ssize_t bytes_read = 0;
+    while(bytes_read < bytes_remaining && is.good())
     {
-      assert(is.good());
-      size_t before = input_pos(is);
-      is >> data.child_records.emplace_back();
-      bytes_remaining -= input_pos(is) - before;
+      auto& child = data.child_records.emplace_back();
+      is >> child;
+      bytes_read += read_size(child);
     }
-    --read_depth;
-//    std::cout << "raising to depth: " << std::to_string(depth) << std::endl;
+    if(bytes_read != bytes_remaining) // children that overrun their parent
+      is.setstate(std::ios_base::failbit);
+    return bytes_read;
   }
 
   void write_child_records(std::ostream& os, const record_header_t& data, ssize_t bytes_remaining)
   {
     static uint32_t write_depth = 0;
     ++write_depth;
-    auto pos = std::begin(data.child_records);
-    const auto end = std::end(data.child_records);
-    while(bytes_remaining > 0)
+    for(const auto& child : data.child_records)
     {
-      assert(os.good() && pos != end);
-      size_t before = output_pos(os);
-      os << *pos;
-      pos++;
-      bytes_remaining -= output_pos(os) - before;
+      assert(os.good() && bytes_remaining > 0);
+      os << child;
+      bytes_remaining -= record_size(child);
     }
+    assert(!bytes_remaining);
     --write_depth;
   }
 
@@ -93,115 +101,160 @@ namespace garmin
   template<typename T>
   void read_record(std::istream& is, T& data)
   {
-    /*
-    std::cout << std::hex
-              << "header pos: 0x" << std::setw(8) << uint32_t(input_pos(is) - data.header_size()) << std::endl
-              << "record pos: 0x" << std::setw(8) << input_pos(is) << std::endl;
-              */
-//      std::cout << "header pos: " << std::setw(4) << uint32_t(input_pos(is) - record_header.header_size()) << std::endl;
-//      std::cout << "record pos: " << std::setw(4) << input_pos(is) << std::endl;
     is >> data;
-//    std::cout << "end pos: " << std::setw(4) << input_pos(is) << std::endl;
     read_child_records(is, data);
   }
 
   template<typename T>
   void write_record(std::ostream& os, const T& data)
   {
-//      std::cout << "header pos: " << std::setw(4) << uint32_t(output_pos(os) - record_header.header_size()) << std::endl;
-//      std::cout << "record pos: " << std::setw(4) << output_pos(os)) << std::endl;
     os << data;
-//    std::cout << "end pos: " << std::setw(4) << output_pos(os) << std::endl;
     write_child_records(os, data);
   }
 
 
+  template<typename T>
+  struct read_entry_t
+  {
+    static void function(std::istream& is, any_record_t& data, const record_header_t& header)
+    {
+      read_record(is, emplace_record<T>(data, header));
+      if constexpr(std::is_same_v<T, record_header_t>)
+        is.setstate(std::ios_base::failbit); // End: not an error, just finished reading records
+    }
+  };
+
   std::istream& operator>>(std::istream& is, any_record_t& data)
   {
     record_header_t record_header;
     if((is >> record_header).good())
     {
-      switch(record_header.type)
-      {
-        case GarminHeader:      read_record(is, data.emplace<garmin_header_t      >(record_header)); break;
-        case POIHeader:         read_record(is, data.emplace<poi_header_t         >(record_header)); break;
-        case Point:             read_record(is, data.emplace<point_t              >(record_header)); break;
-        case Alert:             read_record(is, data.emplace<alert_t              >(record_header)); break;
-        case BitmapReference:   read_record(is, data.emplace<bitmap_reference_t   >(record_header)); break;
-        case Bitmap:            read_record(is, data.emplace<bitmap_t             >(record_header)); break;
-        case CategoryReference: read_record(is, data.emplace<category_reference_t >(record_header)); break;
-        case Category:          read_record(is, data.emplace<category_t           >(record_header)); break;
-        case Area:              read_record(is, data.emplace<area_t               >(record_header)); break;
-        case POIGroup:          read_record(is, data.emplace<poi_group_t          >(record_header)); break;
-        case Comment:           read_record(is, data.emplace<comment_t            >(record_header)); break;
-        case Address:           read_record(is, data.emplace<address_t            >(record_header)); break;
-        case Contact:           read_record(is, data.emplace<contact_t            >(record_header)); break;
-        case ImageFile:         read_record(is, data.emplace<image_file_t         >(record_header)); break;
-        case Description:       read_record(is, data.emplace<description_t        >(record_header)); break;
-        case Record15:          read_record(is, data.emplace<record15_t           >(record_header)); break;
-        case Record16:          read_record(is, data.emplace<record16_t           >(record_header)); break;
-        case Copyright:         read_record(is, data.emplace<copyright_t          >(record_header)); break;
-        case AudioFile:         read_record(is, data.emplace<audio_file_t         >(record_header)); break;
-        case SpeedCamera:       read_record(is, data.emplace<speed_camera_t       >(record_header)); break;
-        case Record20:          read_record(is, data.emplace<record20_t           >(record_header)); break;
-        case Index:             read_record(is, data.emplace<index_t              >(record_header)); break;
-        case Record22:          read_record(is, data.emplace<record22_t           >(record_header)); break;
-        case Record23:          read_record(is, data.emplace<record23_t           >(record_header)); break;
-        case Record24:          read_record(is, data.emplace<record24_t           >(record_header)); break;
-        case Record25:          read_record(is, data.emplace<record25_t           >(record_header)); break;
-        case Record26:          read_record(is, data.emplace<record26_t           >(record_header)); break;
-        case Record27:          read_record(is, data.emplace<record27_t           >(record_header)); break;
-        case End:               read_record(is, data.emplace<record_header_t      >(record_header));
-          is.setstate(std::ios_base::failbit); // not an error, just finished reading records
-          break;
-        default:
-          assert(false);
-      }
+      record_trace_t trace(record_header);
+      if(known_record_type(record_header.type))
+        record_table<read_entry_t>[record_index(record_header.type)](is, data, record_header);
+      else
+        is.setstate(std::ios_base::failbit);
     }
     return is;
   } // end function
 
-  std::ostream& operator<<(std::ostream& os, const any_record_t& data)
+  template<typename T>
+  struct read_data_entry_t
+  {
+    static uint32_t function(std::istream& is, any_record_t& data, const record_header_t& header)
+    {
+      T& record = emplace_record<T>(data, header);
+      if constexpr(std::is_same_v<T, poi_group_t>)
+      {
+        is >> record.source;
+        return record.source.byte_count();
+      }
+      else if constexpr(std::is_base_of_v<opaque_record_t, T>)
+      {
+        debug_read_record(is, record.header()); // consumes all of the data, whatever operator>> T has
+        return header.end_of_record;
+      }
+      else
+      {
+        is >> record;
+        if(header.type == Address || header.type == Contact || header.type == AudioFile)
+          return header.end_of_record; // their extra data is not made of records
+        else
+          return header.data_size();
+      }
+    }
+  };
+
+  uint32_t read_record_data(std::istream& is, any_record_t& data, const record_header_t& header)
   {
-    switch(data.index())
+    if(!known_record_type(header.type))
     {
-      case GarminHeader:      write_record(os, std::get<garmin_header_t      >(data)); break;
-      case POIHeader:         write_record(os, std::get<poi_header_t         >(data)); break;
-      case Point:             write_record(os, std::get<point_t              >(data)); break;
-      case Alert:             write_record(os, std::get<alert_t              >(data)); break;
-      case BitmapReference:   write_record(os, std::get<bitmap_reference_t   >(data)); break;
-      case Bitmap:            write_record(os, std::get<bitmap_t             >(data)); break;
-      case CategoryReference: write_record(os, std::get<category_reference_t >(data)); break;
-      case Category:          write_record(os, std::get<category_t           >(data)); break;
-      case Area:              write_record(os, std::get<area_t               >(data)); break;
-      case POIGroup:          write_record(os, std::get<poi_group_t          >(data)); break;
-      case Comment:           write_record(os, std::get<comment_t            >(data)); break;
-      case Address:           write_record(os, std::get<address_t            >(data)); break;
-      case Contact:           write_record(os, std::get<contact_t            >(data)); break;
-      case ImageFile:         write_record(os, std::get<image_file_t         >(data)); break;
-      case Description:       write_record(os, std::get<description_t        >(data)); break;
-      case Record15:          write_record(os, std::get<record15_t           >(data)); break;
-      case Record16:          write_record(os, std::get<record16_t           >(data)); break;
-      case Copyright:         write_record(os, std::get<copyright_t          >(data)); break;
-      case AudioFile:         write_record(os, std::get<audio_file_t         >(data)); break;
-      case SpeedCamera:       write_record(os, std::get<speed_camera_t       >(data)); break;
-      case Record20:          write_record(os, std::get<record20_t           >(data)); break;
-      case Index:             write_record(os, std::get<index_t              >(data)); break;
-      case Record22:          write_record(os, std::get<record22_t           >(data)); break;
-      case Record23:          write_record(os, std::get<record23_t           >(data)); break;
-      case Record24:          write_record(os, std::get<record24_t           >(data)); break;
-      case Record25:          write_record(os, std::get<record25_t           >(data)); break;
-      case Record26:          write_record(os, std::get<record26_t           >(data)); break;
-      case Record27:          write_record(os, std::get<record27_t           >(data)); break;
-      case End:               write_record(os, std::get<record_header_t      >(data));
-        os.setstate(std::ios_base::failbit); // not an error, just finished reading records
-        break;
-      default:
-        assert(false);
+      is.setstate(std::ios_base::failbit);
+      return 0;
     }
+    return record_table<read_data_entry_t>[record_index(header.type)](is, data, header);
+  }
+
+  // sets the header lengths of a record from its current content
+  template<typename T>
+  const record_header_t& sized_header(const T& data)
+  {
+    uint32_t extra_size = data.extra_data_size();
+    data.end_of_record = data.calc_data_size() + extra_size;
+    if(extra_size)
+      data.end_of_data = data.calc_data_size();
+    else
+      data.end_of_data.reset();
+    return data.header();
+  }
+
+  std::ostream& operator<<(std::ostream& os, const any_record_t& data)
+  {
+    visit_record([&os](const auto& record)
+    {
+      if constexpr(std::is_same_v<std::decay_t<decltype(record)>, record_header_t>)
+        os << sized_header(record); // End
+      else
+        write_record(os, record);
+    }, data);
     return os;
   }
 
+// wire layout conversions
+
+  template<typename T>
+  static std::istream& read_wire(std::istream& is, T& data)
+  {
+    static_assert(std::is_trivially_copyable_v<T>, "wire types must be copyable as bytes");
+    return is.read(reinterpret_cast<char*>(&data), sizeof(T));
+  }
+
+  template<typename T>
+  static std::ostream& write_wire(std::ostream& os, const T& data)
+  {
+    static_assert(std::is_trivially_copyable_v<T>, "wire types must be copyable as bytes");
+    return os.write(reinterpret_cast<const char*>(&data), sizeof(T));
+  }
+
+  static flags_t flags_from_wire(uint16_t value)
+  {
+    flags_t flags;
+    value = wire::from_le(value);
+    flags.byte0 = uint8_t(value);
+    flags.byte1 = uint8_t(value >> 8);
+    return flags;
+  }
+
+  static uint16_t flags_to_wire(const flags_t& flags)
+    { return wire::to_le(uint16_t(flags.byte0 | (flags.byte1 << 8))); }
+
+  static coords32_t coords_from_wire(const wire::coords32_t& value)
+  {
+    coords32_t coords;
+    coords.latitude = wire::coord32_degrees(wire::from_le(value.latitude));
+    coords.longitude = wire::coord32_degrees(wire::from_le(value.longitude));
+    return coords;
+  }
+
+  static wire::coords32_t coords_to_wire(const coords32_t& coords)
+  {
+    wire::coords32_t value;
+    value.latitude = wire::to_le(wire::coord32_value(coords.latitude));
+    value.longitude = wire::to_le(wire::coord32_value(coords.longitude));
+    return value;
+  }
+
+  static timestamp_t timestamp_from_wire(uint32_t value)
+  {
+    value = wire::from_le(value);
+    if(value == 0xFFFFFFFF)
+      value = 0;
+    return timestamp_t(std::chrono::duration<uint64_t>(value + unix_time_offset));
+  }
+
+  static uint32_t timestamp_to_wire(const timestamp_t& timestamp)
+    { return wire::to_le(uint32_t(timestamp.time_since_epoch().count() - unix_time_offset)); }
+
 // enumeration Read/Write function pairs
 
   template <typename T, std::enable_if_t<std::is_enum_v<T> && std::is_same_v<std::underlying_type_t<T>, uint8_t>, bool> = true>
@@ -229,24 +282,31 @@ namespace garmin
     { return os << uint16le_t(data); }
 
 // shortcut type Read/Write function pairs
+  std::istream& operator>>(std::istream& is, uint8_t& data)
+    { return is.get(reinterpret_cast<char&>(data)); }
+
+  std::istream& operator>>(std::istream& is, char& data)
+    { return is.get(data); }
+
   std::istream& operator>>(std::istream& is, flags_t& data)
     { return is >> data.byte0 >> data.byte1; }
 
   std::ostream& operator<<(std::ostream& os, const flags_t& data)
     { return os << data.byte0 << data.byte1; }
 
+  // coordinates are stored as signed fractions of a full circle: degrees = value * 360 / 2^bits
   std::istream& operator>>(std::istream& is,  coord_t<24>& data)
   {
     uint32le_t val = 0;
-    is >> val[0] >> val[1] >> val[2] >> val[3] >> val[4] >> val[5];
-    data = double(val) / 360 * (2 << 24);
+    is >> val[0] >> val[1] >> val[2];
+    data = double(int32_t(val << 8) >> 8) * 360 / (1 << 24);
     return is;
   }
 
   std::ostream& operator<<(std::ostream& os, const coord_t<24>& data)
   {
-    uint32le_t val = double(data) * 360 / (2 << 24);
-    return os << val[0] << val[1] << val[2] << val[3] << val[4] << val[5];
+    uint32le_t val = uint32_t(int32_t(std::lround(double(data) * (1 << 24) / 360)));
+    return os << val[0] << val[1] << val[2];
   }
 
   std::istream& operator>>(std::istream& is, coord_t<32>& data)
@@ -254,38 +314,35 @@ namespace garmin
     assert(is.good());
     uint32le_t tmp = 0;
     is >> tmp;
-    data = double(tmp) / 360 * (uint64_t(2) << 32);
+    data = wire::coord32_degrees(tmp);
     return is;
   }
 
   std::ostream& operator<<(std::ostream& os, const coord_t<32>& data)
   {
-    return os << uint32le_t(double(data) * 360 / (uint64_t(2) << 32));
+    return os << uint32le_t(wire::coord32_value(data));
   }
 
   template<int bits>
   std::istream& operator>>(std::istream& is, coord_pair_t<bits>& data)
-    { return is >> data.longitude >> data.longitude; }
+    { return is >> data.latitude >> data.longitude; }
 
   template<int bits>
   std::ostream& operator<<(std::ostream& os, const coord_pair_t<bits>& data)
-    { return os << data.longitude << data.longitude; }
+    { return os << data.latitude << data.longitude; }
 
 
   std::istream& operator>>(std::istream& is, timestamp_t& data)
   {
-    uint32le_t input = 0;
-    is >> input;
-    if(input == 0xFFFFFFFF)
-      input = 0;
-
-    data = timestamp_t(std::chrono::duration<uint64_t>(input + unix_time_offset));
+    uint32_t input = 0;
+    read_wire(is, input);
+    data = timestamp_from_wire(input);
     return is;
   }
 
   std::ostream& operator<<(std::ostream& os, const timestamp_t& data)
   {
-    return os << uint32le_t(data.time_since_epoch().count() - unix_time_offset);
+    return write_wire(os, timestamp_to_wire(data));
   }
 
 
@@ -303,19 +360,6 @@ namespace garmin
 
       if(data.header_flags.bit3)
         is >> data.end_of_data;
-
-      if(is.good())
-      {
-        /*
-        std::cout << "data:" << std::endl
-                  << "  type: " << std::to_string(uint16_t(data.type)) << std::endl
-                  << "  header_flags: " << std::setw(2) << uint16_t(data.header_flags.byte0)
-                                        << std::setw(2) << uint16_t(data.header_flags.byte1) << std::endl
-                  << "  data size: " << data.data_size() << std::endl
-                  << "  aux data size: " << data.aux_data_size() << std::endl;
-                  */
-      }
-
     }
     return is;
   }
@@ -323,12 +367,6 @@ namespace garmin
 
   std::ostream& operator<<(std::ostream& os, const record_header_t& data)
   {
-    if(data.child_records.size())
-    {
-      data.end_of_data = data.end_of_record;
-      data.end_of_record += data.children_size();
-    }
-
     data.header_flags.bit3 = data.end_of_data.has_value();
 
     return os << data.type
@@ -340,134 +378,137 @@ namespace garmin
 // specialized record Read/Write function pairs
   std::istream& operator>>(std::istream& is, garmin_header_t& data)
   {
-    ISTREAM_DEBUG_START
-
-    is >> data.header()
-       >> data.magic[0] >> data.magic[1] >> data.magic[2] >> data.magic[3] >> data.magic[4] >> data.magic[5]
-       >> data.version[0] >> data.version[1]
-       >> data.timestamp
-       >> data.flags
+    wire::garmin_header_t statics;
+    is >> data.header();
+    read_wire(is, statics)
        >> data.name;
 
-    ISTREAM_DEBUG_END
-    return is;
+    std::copy(statics.magic, statics.magic + 6, data.magic);
+    std::copy(statics.version, statics.version + 2, data.version);
+    data.timestamp = timestamp_from_wire(statics.timestamp);
+    data.flags = flags_from_wire(statics.flags);
+
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const garmin_header_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-    os << data.header()
-      << data.magic[0] << data.magic[1] << data.magic[2] << data.magic[3] << data.magic[4] << data.magic[5]
-      << data.version[0] << data.version[1]
-      << data.timestamp
-      << data.flags
-      << data.name;
-    return os;
+    wire::garmin_header_t statics;
+    std::copy(data.magic, data.magic + 6, statics.magic);
+    std::copy(data.version, data.version + 2, statics.version);
+    statics.timestamp = timestamp_to_wire(data.timestamp);
+    statics.flags = flags_to_wire(data.flags);
+
+    os << sized_header(data);
+    return write_wire(os, statics)
+              << data.name;
   }
 
 
   std::istream& operator>>(std::istream& is, poi_header_t& data)
   {
-    ISTREAM_DEBUG_START
+    wire::poi_header_t statics;
+    is >> data.header();
+    read_wire(is, statics);
 
-    is >> data.header()
-              >> data.magic[0] >> data.magic[1] >> data.magic[2] >> data.magic[3] >> data.magic[4] >> data.magic[5]
-              >> data.version[0] >> data.version[1]
-              >> data.codepage
-              >> data.auxiliary_type;
+    std::copy(statics.magic, statics.magic + 6, data.magic);
+    std::copy(statics.version, statics.version + 2, data.version);
+    data.codepage = codepage_t(wire::from_le(statics.codepage));
+    data.auxiliary_type = record_id_t(wire::from_le(statics.auxiliary_type));
 
-    ISTREAM_DEBUG_END
-    return is;
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const poi_header_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-    return os << data.header()
-              << data.magic[0] << data.magic[1] << data.magic[2] << data.magic[3] << data.magic[4] << data.magic[5]
-              << data.version[0] << data.version[1]
-              << data.codepage
-              << data.auxiliary_type;
+    wire::poi_header_t statics;
+    std::copy(data.magic, data.magic + 6, statics.magic);
+    std::copy(data.version, data.version + 2, statics.version);
+    statics.codepage = wire::to_le(uint16_t(data.codepage));
+    statics.auxiliary_type = wire::to_le(uint16_t(data.auxiliary_type));
+
+    os << sized_header(data);
+    return write_wire(os, statics);
   }
 
 
   std::istream& operator>>(std::istream& is, point_t& data)
   {
-    ISTREAM_DEBUG_START
+    wire::point_t statics;
+    is >> data.header();
+    read_wire(is, statics)
+       >> data.shortname;
 
-    is >> data.header()
-              >> data.coordinates
-              >> data.reserved
-              >> data.flags
-              >> data.shortname;
+    data.coordinates = coords_from_wire(statics.coordinates);
+    data.reserved = statics.reserved;
+    data.flags = flags_from_wire(statics.flags);
 
-    ISTREAM_DEBUG_END
-    return is;
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const point_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-    return os << data.header()
-              << data.coordinates
-              << data.reserved
-              << data.flags
+    wire::point_t statics;
+    statics.coordinates = coords_to_wire(data.coordinates);
+    statics.reserved = data.reserved;
+    statics.flags = flags_to_wire(data.flags);
+
+    os << sized_header(data);
+    return write_wire(os, statics)
               << data.shortname;
   }
 
 
   std::istream& operator>>(std::istream& is, alert_t& data)
   {
-    ISTREAM_DEBUG_START
+    wire::alert_t statics;
+    is >> data.header();
+    read_wire(is, statics);
 
-    is >> data.header()
-              >> data.proximity
-              >> data.velocity
-              >> data.Unknown6
-              >> data.Unknown7
-              >> data.enabled
-              >> data.trigger
-              >> data.symbol_id
-              >> data.source;
-
-    ISTREAM_DEBUG_END
-    return is;
+    data.proximity = wire::from_le(statics.proximity);
+    data.velocity = wire::from_le(statics.velocity);
+    data.Unknown6 = wire::from_le(statics.Unknown6);
+    data.Unknown7 = wire::from_le(statics.Unknown7);
+    data.enabled = bool_t(statics.enabled);
+    data.trigger = alert_trigger_t(statics.trigger);
+    data.symbol_id = statics.symbol_id;
+    data.source = alert_source_t(statics.source);
+
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const alert_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-    return os << data.header()
-              << data.proximity
-              << data.velocity
-              << data.Unknown6
-              << data.Unknown7
-              << uint8_t(data.enabled)
-              << data.trigger
-              << data.symbol_id
-              << data.source;
+    wire::alert_t statics;
+    statics.proximity = wire::to_le(uint16_t(data.proximity));
+    statics.velocity = wire::to_le(uint16_t(data.velocity));
+    statics.Unknown6 = wire::to_le(uint16_t(data.Unknown6));
+    statics.Unknown7 = wire::to_le(uint16_t(data.Unknown7));
+    statics.enabled = data.enabled;
+    statics.trigger = data.trigger;
+    statics.symbol_id = data.symbol_id;
+    statics.source = data.source;
+
+    os << sized_header(data);
+    return write_wire(os, statics);
   }
 
 
   std::istream& operator>>(std::istream& is, bitmap_reference_t& data)
   {
-    ISTREAM_DEBUG_START
-
     data.Unknown8.reset();
     is >> data.header()
        >> data.bitmap_id;
 
     if(data.data_size() >= 4)
-      is >> data.Unknown8.value();
+      is >> data.Unknown8;
 
-    ISTREAM_DEBUG_END
-    return is;
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const bitmap_reference_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-    return os << data.header()
+    return os << sized_header(data)
               << data.bitmap_id
               << data.Unknown8;
   }
@@ -475,25 +516,33 @@ namespace garmin
 
   std::istream& operator>>(std::istream& is, bitmap_t& data)
   {
-    ISTREAM_DEBUG_START
-
-    uint32le_t image_byte_length = 0;
-    uint32le_t palette_size = 0;
-
-    is >> data.header()
-       >> data.bitmap_id
-       >> data.height
-       >> data.width
-       >> data.line_length
-       >> data.bits_per_pixel
-       >> data.reserved0
-       >> image_byte_length
-       >> data.image_offset
-       >> palette_size
-       >> data.transparent_color
-       >> data.reserved1
-       >> data.flags
-       >> data.palette_offset;
+    wire::bitmap_t statics;
+    is >> data.header();
+    read_wire(is, statics);
+
+    data.bitmap_id = wire::from_le(statics.bitmap_id);
+    data.height = wire::from_le(statics.height);
+    data.width = wire::from_le(statics.width);
+    data.line_length = wire::from_le(statics.line_length);
+    data.bits_per_pixel = wire::from_le(statics.bits_per_pixel);
+    data.reserved0 = wire::from_le(statics.reserved0);
+    data.image_offset = wire::from_le(statics.image_offset);
+    data.transparent_color = wire::from_le(statics.transparent_color);
+    data.reserved1 = wire::from_le(statics.reserved1);
+    data.flags = flags_from_wire(statics.flags);
+    data.palette_offset = wire::from_le(statics.palette_offset);
+
+    uint32_t image_byte_length = wire::from_le(statics.image_byte_length);
+    uint32_t palette_size = wire::from_le(statics.palette_size);
+    uint32_t palette_byte_length = palette_size * sizeof(uint32_t);
+    if(!is.good() ||
+       data.data_size() < data.statics_size() ||
+       image_byte_length > data.data_size() - data.statics_size() ||
+       palette_byte_length > data.data_size() - data.statics_size() - image_byte_length)
+    {
+      is.setstate(std::ios_base::failbit);
+      return is;
+    }
 
     data.image_data.resize(image_byte_length);
     data.palette_data.resize(palette_size);
@@ -501,52 +550,47 @@ namespace garmin
     is.read(reinterpret_cast<char*>(data.image_data.data()), image_byte_length);
 
     if(palette_size)
-      is.read(reinterpret_cast<char*>(data.palette_data.data()), palette_size * sizeof(uint32_t));
+      is.read(reinterpret_cast<char*>(data.palette_data.data()), palette_byte_length);
 
 //  if(data.flags.bit0)
 
     uint32_t mask_size = data.data_size() -
                          data.statics_size() -
                          image_byte_length -
-                         (palette_size * sizeof(uint32_t));
+                         palette_byte_length;
     data.mask_data.resize(mask_size);
     is.read(reinterpret_cast<char*>(data.mask_data.data()), mask_size);
 
-    ISTREAM_DEBUG_END
-    return is;
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const bitmap_t& data)
   {
-    uint32le_t image_byte_length = data.image_data.size();
-    uint32le_t palette_size = data.palette_data.size();
-
-    data.end_of_data = data.calc_data_size();
-
-    data.flags.bit0 = !data.mask_data.empty();
-
-    os << data.header()
-       << data.bitmap_id
-       << data.height
-       << data.width
-       << data.line_length
-       << data.bits_per_pixel
-       << data.reserved0
-       << image_byte_length
-       << data.image_offset
-       << palette_size
-       << data.transparent_color
-       << data.reserved1
-       << data.flags
-       << data.palette_offset;
-
-    if(image_byte_length)
-      os.write(reinterpret_cast<const char*>(data.image_data.data()), image_byte_length);
-
-    if(palette_size)
-      os.write(reinterpret_cast<const char*>(data.palette_data.data()), palette_size * sizeof(uint32_t));
-
-    if(data.flags.bit0)
+    wire::bitmap_t statics;
+    statics.bitmap_id = wire::to_le(uint16_t(data.bitmap_id));
+    statics.height = wire::to_le(uint16_t(data.height));
+    statics.width = wire::to_le(uint16_t(data.width));
+    statics.line_length = wire::to_le(uint16_t(data.line_length));
+    statics.bits_per_pixel = wire::to_le(uint16_t(data.bits_per_pixel));
+    statics.reserved0 = wire::to_le(uint16_t(data.reserved0));
+    statics.image_byte_length = wire::to_le(uint32_t(data.image_data.size()));
+    statics.image_offset = wire::to_le(uint32_t(data.image_offset));
+    statics.palette_size = wire::to_le(uint32_t(data.palette_data.size()));
+    statics.transparent_color = wire::to_le(uint32_t(data.transparent_color));
+    statics.reserved1 = wire::to_le(uint16_t(data.reserved1));
+    statics.flags = flags_to_wire(data.flags);
+    statics.palette_offset = wire::to_le(uint32_t(data.palette_offset));
+
+    os << sized_header(data);
+    write_wire(os, statics);
+
+    if(!data.image_data.empty())
+      os.write(reinterpret_cast<const char*>(data.image_data.data()), data.image_data.size());
+
+    if(!data.palette_data.empty())
+      os.write(reinterpret_cast<const char*>(data.palette_data.data()), data.palette_data.size() * sizeof(uint32_t));
+
+    if(!data.mask_data.empty())
       os.write(reinterpret_cast<const char*>(data.mask_data.data()), data.mask_data.size());
 
     return os;
@@ -554,121 +598,105 @@ namespace garmin
 
   std::istream& operator>>(std::istream& is, category_reference_t& data)
   {
-    ISTREAM_DEBUG_START
-
     is >> data.header()
        >> data.category_id;
 
-    ISTREAM_DEBUG_END
-    return is;
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const category_reference_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-    return os << data.header()
+    return os << sized_header(data)
               << data.category_id;
   }
 
   std::istream& operator>>(std::istream& is, category_t& data)
   {
-    ISTREAM_DEBUG_START
-
     is >> data.header()
               >> data.category_id
               >> data.name;
 
-    ISTREAM_DEBUG_END
-    return is;
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const category_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-    return os << data.header()
+    return os << sized_header(data)
               << data.category_id
               << data.name;
   }
 
   std::istream& operator>>(std::istream& is, area_t& data)
   {
-    ISTREAM_DEBUG_START
+    wire::area_t statics;
+    is >> data.header();
+    read_wire(is, statics);
 
-    is >> data.header()
-              >> data.coordinates_max
-              >> data.coordinates_min
-              >> data.reserved
-              >> data.flags
-              >> data.unknown;
+    data.coordinates_max = coords_from_wire(statics.coordinates_max);
+    data.coordinates_min = coords_from_wire(statics.coordinates_min);
+    data.reserved = wire::from_le(statics.reserved);
+    data.flags = flags_from_wire(statics.flags);
+    data.unknown = statics.unknown;
 
-    ISTREAM_DEBUG_END
-    return is;
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const area_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-    return os << data.header()
-              << data.coordinates_max
-              << data.coordinates_min
-              << data.reserved
-              << data.flags
-              << data.unknown;
+    wire::area_t statics;
+    statics.coordinates_max = coords_to_wire(data.coordinates_max);
+    statics.coordinates_min = coords_to_wire(data.coordinates_min);
+    statics.reserved = wire::to_le(uint32_t(data.reserved));
+    statics.flags = flags_to_wire(data.flags);
+    statics.unknown = data.unknown;
+
+    os << sized_header(data);
+    return write_wire(os, statics);
   }
 
 
   std::istream& operator>>(std::istream& is, poi_group_t& data)
   {
-    ISTREAM_DEBUG_START
-
     data.areas.clear();
     is >> data.header()
        >> data.source;
 
-    read_child_records(is, data, data.data_size() - data.source.byte_count());
+    uint32_t areas_size = read_child_records(is, data, data.data_size() - data.source.byte_count());
+    data.areas.reserve(data.child_records.size());
     for(auto& area : data.child_records)
-      data.areas.emplace_back(std::get<area_t>(area));
+      data.areas.emplace_back(std::move(get_record<area_t>(area)));
     data.child_records.clear();
 
-    ISTREAM_DEBUG_END
-    return is;
+    return skip_unparsed(is, data.source.byte_count() + areas_size, data.data_size());
   }
 
   std::ostream& operator<<(std::ostream& os, const poi_group_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-
-    os << data.header()
+    os << sized_header(data)
        << data.source;
 
     for(auto& area : data.areas)
-      os << area;
+      write_record(os, area);
 
     return os;
   }
 
   std::istream& operator>>(std::istream& is, comment_t& data)
   {
-    ISTREAM_DEBUG_START
-
     is >> data.header()
        >> data.text;
 
-    ISTREAM_DEBUG_END
-    return is;
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const comment_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-    return os << data.header()
+    return os << sized_header(data)
               << data.text;
   }
 
   std::istream& operator>>(std::istream& is, address_t& data)
   {
-    ISTREAM_DEBUG_START
-
     data.city.reset();
     data.country.reset();
     data.state.reset();
@@ -676,9 +704,12 @@ namespace garmin
     data.street_name.reset();
     data.building_id.reset();
 
-    is >> data.header()
-       >> data.header_flags
-       >> data.have.byte0 >> data.have.byte1;
+    uint16_t have = 0;
+    is >> data.header();
+    read_wire(is, have);
+    have = wire::from_le(have);
+    data.have.byte0 = uint8_t(have);
+    data.have.byte1 = uint8_t(have >> 8);
 
     if(data.have.city)
       is >> data.city;
@@ -693,14 +724,12 @@ namespace garmin
     if(data.have.building_id)
       is >> data.building_id;
 
-    ISTREAM_DEBUG_END
-    return is;
+    // FileVersion '00' keeps the fields in the extra data
+    return skip_unparsed(is, data.calc_data_size(), data.end_of_record);
   }
 
   std::ostream& operator<<(std::ostream& os, const address_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-
     data.have.city        = data.city.has_value();
     data.have.country     = data.country.has_value();
     data.have.state       = data.state.has_value();
@@ -708,33 +737,32 @@ namespace garmin
     data.have.street_name = data.street_name.has_value();
     data.have.building_id = data.building_id.has_value();
 
-    os << data.header()
-       << data.header_flags
-       << data.have.byte0 << data.have.byte1
+    uint16_t have = wire::to_le(uint16_t(data.have.byte0 | (data.have.byte1 << 8)));
+    os << sized_header(data);
+    return write_wire(os, have)
        << data.city
        << data.country
        << data.state
        << data.postal_code
        << data.street_name
        << data.building_id;
-
-    return os;
   }
 
   std::istream& operator>>(std::istream& is, contact_t& data)
   {
-    ISTREAM_DEBUG_START
-
-    is >> data.header()
-       >> data.header_flags
-       >> data.have.byte0 >> data.have.byte1;
-
     data.phone1.reset();
     data.phone2.reset();
     data.fax.reset();
     data.email.reset();
     data.URL.reset();
 
+    uint16_t have = 0;
+    is >> data.header();
+    read_wire(is, have);
+    have = wire::from_le(have);
+    data.have.byte0 = uint8_t(have);
+    data.have.byte1 = uint8_t(have >> 8);
+
     if(data.have.phone1)
       is >> data.phone1;
     if(data.have.phone2)
@@ -746,22 +774,21 @@ namespace garmin
     if(data.have.URL)
       is >> data.URL;
 
-    ISTREAM_DEBUG_END
-    return is;
+    // FileVersion '00' keeps the fields in the extra data
+    return skip_unparsed(is, data.calc_data_size(), data.end_of_record);
   }
 
   std::ostream& operator<<(std::ostream& os, const contact_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-
     data.have.phone1 = data.phone1.has_value();
     data.have.phone2 = data.phone2.has_value();
     data.have.fax    = data.fax.has_value();
     data.have.email  = data.email.has_value();
     data.have.URL    = data.URL.has_value();
 
-    return os << data.header()
-       << data.have.byte0 << data.have.byte1
+    uint16_t have = wire::to_le(uint16_t(data.have.byte0 | (data.have.byte1 << 8)));
+    os << sized_header(data);
+    return write_wire(os, have)
        << data.phone1
        << data.phone2
        << data.fax
@@ -771,128 +798,147 @@ namespace garmin
 
   std::istream& operator>>(std::istream& is, image_file_t& data)
   {
-    ISTREAM_DEBUG_START
-
     is >> data.header()
        >> data.unknown
        >> data.image_data;
 
-    ISTREAM_DEBUG_END
-    return is;
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const image_file_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-    return os << data.header()
+    return os << sized_header(data)
               << data.unknown
               << data.image_data;
   }
 
   std::istream& operator>>(std::istream& is, description_t& data)
   {
-    ISTREAM_DEBUG_START
-
     is >> data.header()
        >> data.unknown
        >> data.text;
 
-    ISTREAM_DEBUG_END
-    return is;
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const description_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-    return os << data.header()
+    return os << sized_header(data)
               << data.unknown
               << data.text;
   }
 
   std::istream& operator>>(std::istream& is, audio_file_t& data)
   {
-    ISTREAM_DEBUG_START_AUX
+    wire::audio_file_t statics;
+    is >> data.header();
+    read_wire(is, statics);
 
-    is >> data.header()
-       >> data.audio_id
-       >> data.format;
+    data.audio_id = wire::from_le(statics.audio_id);
+    data.format = audio_format_t(statics.format);
 
     if(data.end_of_record)
       is >> data.audio_data;
 
-    ISTREAM_DEBUG_END
-    return is;
+    return skip_unparsed(is, data.calc_data_size() + data.extra_data_size(), data.end_of_record);
   }
 
   std::ostream& operator<<(std::ostream& os, const audio_file_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-    data.end_of_record = data.audio_data.byte_count();
-    return os << data.header()
-              << data.audio_id
-              << data.format
+    wire::audio_file_t statics;
+    statics.audio_id = wire::to_le(uint16_t(data.audio_id));
+    statics.format = data.format;
+
+    os << sized_header(data);
+    return write_wire(os, statics)
               << data.audio_data;
   }
 
 
   std::istream& operator>>(std::istream& is, record15_t& data)
   {
-    ISTREAM_DEBUG_START
-
+    wire::record15_t statics;
     data.unknown.reset();
-    is >> data.header()
-       >> data.map_id
-       >> data.product_id
-       >> data.region_id
-       >> data.vendor_id;
+    is >> data.header();
+    read_wire(is, statics);
+
+    data.map_id = wire::from_le(statics.map_id);
+    data.product_id = statics.product_id;
+    data.region_id = region_t(statics.region_id);
+    data.vendor_id = statics.vendor_id;
+
     if(data.data_size() > data.statics_size())
       is >> data.unknown;
 
-    ISTREAM_DEBUG_END
-    return is;
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const record15_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-    return os << data.header()
-              << data.map_id
-              << data.product_id
-              << data.region_id
-              << data.vendor_id
+    wire::record15_t statics;
+    statics.map_id = wire::to_le(uint16_t(data.map_id));
+    statics.product_id = data.product_id;
+    statics.region_id = data.region_id;
+    statics.vendor_id = data.vendor_id;
+
+    os << sized_header(data);
+    return write_wire(os, statics)
               << data.unknown;
   }
 
   std::istream& operator>>(std::istream& is, record16_t& data)
   {
-    ISTREAM_DEBUG_START
+    uint16_t count = 0;
+    is >> data.header();
+    read_wire(is, count);
+    count = wire::from_le(count);
 
-    is >> data.header()
-       >> data.points;
+    std::vector<wire::point3d_t> points(count);
+    is.read(reinterpret_cast<char*>(points.data()), count * sizeof(wire::point3d_t));
 
-    ISTREAM_DEBUG_END
-    return is;
+    data.points.resize(count);
+    for(uint16_t i = 0; i < count; ++i)
+    {
+      data.points[i].location = coords_from_wire(points[i].location);
+      data.points[i].unknown = wire::from_le(points[i].unknown);
+    }
+
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const record16_t& data)
   {
-    data.end_of_data = data.calc_data_size();
-    return os << data.header()
-              << data.points;
+    std::vector<wire::point3d_t> points(data.points.size());
+    for(size_t i = 0; i < points.size(); ++i)
+    {
+      points[i].location = coords_to_wire(data.points[i].location);
+      points[i].unknown = wire::to_le(uint32_t(data.points[i].unknown));
+    }
+
+    uint16_t count = wire::to_le(uint16_t(points.size()));
+    os << sized_header(data);
+    write_wire(os, count);
+    return os.write(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(wire::point3d_t));
   }
 
   std::istream& operator>>(std::istream& is, copyright_t& data)
   {
-    ISTREAM_DEBUG_START
-
+    wire::copyright_t statics;
+    data.device_model.reset();
     data.Unknown30.reset();
-    is >> data.header()
-       >> data.have.byte0 >> data.have.byte1 >> data.have.byte2 >> data.have.byte3
-       >> data.unknown0
-       >> data.unknown1
+    is >> data.header();
+    read_wire(is, statics)
        >> data.data_source
        >> data.copyright_notice;
 
+    uint32_t have = wire::from_le(statics.have);
+    data.have.byte0 = uint8_t(have);
+    data.have.byte1 = uint8_t(have >> 8);
+    data.have.byte2 = uint8_t(have >> 16);
+    data.have.byte3 = uint8_t(have >> 24);
+    data.unknown0 = wire::from_le(statics.unknown0);
+    data.unknown1 = wire::from_le(statics.unknown1);
+
     if(data.have.device_model)
       is >> data.device_model;
     if(data.have.image_files)
@@ -902,34 +948,33 @@ namespace garmin
     if(data.have.Unknown30)
       is >> data.Unknown30;
 
-    ISTREAM_DEBUG_END
-    return is;
+    return skip_unparsed(is, data);
   }
 
   std::ostream& operator<<(std::ostream& os, const copyright_t& data)
   {
-    data.end_of_data = data.calc_data_size();
     data.have.device_model = data.device_model.has_value();
     data.have.image_files = 0;//data.image_files.has_value();
     data.have.Unknown30 = data.Unknown30.has_value();
-    os << data.header()
-       << data.have.byte0 << data.have.byte1 << data.have.byte2 << data.have.byte3
-       << data.unknown0
-       << data.unknown1
+
+    wire::copyright_t statics;
+    statics.have = wire::to_le(uint32_t(data.have.byte0 | (data.have.byte1 << 8) | (data.have.byte2 << 16) | (uint32_t(data.have.byte3) << 24)));
+    statics.unknown0 = wire::to_le(uint16_t(data.unknown0));
+    statics.unknown1 = wire::to_le(uint16_t(data.unknown1));
+
+    os << sized_header(data);
+    return write_wire(os, statics)
        << data.data_source
        << data.copyright_notice
        << data.device_model
 //       << data.image_files
        << data.Unknown30;
-
-    return os;
   }
 
   std::istream& debug_read_record(std::istream& is, record_header_t& data)
   {
     is >> data;
-    is.seekg(data.end_of_record, std::ios_base::cur);
-    return is;
+    return skip_unparsed(is, 0, data.end_of_record);
   }
 
   std::ostream& debug_write_record(std::ostream& os, const record_header_t& data)
@@ -939,6 +984,16 @@ namespace garmin
     return os;
   }
 
+  std::istream& operator>>(std::istream& is, speed_camera_t& data)
+  {
+    return debug_read_record(is, data.header());
+  }
+
+  std::ostream& operator<<(std::ostream& os, const speed_camera_t& data)
+  {
+    return debug_write_record(os, data.header());
+  }
+
   std::istream& operator>>(std::istream& is, index_t& data)
   {
     return debug_read_record(is, data.header());
@@ -1017,6 +1072,6 @@ namespace garmin
 
   std::ostream& operator<<(std::ostream& os, const record27_t& data)
   {
-    return os << data.header();
+    return debug_write_record(os, data.header());
   }
 }
@@ -10,6 +10,21 @@ namespace garmin
   std::istream& operator>>(std::istream& is, any_record_t& data);
   std::ostream& operator<<(std::ostream& os, const any_record_t& data);
 
+  // skips data, seeking when the stream supports it
+  std::istream& skip_bytes(std::istream& is, uint32_t count);
+
+  // decodes a record whose header was already read, leaving out its subordinated records and the
+  // areas of POI groups, and returns the bytes of its data consumed
+  uint32_t read_record_data(std::istream& is, any_record_t& data, const record_header_t& header);
+
+  // Read/Write function pair of the records whose content is skipped over, the whole data is consumed
+  std::istream& debug_read_record(std::istream& is, record_header_t& data);
+  std::ostream& debug_write_record(std::ostream& os, const record_header_t& data);
+
+  // single bytes are extracted unformatted so byte values that happen to be whitespace are not skipped
+  std::istream& operator>>(std::istream& is, uint8_t& data);
+  std::istream& operator>>(std::istream& is, char& data);
+
 
   template<typename type>
   std::istream& operator>>(std::istream& is, std::optional<type>& data)
@@ -66,11 +81,7 @@ namespace garmin
   template<typename localized_type>
   std::ostream& operator<<(std::ostream& os, const localized_t<localized_type>& data)
   {
-    uint32_t byte_length = 0;
-    for(const auto& pair : data)
-      byte_length += sizeof(uint16_t)
-                  +  pair.second.size();
-    os << uint32le_t(byte_length);
+    os << uint32le_t(data.byte_count() - sizeof(uint32_t));
     for(const auto& pair : data)
       os << char(pair.first >> 8) << char(pair.first & 0xFF) << pair.second;
     return os;
@@ -136,6 +147,9 @@ namespace garmin
   std::istream& operator>>(std::istream& is, copyright_t& data);
   std::ostream& operator<<(std::ostream& os, const copyright_t& data);
 
+  std::istream& operator>>(std::istream& is, speed_camera_t& data);
+  std::ostream& operator<<(std::ostream& os, const speed_camera_t& data);
+
   std::istream& operator>>(std::istream& is, index_t& data);
   std::ostream& operator<<(std::ostream& os, const index_t& data);
 } // namespace garmin
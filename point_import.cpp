@@ -0,0 +1,305 @@
+#include "point_import.h"
+#include "parallel.h"
+#include "record_dispatch.h"
+#include "record_writer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <cassert>
+
+namespace garmin
+{
+  bool import_field(std::string_view name, import_field_t& field)
+  {
+    static constexpr struct { const char* name; import_field_t field; } aliases[] =
+    {
+      { "name", NameField },            { "title", NameField },
+      { "comment", CommentField },      { "cmt", CommentField },          { "desc", CommentField },
+      { "description", CommentField },  { "note", CommentField },
+      { "category", CategoryField },    { "type", CategoryField },
+      { "city", CityField },            { "town", CityField },
+      { "country", CountryField },
+      { "state", StateField },          { "province", StateField },
+      { "postal_code", PostalCodeField }, { "postalcode", PostalCodeField }, { "postcode", PostalCodeField },
+      { "zip", PostalCodeField },
+      { "street", StreetField },        { "streetaddress", StreetField }, { "address", StreetField },
+      { "building", BuildingField },    { "housenumber", BuildingField }, { "house_number", BuildingField },
+      { "phone", PhoneField },          { "phonenumber", PhoneField },    { "telephone", PhoneField },
+      { "fax", FaxField },
+      { "email", EmailField },
+      { "url", URLField },              { "website", URLField },          { "link", URLField },
+      { "lat", LatitudeField },         { "latitude", LatitudeField },
+      { "lon", LongitudeField },        { "lng", LongitudeField },        { "longitude", LongitudeField },
+      { "proximity", ProximityField },  { "radius", ProximityField },
+      { "speed", SpeedField },          { "maxspeed", SpeedField },
+    };
+
+    for(const auto& alias : aliases)
+      if(name.size() == std::strlen(alias.name) &&
+         std::equal(std::begin(name), std::end(name), alias.name,
+                    [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; }))
+      {
+        field = alias.field;
+        return true;
+      }
+    return false;
+  }
+
+  void import_batch_t::begin_point(void)
+  {
+    imported_point_t& point = points.emplace_back();
+    point.latitude = NAN;
+    point.longitude = NAN;
+    point.proximity = 0;
+    point.speed = 0;
+    for(auto& field : point.fields)
+      field = text_span_t { 0, 0 };
+  }
+
+  bool import_batch_t::set_field(import_field_t field, std::string_view value)
+  {
+    assert(!points.empty());
+    imported_point_t& point = points.back();
+    if(field < ImportFieldCount)
+    {
+      if(!point.fields[field].size) // the first of several aliases wins
+      {
+        point.fields[field] = text_span_t { text.size(), value.size() };
+        text.append(value);
+      }
+      return true;
+    }
+
+    while(!value.empty() && std::isspace(static_cast<unsigned char>(value.front())))
+      value.remove_prefix(1);
+    while(!value.empty() && std::isspace(static_cast<unsigned char>(value.back())))
+      value.remove_suffix(1);
+    if(!value.empty() && value.front() == '+')
+      value.remove_prefix(1);
+
+    double number = 0;
+    auto result = std::from_chars(value.data(), value.data() + value.size(), number);
+    if(value.empty() || result.ec != std::errc() || result.ptr != value.data() + value.size())
+      return false;
+
+    switch(field)
+    {
+      case LatitudeField:  point.latitude = number; break;
+      case LongitudeField: point.longitude = number; break;
+      case ProximityField: point.proximity = uint16_t(std::clamp(number, 0.0, 65535.0)); break;
+      case SpeedField:     point.speed = uint16_t(std::clamp(number, 0.0, 65535.0)); break;
+      default: break;
+    }
+    return true;
+  }
+
+  void import_batch_t::end_point(void)
+  {
+    assert(!points.empty());
+    const imported_point_t& point = points.back();
+    if(!(point.latitude >= -90 && point.latitude <= 90 && point.longitude >= -180 && point.longitude <= 180)) // also NaN
+    {
+      points.pop_back();
+      ++skipped;
+    }
+  }
+
+
+  std::vector<import_batch_t> parse_chunks(const char* data, size_t size, const import_options_t& options,
+                                           const std::function<void(std::vector<size_t>&)>& find_boundaries,
+                                           const std::function<void(const char*, const char*, import_batch_t&)>& parse)
+  {
+    size_t threads = options.threads ? options.threads : std::max(std::thread::hardware_concurrency(), 1u);
+    size_t chunks = std::clamp(size / std::max(options.chunk_size, size_t(1)), size_t(1), threads);
+
+    std::vector<size_t> bounds(chunks + 1, size);
+    for(size_t i = 0; i < chunks; ++i)
+      bounds[i] = size / chunks * i;
+    if(chunks > 1)
+      find_boundaries(bounds);
+    bounds.front() = 0;
+    bounds.back() = size;
+    for(size_t i = 1; i < chunks; ++i) // a chunk without a boundary of its own ends up empty
+      bounds[i] = std::clamp(bounds[i], bounds[i - 1], size);
+
+    std::vector<import_batch_t> batches(chunks);
+    run_parallel(chunks, options.threads, [&](size_t i) { parse(data + bounds[i], data + bounds[i + 1], batches[i]); });
+    return batches;
+  }
+
+  struct point_ref_t
+  {
+    uint32_t batch;
+    uint32_t index;
+    uint64_t key; // along the curve of the spatial order
+  };
+
+  struct imported_writer_t : vector_area_builder_t<point_ref_t>
+  {
+    imported_writer_t(std::ostream& os, const std::vector<import_batch_t>& batches, const import_options_t& options)
+      : vector_area_builder_t(refs, options.area_points, max_area_depth, options.order),
+        writer(os),
+        batches(batches),
+        options(options),
+        locale(uint16_t((options.locale[0] << 8) | options.locale[1]))
+    {
+    }
+
+    const imported_point_t& point(const point_ref_t& ref) const { return batches[ref.batch].points[ref.index]; }
+    double latitude(const point_ref_t& ref) const { return point(ref).latitude; }
+    double longitude(const point_ref_t& ref) const { return point(ref).longitude; }
+
+    template<typename T>
+    static T& add_child(record_header_t& parent)
+      { return add_record<T>(parent.child_records); }
+
+    template<typename T>
+    void optional_text(const import_batch_t& batch, const imported_point_t& data, import_field_t field, std::optional<T>& text) const
+    {
+      std::string_view value = batch.field(data, field);
+      if(value.empty())
+        return;
+      if constexpr(std::is_same_v<T, lstring_t>)
+        text = make_lstring(value, locale);
+      else
+        text.emplace().assign(std::begin(value), std::end(value));
+    }
+
+    void file(void)
+    {
+      file_description_t description;
+      std::copy(options.version, options.version + 2, description.version);
+      description.timestamp = options.timestamp;
+      description.name = options.name;
+      description.source = make_lstring(options.name, locale);
+      description.copyright_notice = description.source;
+      writer.begin_file(description);
+
+      // category ids in order of first use
+      for(uint32_t b = 0; b < batches.size(); ++b)
+        for(uint32_t i = 0; i < batches[b].points.size(); ++i)
+        {
+          refs.push_back(point_ref_t { b, i, 0 });
+          std::string_view name = batches[b].field(batches[b].points[i], CategoryField);
+          if(!name.empty() && category_ids.size() < UINT16_MAX)
+            if(category_ids.emplace(name, uint16_t(category_ids.size())).second)
+              category_names.push_back(name);
+        }
+
+      if(options.order != InputOrder)
+      {
+        std::vector<double> latitudes(refs.size());
+        std::vector<double> longitudes(refs.size());
+        std::vector<uint64_t> keys(refs.size());
+        for(size_t i = 0; i < refs.size(); ++i)
+        {
+          latitudes[i] = point(refs[i]).latitude;
+          longitudes[i] = point(refs[i]).longitude;
+        }
+        spatial_keys(options.order, latitudes.data(), longitudes.data(), refs.size(), keys.data());
+        for(size_t i = 0; i < refs.size(); ++i)
+          refs[i].key = keys[i];
+      }
+
+      build();
+      for(uint16_t i = 0; i < category_names.size(); ++i)
+      {
+        category_t category;
+        category.category_id = i;
+        category.name = make_lstring(category_names[i], locale);
+        writer.write(category);
+      }
+      writer.end_file();
+    }
+
+    void open_area(const area_bounds_t& bounds) { writer.open(make_area(bounds)); }
+    void close_area(void) { writer.close(); }
+
+    void points(void)
+    {
+      if(options.order != InputOrder)
+        std::stable_sort(first(), last(), [](const point_ref_t& a, const point_ref_t& b) { return a.key < b.key; });
+      for(auto pos = first(); pos != last(); ++pos)
+        write_point(*pos);
+    }
+
+    void write_point(const point_ref_t& ref)
+    {
+      const import_batch_t& batch = batches[ref.batch];
+      const imported_point_t& data = batch.points[ref.index];
+
+      point_t point;
+      point.coordinates.latitude = data.latitude;
+      point.coordinates.longitude = data.longitude;
+      point.reserved = 0;
+      point.flags = flags_t();
+      point.flags.bit8 = 1;
+      point.shortname = make_lstring(batch.field(data, NameField), locale);
+
+      auto category = category_ids.find(batch.field(data, CategoryField));
+      if(category != category_ids.end()) // names beyond the last category id are left out
+        add_child<category_reference_t>(point).category_id = category->second;
+
+      if(data.proximity)
+      {
+        alert_t& alert = add_child<alert_t>(point);
+        alert.proximity = data.proximity;
+        alert.velocity = uint16_t(std::min(uint32_t(data.speed) * 100 * 1000 / 3600, uint32_t(UINT16_MAX)));
+        alert.Unknown6 = 0x100;
+        alert.Unknown7 = 0x100;
+        alert.enabled = True;
+        alert.trigger = proximity;
+        alert.source = internal;
+        alert.internal_id = beep;
+      }
+
+      std::string_view comment = batch.field(data, CommentField);
+      if(!comment.empty())
+        add_child<comment_t>(point).text = make_lstring(comment, locale);
+
+      if(data.fields[CityField].size || data.fields[CountryField].size || data.fields[StateField].size ||
+         data.fields[PostalCodeField].size || data.fields[StreetField].size || data.fields[BuildingField].size)
+      {
+        address_t& address = add_child<address_t>(point);
+        optional_text(batch, data, CityField, address.city);
+        optional_text(batch, data, CountryField, address.country);
+        optional_text(batch, data, StateField, address.state);
+        optional_text(batch, data, PostalCodeField, address.postal_code);
+        optional_text(batch, data, StreetField, address.street_name);
+        optional_text(batch, data, BuildingField, address.building_id);
+      }
+
+      if(data.fields[PhoneField].size || data.fields[FaxField].size ||
+         data.fields[EmailField].size || data.fields[URLField].size)
+      {
+        contact_t& contact = add_child<contact_t>(point);
+        optional_text(batch, data, PhoneField, contact.phone1);
+        optional_text(batch, data, FaxField, contact.fax);
+        optional_text(batch, data, EmailField, contact.email);
+        optional_text(batch, data, URLField, contact.URL);
+      }
+
+      writer.write(point);
+    }
+
+    std::vector<point_ref_t> refs;
+    record_writer_t writer;
+    const std::vector<import_batch_t>& batches;
+    const import_options_t& options;
+    uint16_t locale;
+    std::unordered_map<std::string_view, uint16_t> category_ids;
+    std::vector<std::string_view> category_names;
+  };
+
+  std::ostream& write_imported(std::ostream& os, const std::vector<import_batch_t>& batches, const import_options_t& options)
+  {
+    assert(options.version[0] == '0' && (options.version[1] == '0' || options.version[1] == '1'));
+    imported_writer_t(os, batches, options).file();
+    return os;
+  }
+} // namespace garmin
@@ -0,0 +1,100 @@
+#ifndef POINT_IMPORT_H
+#define POINT_IMPORT_H
+
+#include "mapped_file.h"
+#include "record_types.h"
+#include "spatial_order.h"
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Points read from third party formats and the writer that turns them into a GPI file. Parsers fill
+// one batch per chunk of input so chunks can be parsed on separate threads, the text of all fields
+// of a batch is kept in a single buffer.
+
+namespace garmin
+{
+  enum import_field_t : uint8_t
+  {
+    NameField = 0,
+    CommentField,
+    CategoryField,
+    CityField,
+    CountryField,
+    StateField,
+    PostalCodeField,
+    StreetField,
+    BuildingField,
+    PhoneField,
+    FaxField,
+    EmailField,
+    URLField,
+
+    ImportFieldCount, // text fields above, numbers below
+
+    LatitudeField = ImportFieldCount,
+    LongitudeField,
+    ProximityField,
+    SpeedField,
+  };
+
+  // maps common column, property and element names (case insensitive) to fields
+  bool import_field(std::string_view name, import_field_t& field);
+
+  struct text_span_t
+  {
+    size_t offset; // into import_batch_t::text
+    size_t size;
+  };
+
+  struct imported_point_t
+  {
+    double latitude;
+    double longitude;
+    uint16_t proximity; // meters, an alert is added when not 0
+    uint16_t speed;     // km/h, 0 for none
+    text_span_t fields[ImportFieldCount];
+  };
+
+  struct import_batch_t
+  {
+    std::string_view field(const imported_point_t& point, import_field_t field) const
+      { return std::string_view(text.data() + point.fields[field].offset, point.fields[field].size); }
+
+    // a point is started, given its fields and ended, points without valid coordinates are skipped
+    void begin_point(void);
+    bool set_field(import_field_t field, std::string_view value); // false for a malformed number
+    void end_point(void);
+
+    std::string text;
+    std::vector<imported_point_t> points;
+    uint64_t skipped = 0; // records that could not be read
+  };
+
+  struct import_options_t
+  {
+    std::string name = "POI";         // file name in the garmin header and data source
+    char version[2] = { '0', '1' };
+    char locale[2] = { 'E', 'N' };    // of the imported text, which is UTF-8
+    uint32_t area_points = 256;       // areas with more points are split into quadrants
+    spatial_order_t order = InputOrder; // of the points in an area and of sibling areas
+    uint32_t threads = 0;             // 0 for the hardware concurrency
+    size_t chunk_size = 16 << 20;     // minimum input bytes per thread
+    uint64_t timestamp = unix_time_offset; // UNIX time, not before the Garmin epoch
+  };
+
+  // Splits data into one chunk per thread and parses them in parallel. find_boundaries gets the even
+  // split of data, 0, the chunk starts and size, and moves every chunk start to the first record
+  // boundary at or after it (or size), parse fills the batch of a chunk.
+  std::vector<import_batch_t> parse_chunks(const char* data, size_t size, const import_options_t& options,
+                                           const std::function<void(std::vector<size_t>&)>& find_boundaries,
+                                           const std::function<void(const char*, const char*, import_batch_t&)>& parse);
+
+  // writes the points of all batches as a GPI file
+  std::ostream& write_imported(std::ostream& os, const std::vector<import_batch_t>& batches, const import_options_t& options);
+} // namespace garmin
+
+#endif // POINT_IMPORT_H
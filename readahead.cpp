@@ -0,0 +1,235 @@
+#include "readahead.h"
+#include "obfuscation.h"
+
+#include <algorithm>
+
+namespace garmin
+{
+  readahead_buffer_t::readahead_buffer_t(const std::filesystem::path& path, size_t block_size, size_t block_count)
+    : blocks(std::max<size_t>(block_count, 2)), // one block is read while another is decoded
+      read_index(0),
+      use_index(0),
+      filled(0),
+      in_use(false),
+      end_of_file(false),
+      stopping(false),
+      opened(false),
+      consumed(0),
+      stalled(std::chrono::nanoseconds::zero())
+  {
+    for(auto& block : blocks)
+    {
+      block.data.resize(std::max<size_t>(block_size, 1));
+      block.size = 0;
+    }
+
+    opened = file.open(path, std::ios_base::in | std::ios_base::binary) != nullptr;
+    if(opened)
+      reader = std::thread(&readahead_buffer_t::read_blocks, this);
+    else
+      end_of_file = true;
+  }
+
+  readahead_buffer_t::~readahead_buffer_t(void)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    changed.notify_all();
+    if(reader.joinable())
+      reader.join();
+  }
+
+  void readahead_buffer_t::read_blocks(void)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(!stopping && !end_of_file)
+    {
+      changed.wait(lock, [this] { return stopping || filled < blocks.size(); });
+      if(stopping)
+        break;
+
+      // the block is not visible to the consumer until it is counted as filled
+      block_t& block = blocks[read_index];
+      lock.unlock();
+      block.size = size_t(file.sgetn(block.data.data(), std::streamsize(block.data.size())));
+      lock.lock();
+
+      if(block.size)
+      {
+        read_index = (read_index + 1) % blocks.size();
+        ++filled;
+      }
+      if(block.size < block.data.size())
+        end_of_file = true;
+      changed.notify_all();
+    }
+  }
+
+  readahead_buffer_t::int_type readahead_buffer_t::underflow(void)
+  {
+    if(gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if(in_use) // hand the drained block back to the reader
+    {
+      consumed += blocks[use_index].size;
+      use_index = (use_index + 1) % blocks.size();
+      --filled;
+      in_use = false;
+      changed.notify_all();
+    }
+
+    if(!filled && !end_of_file)
+    {
+      auto start = std::chrono::steady_clock::now();
+      changed.wait(lock, [this] { return filled || end_of_file; });
+      stalled += std::chrono::steady_clock::now() - start;
+    }
+
+    if(!filled)
+    {
+      setg(nullptr, nullptr, nullptr);
+      return traits_type::eof();
+    }
+
+    block_t& block = blocks[use_index];
+    in_use = true;
+    setg(block.data.data(), block.data.data(), block.data.data() + block.size);
+    return traits_type::to_int_type(*gptr());
+  }
+
+  readahead_buffer_t::pos_type readahead_buffer_t::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode)
+  {
+    const pos_type failed = pos_type(off_type(-1));
+    if(!(mode & std::ios_base::in))
+      return failed;
+
+    uint64_t position = consumed + uint64_t(gptr() - eback());
+    uint64_t target = 0;
+    if(direction == std::ios_base::cur)
+      target = position + offset;
+    else if(direction == std::ios_base::beg)
+      target = uint64_t(offset);
+    else
+      return failed;
+
+    if(target < consumed) // already handed back to the reader
+      return failed;
+
+    while(target > consumed + uint64_t(egptr() - eback()))
+    {
+      setg(eback(), egptr(), egptr());
+      if(traits_type::eq_int_type(underflow(), traits_type::eof()))
+        return failed;
+    }
+    setg(eback(), eback() + (target - consumed), egptr());
+    return pos_type(off_type(target));
+  }
+
+  readahead_buffer_t::pos_type readahead_buffer_t::seekpos(pos_type position, std::ios_base::openmode mode)
+  {
+    return seekoff(off_type(position), std::ios_base::beg, mode);
+  }
+
+
+  span_buffer_t::span_buffer_t(const uint8_t* data, size_t size)
+  {
+    char* begin = const_cast<char*>(reinterpret_cast<const char*>(data)); // never written through
+    setg(begin, begin, begin + size);
+  }
+
+  span_buffer_t::pos_type span_buffer_t::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode)
+  {
+    const pos_type failed = pos_type(off_type(-1));
+    if(!(mode & std::ios_base::in))
+      return failed;
+
+    off_type target = offset;
+    if(direction == std::ios_base::cur)
+      target += gptr() - eback();
+    else if(direction == std::ios_base::end)
+      target += egptr() - eback();
+
+    if(target < 0 || target > egptr() - eback())
+      return failed;
+    setg(eback(), eback() + target, egptr());
+    return pos_type(target);
+  }
+
+  span_buffer_t::pos_type span_buffer_t::seekpos(pos_type position, std::ios_base::openmode mode)
+  {
+    return seekoff(off_type(position), std::ios_base::beg, mode);
+  }
+
+
+  file_prefetcher_t::file_prefetcher_t(std::vector<std::filesystem::path> paths)
+    : paths(std::move(paths)),
+      taken(0),
+      has_pending(false),
+      stopping(false),
+      stalled(std::chrono::nanoseconds::zero())
+  {
+    loader = std::thread(&file_prefetcher_t::load_files, this);
+  }
+
+  file_prefetcher_t::~file_prefetcher_t(void)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    changed.notify_all();
+    loader.join();
+  }
+
+  void file_prefetcher_t::load_files(void)
+  {
+    for(const auto& path : paths)
+    {
+      std::vector<uint8_t> data;
+      std::error_code error;
+      uintmax_t size = std::filesystem::file_size(path, error);
+      std::ifstream file(path, std::ios_base::in | std::ios_base::binary);
+      if(!error && file.is_open())
+      {
+        data.resize(size);
+        file.read(reinterpret_cast<char*>(data.data()), std::streamsize(size));
+        data.resize(size_t(file.gcount()));
+        deobfuscate(data.data(), data.size());
+      }
+
+      // the next file is read while the previous one waits to be taken
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [this] { return stopping || !has_pending; });
+      if(stopping)
+        return;
+      pending = std::move(data);
+      has_pending = true;
+      changed.notify_all();
+    }
+  }
+
+  bool file_prefetcher_t::next(std::filesystem::path& path, std::vector<uint8_t>& data)
+  {
+    if(taken == paths.size())
+      return false;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if(!has_pending)
+    {
+      auto start = std::chrono::steady_clock::now();
+      changed.wait(lock, [this] { return has_pending; });
+      stalled += std::chrono::steady_clock::now() - start;
+    }
+
+    path = paths[taken++];
+    data = std::move(pending);
+    pending.clear();
+    has_pending = false;
+    changed.notify_all();
+    return true;
+  }
+} // namespace garmin
@@ -0,0 +1,102 @@
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+// Input sources that read on a background thread so that I/O overlaps decoding.
+
+namespace garmin
+{
+  // Stream buffer fed from a file by a background thread through a ring of blocks. Forward seeks
+  // (as used to skip records) are served from the ring, backward seeks are not supported. The ring
+  // has at least two blocks.
+  class readahead_buffer_t : public std::streambuf
+  {
+  public:
+    readahead_buffer_t(const std::filesystem::path& path, size_t block_size = 1 << 20, size_t block_count = 4);
+    ~readahead_buffer_t(void);
+
+    bool is_open(void) const { return opened; }
+    std::chrono::nanoseconds stall_time(void) const { return stalled; } // time spent waiting for the reader
+
+  protected:
+    int_type underflow(void);
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode);
+    pos_type seekpos(pos_type position, std::ios_base::openmode mode);
+
+  private:
+    struct block_t
+    {
+      std::vector<char> data;
+      size_t size;
+    };
+
+    void read_blocks(void);
+
+    std::filebuf file;
+    std::vector<block_t> blocks;
+    size_t read_index;   // next block the thread fills
+    size_t use_index;    // block currently in the get area
+    size_t filled;       // filled blocks including the one in use
+    bool in_use;
+    bool end_of_file;
+    bool stopping;
+    bool opened;
+    uint64_t consumed;   // bytes of the blocks already released
+    std::chrono::nanoseconds stalled;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread reader;
+  };
+
+  // Stream buffer over bytes already in memory, lets a loaded file image go through the stream parsers.
+  class span_buffer_t : public std::streambuf
+  {
+  public:
+    span_buffer_t(const uint8_t* data, size_t size);
+
+  protected:
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode);
+    pos_type seekpos(pos_type position, std::ios_base::openmode mode);
+  };
+
+  // Loads whole files on a background thread, one file ahead of the one handed out. Obfuscated files
+  // are deobfuscated on that thread too.
+  class file_prefetcher_t
+  {
+  public:
+    file_prefetcher_t(std::vector<std::filesystem::path> paths);
+    ~file_prefetcher_t(void);
+
+    // blocks until the next file is loaded, returns false after the last one
+    // a file that could not be read is handed out empty
+    bool next(std::filesystem::path& path, std::vector<uint8_t>& data);
+
+    std::chrono::nanoseconds stall_time(void) const { return stalled; }
+
+  private:
+    void load_files(void);
+
+    std::vector<std::filesystem::path> paths;
+    size_t taken;    // files handed out
+    std::vector<uint8_t> pending;
+    bool has_pending;
+    bool stopping;
+    std::chrono::nanoseconds stalled;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread loader;
+  };
+} // namespace garmin
+
+#endif // READAHEAD_H
@@ -0,0 +1,161 @@
+#ifndef RECORD_DISPATCH_H
+#define RECORD_DISPATCH_H
+
+#include "record_types.h"
+
+#include <array>
+#include <utility>
+
+#include <cassert>
+
+// Function tables generated from the any_record_t type list. A new record type only has to be added
+// to record_id_t and any_record_t, every table picks it up from there.
+
+namespace garmin
+{
+  // any_record_t holds the record types in record_id_t order behind the bare header, which stands for End
+  constexpr std::size_t record_type_count = std::variant_size_v<any_record_t>;
+
+  constexpr std::size_t record_index(record_id_t type)
+    { return type == End ? 0 : std::size_t(type) + 1; }
+
+  constexpr bool known_record_type(record_id_t type)
+    { return record_index(type) < record_type_count; }
+
+  template<typename T>
+  struct unboxed_t { using type = T; };
+
+  template<typename T>
+  struct unboxed_t<boxed_t<T>> { using type = T; };
+
+  template<typename T, typename Variant>
+  struct is_alternative_t;
+
+  template<typename T, typename... Types>
+  struct is_alternative_t<T, std::variant<Types...>> : std::disjunction<std::is_same<T, Types>...> { };
+
+  // what any_record_t holds for a record type, the record itself or its box
+  template<typename T>
+  using record_storage_t = std::conditional_t<is_alternative_t<boxed_t<T>, any_record_t>::value, boxed_t<T>, T>;
+
+  template<std::size_t index>
+  using record_at_t = typename unboxed_t<std::variant_alternative_t<index, any_record_t>>::type;
+
+  static_assert(std::is_same_v<record_at_t<record_index(End)>, record_header_t>);
+  static_assert(std::is_same_v<record_at_t<record_index(Record27)>, record27_t>);
+  static_assert(std::is_same_v<record_at_t<record_index(Address)>, address_t>);
+
+  template<std::size_t... indexes>
+  constexpr bool inline_records_fit(std::index_sequence<indexes...>)
+  {
+    return ((sizeof(std::variant_alternative_t<indexes, any_record_t>) <= sizeof(point_t)) && ...);
+  }
+
+  // points make up most of a tree, no record type held in place may be larger
+  static_assert(inline_records_fit(std::make_index_sequence<record_type_count>()));
+
+  // growing a list of records moves the subtrees instead of copying them
+  static_assert(std::is_nothrow_move_constructible_v<any_record_t>);
+
+  template<std::size_t... indexes>
+  constexpr bool records_size_themselves(std::index_sequence<indexes...>)
+  {
+    return ((indexes == record_index(End) ||
+             !std::is_same_v<decltype(&record_at_t<indexes>::calc_data_size), decltype(&record_header_t::calc_data_size)>) && ...);
+  }
+
+  // the sizes are not virtual, a record type that inherited the bare header's calc_data_size would be written as empty
+  static_assert(records_size_themselves(std::make_index_sequence<record_type_count>()));
+
+  template<typename T>
+  T& unbox(T& record) { return record; }
+
+  template<typename T>
+  const T& unbox(const T& record) { return record; }
+
+  template<typename T>
+  T& unbox(boxed_t<T>& box) { return *box.record; }
+
+  template<typename T>
+  const T& unbox(const boxed_t<T>& box) { return *box.record; }
+
+  // std::variant access by record type, looking through boxes
+  template<typename T>
+  bool holds_record(const any_record_t& data)
+    { return std::holds_alternative<record_storage_t<T>>(data); }
+
+  template<typename T>
+  T& get_record(any_record_t& data)
+    { return unbox(std::get<record_storage_t<T>>(data)); }
+
+  template<typename T>
+  const T& get_record(const any_record_t& data)
+    { return unbox(std::get<record_storage_t<T>>(data)); }
+
+  template<typename T>
+  T* get_record_if(any_record_t* data)
+  {
+    auto storage = std::get_if<record_storage_t<T>>(data);
+    return storage ? &unbox(*storage) : nullptr;
+  }
+
+  template<typename T>
+  const T* get_record_if(const any_record_t* data)
+  {
+    auto storage = std::get_if<record_storage_t<T>>(data);
+    return storage ? &unbox(*storage) : nullptr;
+  }
+
+  template<typename T, typename... Args>
+  T& emplace_record(any_record_t& data, Args&&... args)
+    { return unbox(data.emplace<record_storage_t<T>>(std::forward<Args>(args)...)); }
+
+  // appends a default constructed record of type T
+  template<typename T>
+  T& add_record(std::vector<any_record_t>& records)
+    { return unbox(std::get<record_storage_t<T>>(records.emplace_back(std::in_place_type<record_storage_t<T>>))); }
+
+  // array of Entry<T>::function for every alternative T of any_record_t, indexed by record_index()
+  template<template<typename> class Entry, std::size_t... indexes>
+  constexpr auto make_record_table(std::index_sequence<indexes...>)
+  {
+    using function_t = decltype(&Entry<record_header_t>::function);
+    return std::array<function_t, sizeof...(indexes)> { &Entry<record_at_t<indexes>>::function... };
+  }
+
+  template<template<typename> class Entry>
+  inline constexpr auto record_table = make_record_table<Entry>(std::make_index_sequence<record_type_count>());
+
+  template<typename Visitor, typename Variant>
+  struct visit_entries_t
+  {
+    template<typename T>
+    using match_const_t = std::conditional_t<std::is_const_v<Variant>, const T, T>;
+
+    using result_t = decltype(std::declval<Visitor&>()(std::declval<match_const_t<record_header_t>&>()));
+
+    template<typename T>
+    struct entry_t
+    {
+      static result_t function(Visitor& visitor, Variant& data)
+        { return visitor(unbox(*std::get_if<record_storage_t<T>>(&data))); }
+    };
+  };
+
+  // calls visitor with the held record as its concrete type, every overload must return the same type
+  template<typename Visitor, typename Variant>
+  decltype(auto) visit_record(Visitor&& visitor, Variant& data)
+  {
+    static_assert(std::is_same_v<std::remove_const_t<Variant>, any_record_t>);
+    assert(!data.valueless_by_exception());
+    return record_table<visit_entries_t<std::remove_reference_t<Visitor>, Variant>::template entry_t>[data.index()](visitor, data);
+  }
+
+  inline record_header_t& record_header(any_record_t& data)
+    { return visit_record([](record_header_t& record) -> record_header_t& { return record; }, data); }
+
+  inline const record_header_t& record_header(const any_record_t& data)
+    { return visit_record([](const record_header_t& record) -> const record_header_t& { return record; }, data); }
+} // namespace garmin
+
+#endif // RECORD_DISPATCH_H
@@ -0,0 +1,163 @@
+#include "record_filter.h"
+#include "parsers.h"
+#include "skim.h"
+#include "wire_types.h"
+
+namespace garmin
+{
+  // record types that may follow each record type, including the areas in the main data of POI groups
+  static uint32_t subordinate_types(record_id_t type)
+  {
+    uint32_t types = allowed_children(type);
+    if(type == POIGroup)
+      types |= record_filter_t::bit(Area);
+    return types;
+  }
+
+  record_filter_t::record_filter_t(std::initializer_list<record_id_t> types)
+    : wanted(0),
+      containers(0)
+  {
+    for(record_id_t type : types)
+      if(known_record_type(type))
+        wanted |= bit(type);
+
+    // close over the schema until no more containers are found
+    for(uint32_t previous = ~containers; previous != containers;)
+    {
+      previous = containers;
+      for(std::size_t i = 0; i < record_type_count; ++i)
+      {
+        record_id_t type = i ? record_id_t(i - 1) : End;
+        if(subordinate_types(type) & (wanted | containers))
+          containers |= bit(type);
+      }
+    }
+  }
+
+  template<typename T>
+  struct filtered_read_entry_t
+  {
+    // decodes the record itself and returns the bytes consumed from its data
+    static uint32_t function(std::istream& is, any_record_t& data, const record_header_t& header)
+    {
+      T& record = emplace_record<T>(data, header);
+      if constexpr(std::is_base_of_v<opaque_record_t, T>)
+      {
+        debug_read_record(is, record.header());
+        return header.end_of_record;
+      }
+      else
+      {
+        is >> record;
+        return allowed_children(header.type) ? header.data_size() : uint32_t(header.end_of_record);
+      }
+    }
+  };
+
+  struct filtered_parse_t
+  {
+    std::istream& is;
+    const record_filter_t& filter;
+    const std::function<void(any_record_t&)>& sink;
+    bool finished;
+
+    // reads the records in the next size bytes
+    void records(uint32_t size, record_header_t* parent)
+    {
+      while(size && is.good())
+      {
+        uint32_t record_size = record(parent);
+        if(record_size > size)
+          is.setstate(std::ios_base::failbit);
+        else
+          size -= record_size;
+      }
+    }
+
+    // reads one record and returns its size, wanted records are added to parent or handed to the sink
+    uint32_t record(record_header_t* parent)
+    {
+      record_header_t header;
+      if(!(is >> header).good())
+        return 0;
+
+      if(!known_record_type(header.type) || header.data_size() > header.end_of_record)
+      {
+        is.setstate(std::ios_base::failbit);
+        return 0;
+      }
+
+      if(header.type == End)
+      {
+        finished = true;
+        skip_bytes(is, header.end_of_record);
+        return header.header_size() + header.end_of_record;
+      }
+
+      if(!filter.wants(header.type))
+      {
+        uint32_t consumed = 0;
+        if(filter.reaches(header.type))
+        {
+          consumed = header.data_size();
+          if(header.type == POIGroup) // the areas follow the data source
+          {
+            if(consumed < sizeof(uint32_t))
+            {
+              is.setstate(std::ios_base::failbit);
+              return 0;
+            }
+            uint32_t source_size = 0;
+            is.read(reinterpret_cast<char*>(&source_size), sizeof(source_size));
+            source_size = wire::from_le(source_size);
+            if(source_size > consumed - sizeof(uint32_t))
+            {
+              is.setstate(std::ios_base::failbit);
+              return 0;
+            }
+            skip_bytes(is, source_size);
+            records(consumed - sizeof(uint32_t) - source_size, parent);
+          }
+          else
+            skip_bytes(is, consumed);
+
+          if(allowed_children(header.type))
+            records(header.end_of_record - consumed, parent);
+          consumed = header.end_of_record;
+        }
+        skip_bytes(is, header.end_of_record - consumed);
+        return header.header_size() + header.end_of_record;
+      }
+
+      any_record_t local;
+      any_record_t& data = parent ? parent->child_records.emplace_back() : local;
+      uint32_t consumed = record_table<filtered_read_entry_t>[record_index(header.type)](is, data, header);
+      if(consumed < header.end_of_record)
+        records(header.end_of_record - consumed, &record_header(data));
+
+      if(!parent && is.good())
+        sink(data);
+      return header.header_size() + header.end_of_record;
+    }
+
+    void file(void)
+    {
+      while(!finished && is.good() && is.peek() != EOF)
+        record(nullptr);
+    }
+  };
+
+  std::istream& read_filtered(std::istream& is, const record_filter_t& filter, const std::function<void(any_record_t&)>& sink)
+  {
+    filtered_parse_t{ is, filter, sink, false }.file();
+    return is;
+  }
+
+  std::vector<any_record_t> read_filtered(std::istream& is, const record_filter_t& filter)
+  {
+    std::vector<any_record_t> records;
+    read_filtered(is, filter, [&records](any_record_t& record) { records.emplace_back(std::move(record)); });
+    return records;
+  }
+} // namespace garmin
@@ -0,0 +1,35 @@
+#ifndef RECORD_FILTER_H
+#define RECORD_FILTER_H
+
+#include "record_dispatch.h"
+
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+
+// Parsing restricted to a set of record types. Records that neither are wanted nor can hold a wanted
+// record are skipped by their extent without being decoded.
+
+namespace garmin
+{
+  struct record_filter_t
+  {
+    record_filter_t(std::initializer_list<record_id_t> types);
+
+    bool wants(record_id_t type) const { return known_record_type(type) && (wanted & bit(type)); }
+    bool reaches(record_id_t type) const { return known_record_type(type) && (containers & bit(type)); } // may hold a wanted record
+
+    static constexpr uint32_t bit(record_id_t type) { return uint32_t(1) << record_index(type); }
+
+    uint32_t wanted;
+    uint32_t containers;
+  };
+
+  // Hands every top level wanted record to sink in file order and stops after the End record.
+  // Wanted records hold their wanted descendants as child records, even when records in between
+  // were filtered out.
+  std::istream& read_filtered(std::istream& is, const record_filter_t& filter, const std::function<void(any_record_t&)>& sink);
+  std::vector<any_record_t> read_filtered(std::istream& is, const record_filter_t& filter);
+} // namespace garmin
+
+#endif // RECORD_FILTER_H
@@ -1,57 +1,51 @@
 ﻿#include <record_types.h>
+#include <record_dispatch.h>
 
 #include <cassert>
 
 namespace garmin
 {
 
-  template<typename T>
-  inline uint32_t record_size(const any_record_t& data)
+  uint32_t record_size(const any_record_t& data)
   {
-    auto& record = std::get<T>(data);
-
-    return record.header_size() +
-        record.data_size() +
-        record.children_size();
+    return visit_record([](const auto& record) { return calc_record_size(record); }, data);
   }
 
-  uint32_t record_size(const any_record_t& data)
+  const char* record_name(record_id_t type)
   {
-    switch(data.index())
+    switch(type)
     {
-      case GarminHeader:      return record_size<garmin_header_t      >(data);
-      case POIHeader:         return record_size<poi_header_t         >(data);
-      case Point:             return record_size<point_t              >(data);
-      case Alert:             return record_size<alert_t              >(data);
-      case BitmapReference:   return record_size<bitmap_reference_t   >(data);
-      case Bitmap:            return record_size<bitmap_t             >(data);
-      case CategoryReference: return record_size<category_reference_t >(data);
-      case Category:          return record_size<category_t           >(data);
-      case Area:              return record_size<area_t               >(data);
-      case POIGroup:          return record_size<poi_group_t          >(data);
-      case Comment:           return record_size<comment_t            >(data);
-      case Address:           return record_size<address_t            >(data);
-      case Contact:           return record_size<contact_t            >(data);
-      case ImageFile:         return record_size<image_file_t         >(data);
-      case Description:       return record_size<description_t        >(data);
-      case Record15:          return record_size<record15_t           >(data);
-      case Record16:          return record_size<record16_t           >(data);
-      case Copyright:         return record_size<copyright_t          >(data);
-      case AudioFile:         return record_size<audio_file_t         >(data);
-      case SpeedCamera:       return record_size<speed_camera_t       >(data);
-      case Record20:          return record_size<record20_t           >(data);
-      case Index:             return record_size<index_t              >(data);
-      case Record22:          return record_size<record22_t           >(data);
-      case Record23:          return record_size<record23_t           >(data);
-      case Record24:          return record_size<record24_t           >(data);
-      case Record25:          return record_size<record25_t           >(data);
-      case Record26:          return record_size<record26_t           >(data);
-      case Record27:          return record_size<record27_t           >(data);
-      default:
-        assert(false);
-        break;
+      case GarminHeader:      return "GarminHeader";
+      case POIHeader:         return "POIHeader";
+      case Point:             return "Point";
+      case Alert:             return "Alert";
+      case BitmapReference:   return "BitmapReference";
+      case Bitmap:            return "Bitmap";
+      case CategoryReference: return "CategoryReference";
+      case Category:          return "Category";
+      case Area:              return "Area";
+      case POIGroup:          return "POIGroup";
+      case Comment:           return "Comment";
+      case Address:           return "Address";
+      case Contact:           return "Contact";
+      case ImageFile:         return "ImageFile";
+      case Description:       return "Description";
+      case Record15:          return "Record15";
+      case Record16:          return "Record16";
+      case Copyright:         return "Copyright";
+      case AudioFile:         return "AudioFile";
+      case SpeedCamera:       return "SpeedCamera";
+      case Record20:          return "Record20";
+      case Index:             return "Index";
+      case Record22:          return "Record22";
+      case Record23:          return "Record23";
+      case Record24:          return "Record24";
+      case Record25:          return "Record25";
+      case Record26:          return "Record26";
+      case Record27:          return "Record27";
+      case End:               return "End";
+      default:                return "Unknown";
     }
-    return 0;
   }
 
   uint32_t record_header_t::children_size(void) const
@@ -70,16 +64,13 @@ namespace garmin
         mask_data.size();
   }
 
-  poi_group_t::poi_group_t(void) : record_header_t(POIGroup, { Multiple | CategoryReference, Multiple | BitmapReference, Multiple | AudioFile, Record23, Record24 }) { }
+  poi_group_t::poi_group_t(void) : record_header_t(POIGroup) { }
 
   uint32_t poi_group_t::calc_data_size(void) const
   {
     uint32_t total = source.byte_count();
     for(auto& area : areas)
-    {
-      total += area.calc_data_size() +
-               area.children_size();
-    }
+      total += calc_record_size(area);
     return total;
   }
 
@@ -112,7 +103,7 @@ namespace garmin
         copyright_notice.byte_count() +
         (device_model ? device_model->byte_count() : 0) +
         (image_files.size() * sizeof(image_file_data_t)) +
-        (Unknown30 ? sizeof(uint16_t) : 0);
+        (Unknown30 ? sizeof(uint32_t) : 0);
   }
 
 }
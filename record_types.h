@@ -4,8 +4,10 @@
 #include <cstdint>
 #include <cstring>
 #include <chrono>
+#include <initializer_list>
 #include <optional>
 #include <map>
+#include <memory>
 #include <vector>
 #include <iostream>
 #include <variant>
@@ -214,35 +216,49 @@ namespace garmin
   struct record27_t;
   struct end_t;
 
+  // large record types that occur at most a few times per point are held behind a pointer
+  // so that they do not widen every any_record_t
+  template<typename T>
+  struct boxed_t
+  {
+    boxed_t(void) : record(std::make_unique<T>()) { }
+    boxed_t(const record_header_t& header) : record(std::make_unique<T>(header)) { }
+    boxed_t(const T& other) : record(std::make_unique<T>(other)) { }
+    boxed_t(const boxed_t& other) : record(std::make_unique<T>(*other.record)) { }
+    boxed_t(boxed_t&& other) noexcept = default;
+
+    boxed_t& operator=(const boxed_t& other) { record = std::make_unique<T>(*other.record); return *this; }
+    boxed_t& operator=(boxed_t&& other) noexcept = default;
+
+    std::unique_ptr<T> record;
+  };
+
   using any_record_t = std::variant<record_header_t, garmin_header_t, poi_header_t, point_t,
-                                    alert_t, bitmap_reference_t, bitmap_t, category_reference_t,
-                                    category_t, area_t, poi_group_t, comment_t, address_t,
-                                    contact_t, image_file_t, description_t, record15_t,
-                                    record16_t, copyright_t, audio_file_t, speed_camera_t,
+                                    alert_t, bitmap_reference_t, boxed_t<bitmap_t>, category_reference_t,
+                                    category_t, area_t, poi_group_t, comment_t, boxed_t<address_t>,
+                                    boxed_t<contact_t>, image_file_t, description_t, record15_t,
+                                    record16_t, boxed_t<copyright_t>, audio_file_t, speed_camera_t,
                                     record20_t, index_t, record22_t, record23_t, record24_t,
                                     record25_t, record26_t, record27_t>;
 
   struct record_header_t
   {
-    record_header_t(const record_header_t& header)
-      : type(header.type),
-        header_flags(header.header_flags),
-        end_of_record(header.end_of_record),
-        end_of_data(header.end_of_data)
-    {}
-
-    record_header_t(const record_id_t t = End, std::initializer_list<uint16_t> ct = {})
+    record_header_t(const record_id_t t = End)
       : type(t),
-        end_of_record(UINT32_MAX),
-        children_types(ct)
+        header_flags(),
+        end_of_record(UINT32_MAX)
     {}
-    virtual ~record_header_t(void) = default;
+
+    // record types that may be subordinated, every record type declares its own
+    static constexpr std::initializer_list<uint16_t> children_types = {};
 
     record_header_t& header(void) { return *this; }
     const record_header_t& header(void) const { return *this; }
     uint32_t header_size(void) const { return end_of_data ? 12 : 8; }
-    virtual uint32_t statics_size(void) const { return 0; }
-    virtual uint32_t calc_data_size(void) const { return statics_size(); }
+    // not virtual, every record type declares its own calc_data_size and is sized as its concrete type
+    uint32_t statics_size(void) const { return 0; }
+    uint32_t calc_data_size(void) const { return statics_size(); }
+    uint32_t extra_data_size(void) const { return children_size(); }
     uint32_t children_size(void) const;
 
 
@@ -257,10 +273,19 @@ namespace garmin
 
     mutable uint32le_t end_of_record;
     mutable std::optional<uint32le_t> end_of_data;
-    const std::vector<uint16_t> children_types;
     std::vector<any_record_t> child_records;
   };
 
+  // size of the record including its header, record has to be of its concrete type
+  template<typename T>
+  uint32_t calc_record_size(const T& record)
+  {
+    uint32_t extra_size = record.extra_data_size();
+    return (extra_size ? 12 : 8) + // header size
+        record.calc_data_size() +
+        extra_size;
+  }
+
   template<typename size_type, typename data_type>
   struct vector_t : std::vector<data_type>
   {
@@ -289,19 +314,22 @@ namespace garmin
   {
     garmin_header_t(const record_header_t& header) : record_header_t(header) { }
     garmin_header_t(void)
-      : record_header_t(GarminHeader, { Record15 })
+      : record_header_t(GarminHeader)
     {
       memcpy(magic, "GRMREC", 6);
       memcpy(version, "01", 2);
     }
-    uint32_t statics_size(void) const { return 14; }
 
+    static constexpr std::initializer_list<uint16_t> children_types = { Record15 };
+    uint32_t statics_size(void) const { return 14; }
+    uint32_t calc_data_size(void) const { return statics_size() + name.byte_count(); }
 
     char magic[6];    // "GRMREC"
     char version[2];  // "00" or "01"
     timestamp_t timestamp;
     flags_t flags;
-      // bit0: obfustication enabled
+      // bit0-7: unknown, seen values 0, 1, 3 and 5
+      // bit8: obfustication enabled after the POI header
     vector16_t name;
   };
 
@@ -309,13 +337,15 @@ namespace garmin
   {
     poi_header_t(const record_header_t& header) : record_header_t(header) { }
     poi_header_t(void)
-      : record_header_t(POIHeader, { Copyright })
+      : record_header_t(POIHeader)
     {
       memcpy(magic, "POI\0\0\0", 6);
       memcpy(version, "01", 2);
     }
 
+    static constexpr std::initializer_list<uint16_t> children_types = { Copyright };
     uint32_t statics_size(void) const { return 12; }
+    uint32_t calc_data_size(void) const { return statics_size(); }
 
     char magic[6];    // "POI\0\0\0"
     char version[2];  // "00" or "01"
@@ -326,7 +356,9 @@ namespace garmin
   struct point_t : record_header_t
   {
     point_t(const record_header_t& header) : record_header_t(header) { }
-    point_t(void) : record_header_t(Point, { CategoryReference, BitmapReference, Alert, Comment, Address, Contact, Multiple | ImageFile, Description, Record26 }) { }
+    point_t(void) : record_header_t(Point) { }
+
+    static constexpr std::initializer_list<uint16_t> children_types = { CategoryReference, BitmapReference, Alert, Comment, Address, Contact, Multiple | ImageFile, Description, Record26 };
 
     uint32_t statics_size(void) const { return 11; }
     uint32_t calc_data_size(void) const { return statics_size() + shortname.byte_count(); }
@@ -345,9 +377,12 @@ namespace garmin
   struct alert_t : record_header_t
   {
     alert_t(const record_header_t& header) : record_header_t(header) { }
-    alert_t(void) : record_header_t(Alert, { Record16, Record27 }) { }
+    alert_t(void) : record_header_t(Alert) { }
+
+    static constexpr std::initializer_list<uint16_t> children_types = { Record16, Record27 };
 
     uint32_t statics_size(void) const { return 12; }
+    uint32_t calc_data_size(void) const { return statics_size(); }
 
     uint16le_t proximity; // measured in meters
     uint16le_t velocity;  // measured in 100x meters / second, 0 = none
@@ -411,6 +446,7 @@ namespace garmin
     category_reference_t(void) : record_header_t(CategoryReference) { }
 
     uint32_t statics_size(void) const { return 2; }
+    uint32_t calc_data_size(void) const { return statics_size(); }
 
     uint16le_t category_id; // points to the Category record with this ID number
   };
@@ -418,7 +454,9 @@ namespace garmin
   struct category_t : record_header_t
   {
     category_t(const record_header_t& header) : record_header_t(header) { }
-    category_t(void) : record_header_t(Category, { BitmapReference }) { }
+    category_t(void) : record_header_t(Category) { }
+
+    static constexpr std::initializer_list<uint16_t> children_types = { BitmapReference };
 
     uint32_t statics_size(void) const { return 2; }
     uint32_t calc_data_size(void) const { return statics_size() + name.byte_count(); }
@@ -430,9 +468,12 @@ namespace garmin
   struct area_t : record_header_t
   {
     area_t(const record_header_t& header) : record_header_t(header) { }
-    area_t(void) : record_header_t(Area, { Multiple | Area, Multiple | Point, Multiple | SpeedCamera }) { }
+    area_t(void) : record_header_t(Area) { }
+
+    static constexpr std::initializer_list<uint16_t> children_types = { Multiple | Area, Multiple | Point, Multiple | SpeedCamera };
 
     uint32_t statics_size(void) const { return 23; }
+    uint32_t calc_data_size(void) const { return statics_size(); }
 
     coords32_t coordinates_max;
     coords32_t coordinates_min;
@@ -452,6 +493,8 @@ namespace garmin
     poi_group_t(const record_header_t& header) : record_header_t(header) { }
     poi_group_t(void);
 
+    static constexpr std::initializer_list<uint16_t> children_types = { Multiple | Category, Multiple | Bitmap, Multiple | AudioFile, Record23, Record24 };
+
     uint32_t calc_data_size(void) const;
 
     lstring_t source;
@@ -477,7 +520,6 @@ namespace garmin
 
     struct [[gnu::packed]] have_t
     {
-      uint8_t byte0;
       union
       {
         struct
@@ -489,9 +531,10 @@ namespace garmin
           uint8_t street_name : 1;
           uint8_t building_id : 1;
         };
-        uint8_t byte1;
+        uint8_t byte0;
       };
-    } mutable have;
+      uint8_t byte1;
+    } mutable have = have_t(); // zeroed with the unused bits, in FileVersion '00' the fields are stored in the extra data
     static_assert(sizeof(have_t) == sizeof(uint16_t), "packing failure");
 
     std::optional<lstring_t>  city;
@@ -512,7 +555,6 @@ namespace garmin
 
     struct [[gnu::packed]] have_t
     {
-      uint8_t byte0;
       union
       {
         struct
@@ -523,9 +565,10 @@ namespace garmin
           uint8_t email  : 1;
           uint8_t URL    : 1;
         };
-        uint8_t byte1;
+        uint8_t byte0;
       };
-    } mutable have;
+      uint8_t byte1;
+    } mutable have = have_t(); // zeroed with the unused bits, in FileVersion '00' the fields are stored in the extra data
     static_assert(sizeof(have_t) == sizeof(uint16_t), "packing failure");
 
     std::optional<vector16_t> phone1;
@@ -586,7 +629,7 @@ namespace garmin
       uint32le_t unknown; // altitude?
     };
 
-    vector_t<uint16_t, point3d_t> points;
+    std::vector<point3d_t> points; // uint16 count followed by 12 byte points
   };
 
 
@@ -689,32 +732,43 @@ namespace garmin
     audio_file_t(void) : record_header_t(AudioFile) { }
 
     uint32_t statics_size(void) const { return 3; }
-    uint32_t calc_data_size(void) const { return statics_size() + audio_data.byte_count(); }
+    uint32_t calc_data_size(void) const { return statics_size(); }
+    uint32_t extra_data_size(void) const { return audio_data.byte_count(); } // media is stored in the extra data
 
     uint16le_t audio_id;
     audio_format_t format;
     localized_t<vector32_t> audio_data;
   };
 
-  struct speed_camera_t : record_header_t
+  // records whose content is skipped over, their sizes are preserved as read
+  struct opaque_record_t : record_header_t
+  {
+    opaque_record_t(const record_header_t& header) : record_header_t(header) { }
+    opaque_record_t(const record_id_t t) : record_header_t(t) { }
+
+    uint32_t calc_data_size(void) const { return data_size(); }
+    uint32_t extra_data_size(void) const { return aux_data_size(); }
+  };
+
+  struct speed_camera_t : opaque_record_t
   {
-    speed_camera_t(const record_header_t& header) : record_header_t(header) { }
-    speed_camera_t(void) : record_header_t(SpeedCamera) { }
+    speed_camera_t(const record_header_t& header) : opaque_record_t(header) { }
+    speed_camera_t(void) : opaque_record_t(SpeedCamera) { }
 
   };
 
-  struct record20_t : record_header_t
+  struct record20_t : opaque_record_t
   {
-    record20_t(const record_header_t& header) : record_header_t(header) { }
-    record20_t(void) : record_header_t(Record20) { }
+    record20_t(const record_header_t& header) : opaque_record_t(header) { }
+    record20_t(void) : opaque_record_t(Record20) { }
   };
 
-  struct index_t : record_header_t
+  struct index_t : opaque_record_t
   {
-    index_t(const record_header_t& header) : record_header_t(header) { }
-    index_t(void) : record_header_t(Index) { }
+    index_t(const record_header_t& header) : opaque_record_t(header) { }
+    index_t(void) : opaque_record_t(Index) { }
 
-    uint32_t statics_size(void) const override { return 58; }
+    uint32_t statics_size(void) const { return 58; }
 
     uint16le_t data_length; // byte_length - 2 (weird)
     uint32le_t index_offset0;
@@ -727,49 +781,52 @@ namespace garmin
   };
 
 
-  struct record22_t : record_header_t
+  struct record22_t : opaque_record_t
   {
-    record22_t(const record_header_t& header) : record_header_t(header) { }
-    record22_t(void) : record_header_t(Record22) { }
+    record22_t(const record_header_t& header) : opaque_record_t(header) { }
+    record22_t(void) : opaque_record_t(Record22) { }
   };
 
 
-  struct record23_t : record_header_t
+  struct record23_t : opaque_record_t
   {
-    record23_t(const record_header_t& header) : record_header_t(header) { }
-    record23_t(void) : record_header_t(Record23, { Multiple | Bitmap }) { }
+    record23_t(const record_header_t& header) : opaque_record_t(header) { }
+    record23_t(void) : opaque_record_t(Record23) { }
+
+    static constexpr std::initializer_list<uint16_t> children_types = { Multiple | Bitmap };
   };
 
 
-  struct record24_t : record_header_t
+  struct record24_t : opaque_record_t
   {
-    record24_t(const record_header_t& header) : record_header_t(header) { }
-    record24_t(void) : record_header_t(Record24) { }
+    record24_t(const record_header_t& header) : opaque_record_t(header) { }
+    record24_t(void) : opaque_record_t(Record24) { }
   };
 
 
-  struct record25_t : record_header_t
+  struct record25_t : opaque_record_t
   {
-    record25_t(const record_header_t& header) : record_header_t(header) { }
-    record25_t(void) : record_header_t(Record25) { }
+    record25_t(const record_header_t& header) : opaque_record_t(header) { }
+    record25_t(void) : opaque_record_t(Record25) { }
   };
 
 
-  struct record26_t : record_header_t
+  struct record26_t : opaque_record_t
   {
-    record26_t(const record_header_t& header) : record_header_t(header) { }
-    record26_t(void) : record_header_t(Record26) { }
+    record26_t(const record_header_t& header) : opaque_record_t(header) { }
+    record26_t(void) : opaque_record_t(Record26) { }
   };
 
 
-  struct record27_t : record_header_t
+  struct record27_t : opaque_record_t
   {
-    record27_t(const record_header_t& header) : record_header_t(header) { }
-    record27_t(void) : record_header_t(Record27) { }
+    record27_t(const record_header_t& header) : opaque_record_t(header) { }
+    record27_t(void) : opaque_record_t(Record27) { }
   };
 
 
   uint32_t record_size(const any_record_t& data);
+  const char* record_name(record_id_t type);
 
 } // namespace garmin
 
@@ -0,0 +1,217 @@
+#include "record_writer.h"
+#include "parsers.h"
+#include "record_dispatch.h"
+#include "skim.h"
+
+#include <limits>
+#include <sstream>
+#include <cassert>
+
+namespace garmin
+{
+  lstring_t make_lstring(std::string_view text, uint16_t locale)
+  {
+    lstring_t lstring;
+    lstring[locale].assign(std::begin(text), std::end(text));
+    return lstring;
+  }
+
+  void make_file_records(const file_description_t& description, std::vector<any_record_t>& records)
+  {
+    assert(description.version[0] == '0' && (description.version[1] == '0' || description.version[1] == '1'));
+
+    garmin_header_t& garmin_header = add_record<garmin_header_t>(records);
+    std::copy(description.version, description.version + 2, garmin_header.version);
+    garmin_header.timestamp = timestamp_t(std::chrono::duration<uint64_t>(description.timestamp));
+    garmin_header.flags = flags_t();
+    garmin_header.name.assign(std::begin(description.name), std::end(description.name));
+
+    poi_header_t& poi_header = add_record<poi_header_t>(records);
+    std::copy(description.version, description.version + 2, poi_header.version);
+    poi_header.codepage = description.codepage;
+    poi_header.auxiliary_type = record_id_t(0); // none
+    if(description.version[1] == '1')
+    {
+      poi_header.auxiliary_type = Copyright;
+      copyright_t& copyright = add_record<copyright_t>(poi_header.child_records);
+      copyright.have = copyright_t::have_t();
+      copyright.unknown0 = 0;
+      copyright.unknown1 = 0;
+      copyright.data_source = description.source;
+      copyright.copyright_notice = description.copyright_notice;
+    }
+
+    add_record<poi_group_t>(records).source = description.source;
+  }
+
+  area_t make_area(const area_bounds_t& bounds)
+  {
+    area_t area;
+    area.coordinates_max.latitude = bounds.max_latitude;
+    area.coordinates_max.longitude = bounds.max_longitude;
+    area.coordinates_min.latitude = bounds.min_latitude;
+    area.coordinates_min.longitude = bounds.min_longitude;
+    area.reserved = 0;
+    area.flags = flags_t();
+    area.flags.bit0 = 1;
+    area.unknown = 1;
+    return area;
+  }
+
+  area_builder_t::area_builder_t(uint32_t area_points, uint32_t max_depth, spatial_order_t order)
+    : order(order),
+      area_points(area_points),
+      max_depth(max_depth)
+  {
+  }
+
+  void area_builder_t::build(void)
+  {
+    double everywhere = std::numeric_limits<double>::infinity();
+    area(region_t { -everywhere, everywhere, -everywhere, everywhere, 0, 0, -1 }, 0);
+  }
+
+  void area_builder_t::area(const region_t& region, uint32_t depth)
+  {
+    area_bounds_t bounds;
+    uint64_t count = enter(region, bounds);
+    if(count)
+    {
+      open_area(bounds);
+      if(count <= area_points ||
+         depth >= max_depth ||
+         (bounds.min_latitude == bounds.max_latitude && bounds.min_longitude == bounds.max_longitude))
+        points();
+      else
+      {
+        double latitude = (bounds.min_latitude + bounds.max_latitude) / 2;
+        double longitude = (bounds.min_longitude + bounds.max_longitude) / 2;
+        const region_t quadrants[4] =
+        {
+          { region.min_latitude, latitude, region.min_longitude, longitude, latitude, longitude, 0 },
+          { region.min_latitude, latitude, longitude, region.max_longitude, latitude, longitude, 1 },
+          { latitude, region.max_latitude, region.min_longitude, longitude, latitude, longitude, 2 },
+          { latitude, region.max_latitude, longitude, region.max_longitude, latitude, longitude, 3 },
+        };
+        int visits[4] = { 0, 1, 2, 3 };
+        if(order != InputOrder) // quadrants follow the curve through their centers
+        {
+          uint64_t keys[4];
+          for(int i = 0; i < 4; ++i)
+            keys[i] = spatial_key(order,
+                                  i < 2 ? (bounds.min_latitude + latitude) / 2 : (latitude + bounds.max_latitude) / 2,
+                                  i % 2 ? (longitude + bounds.max_longitude) / 2 : (bounds.min_longitude + longitude) / 2);
+          std::sort(std::begin(visits), std::end(visits), [&keys](int a, int b) { return keys[a] < keys[b]; });
+        }
+        for(int i : visits)
+          area(quadrants[i], depth + 1);
+      }
+      close_area();
+    }
+    leave();
+  }
+
+  record_writer_t::record_writer_t(std::ostream& os)
+    : os(os),
+      written(0)
+  {
+  }
+
+  // accounts for a record written inside the innermost open record
+  void record_writer_t::subordinate(record_id_t type)
+  {
+    if(open_records.empty())
+      return;
+
+    open_record_t& parent = open_records.back();
+    if(parent.type == POIGroup && type == Area)
+    {
+      assert(parent.data_end == UINT64_MAX); // areas after the extra data
+      return;
+    }
+    assert(allowed_children(parent.type) & (uint32_t(1) << record_index(type)));
+    if(parent.data_end == UINT64_MAX)
+      parent.data_end = written;
+  }
+
+  std::ostream& record_writer_t::write(const any_record_t& record)
+  {
+    const record_header_t& header = record_header(record);
+    subordinate(header.type);
+    os << record;
+    written += record_size(record);
+    return os;
+  }
+
+  std::ostream& record_writer_t::open(const any_record_t& record)
+  {
+    const record_header_t& header = record_header(record);
+    assert(header.child_records.empty());
+    assert(!holds_record<poi_group_t>(record) || get_record<poi_group_t>(record).areas.empty());
+    subordinate(header.type);
+
+    // the main data as written for a record without subordinated records
+    std::ostringstream buffer;
+    buffer << record;
+    std::string data = std::move(buffer).str();
+    uint32_t header_size = header.header_size();
+
+    record_header_t placeholder(header.type);
+    placeholder.header_flags = header.header_flags;
+    placeholder.end_of_record = 0;
+    placeholder.end_of_data = uint32le_t(0);
+    os << placeholder;
+    os.write(data.data() + header_size, std::streamsize(data.size() - header_size));
+
+    open_record_t& opened = open_records.emplace_back();
+    opened.header_position = written;
+    opened.data_position = written + placeholder.header_size();
+    opened.type = header.type;
+    written = opened.data_position + (data.size() - header_size);
+    opened.data_end = header.type == POIGroup ? UINT64_MAX : written;
+    return os;
+  }
+
+  std::ostream& record_writer_t::begin_file(const file_description_t& description)
+  {
+    std::vector<any_record_t> records;
+    make_file_records(description, records);
+    write(records[0]);
+    write(records[1]);
+    return open(records[2]);
+  }
+
+  std::ostream& record_writer_t::end_file(void)
+  {
+    assert(open_records.size() == 1 && open_records.back().type == POIGroup);
+    close();
+    return write(record_header_t(End));
+  }
+
+  std::ostream& record_writer_t::close(void)
+  {
+    assert(!open_records.empty());
+    if(open_records.empty())
+    {
+      os.setstate(std::ios_base::failbit);
+      return os;
+    }
+
+    open_record_t record = open_records.back();
+    open_records.pop_back();
+    if(record.data_end == UINT64_MAX)
+      record.data_end = written;
+
+    // lengths follow the type and flags, see operator<<(record_header_t)
+    std::streampos end = os.tellp();
+    if(end == std::streampos(std::streamoff(-1)) ||
+       !os.seekp(end - std::streamoff(written - record.header_position - 4)))
+    {
+      os.setstate(std::ios_base::failbit);
+      return os;
+    }
+    os << uint32le_t(uint32_t(written - record.data_position))
+       << uint32le_t(uint32_t(record.data_end - record.data_position));
+    return os.seekp(end);
+  }
+} // namespace garmin
@@ -0,0 +1,203 @@
+#ifndef RECORD_WRITER_H
+#define RECORD_WRITER_H
+
+#include "record_types.h"
+#include "spatial_order.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+// Writes a file while its records are produced, so only the records that are still open are kept in
+// memory. The header of an open record is written with placeholder lengths that are patched when the
+// record is closed, which needs a seekable stream. Open records always get a length for their extra
+// data, records written complete are identical to the output of operator<<.
+
+namespace garmin
+{
+  // nesting limit of the areas files are built with, areas at this depth are not split any further
+  constexpr uint32_t max_area_depth = 24;
+
+  // text in one locale, given as its two letters in the high and low byte
+  lstring_t make_lstring(std::string_view text, uint16_t locale = 0x454E); // EN
+
+  // content of the records every built file starts with
+  struct file_description_t
+  {
+    char version[2] = { '0', '1' };
+    uint64_t timestamp = unix_time_offset; // UNIX time, not before the Garmin epoch
+    std::string name;            // file name in the garmin header
+    codepage_t codepage = Unicode;
+    lstring_t source;            // data source of the POI group and of the copyright record
+    lstring_t copyright_notice;  // of the copyright record, which only version '01' files have
+  };
+
+  // appends the garmin header, the POI header and an empty POI group
+  void make_file_records(const file_description_t& description, std::vector<any_record_t>& records);
+
+  class record_writer_t
+  {
+  public:
+    record_writer_t(std::ostream& os);
+
+    // a complete record including its child records
+    std::ostream& write(const any_record_t& record);
+
+    // a record without child records (or areas for a POI group), its subordinated records follow
+    // until close(). The areas of a POI group have to come before its other subordinated records.
+    std::ostream& open(const any_record_t& record);
+    std::ostream& close(void);
+
+    uint32_t depth(void) const { return uint32_t(open_records.size()); }
+
+    // the records of make_file_records with the POI group left open, end_file closes it and ends the file
+    std::ostream& begin_file(const file_description_t& description);
+    std::ostream& end_file(void);
+
+  private:
+    struct open_record_t
+    {
+      uint64_t header_position;
+      uint64_t data_position; // start of the main data
+      uint64_t data_end;      // end of the main data once known
+      record_id_t type;
+    };
+
+    void subordinate(record_id_t type);
+
+    std::ostream& os;
+    uint64_t written; // bytes since construction
+    std::vector<open_record_t> open_records;
+  };
+
+  struct area_bounds_t
+  {
+    double min_latitude;
+    double max_latitude;
+    double min_longitude;
+    double max_longitude;
+  };
+
+  // area record of a bounding box
+  area_t make_area(const area_bounds_t& bounds);
+
+  // Splits points into nested areas around the centers of their bounding boxes until an area holds at
+  // most area_points points, all its points share a location or it is max_depth deep. The points are
+  // selected by region, so they do not have to be held in memory. The quadrants of a split area are
+  // visited along the curve of order through their centers.
+  class area_builder_t
+  {
+  public:
+    area_builder_t(uint32_t area_points, uint32_t max_depth = max_area_depth, spatial_order_t order = InputOrder);
+    virtual ~area_builder_t(void) = default;
+
+    // the area of all points including the areas within, none without points
+    void build(void);
+
+  protected:
+    // quadrant of the region of the enclosing area, which is split at center
+    struct region_t
+    {
+      double min_latitude;  // half open
+      double max_latitude;
+      double min_longitude;
+      double max_longitude;
+      double center_latitude;
+      double center_longitude;
+      int quadrant;         // below left, below right, above left, above right, -1 for all points
+    };
+
+    // selects the points of a region and returns their number and bounding box, every region entered is left
+    virtual uint64_t enter(const region_t& region, area_bounds_t& bounds) = 0;
+    virtual void leave(void) { }
+
+    virtual void open_area(const area_bounds_t& bounds) = 0;
+    virtual void points(void) = 0; // of the region entered last, in an area that is not split
+    virtual void close_area(void) = 0;
+
+    const spatial_order_t order;
+
+  private:
+    void area(const region_t& region, uint32_t depth);
+
+    uint32_t area_points;
+    uint32_t max_depth;
+  };
+
+  // area_builder_t over points held in a vector, which are reordered into the areas in place
+  template<typename T>
+  class vector_area_builder_t : public area_builder_t
+  {
+  public:
+    using iterator_t = typename std::vector<T>::iterator;
+
+    vector_area_builder_t(std::vector<T>& items, uint32_t area_points, uint32_t max_depth = max_area_depth, spatial_order_t order = InputOrder)
+      : area_builder_t(area_points, max_depth, order),
+        items(items)
+    {
+    }
+
+  protected:
+    virtual double latitude(const T& item) const = 0;
+    virtual double longitude(const T& item) const = 0;
+
+    // points of the region entered last
+    iterator_t first(void) const { return ranges.back().bounds[0]; }
+    iterator_t last(void) const { return ranges.back().bounds[4]; }
+
+    uint64_t enter(const region_t& region, area_bounds_t& bounds)
+    {
+      range_t range;
+      if(region.quadrant < 0)
+      {
+        range.bounds[0] = items.begin();
+        range.bounds[4] = items.end();
+      }
+      else
+      {
+        range_t& parent = ranges.back();
+        if(!parent.split) // into quadrants, below before above and left before right
+        {
+          auto below = [this, &region](const T& item) { return latitude(item) < region.center_latitude; };
+          auto left = [this, &region](const T& item) { return longitude(item) < region.center_longitude; };
+          parent.bounds[2] = std::partition(parent.bounds[0], parent.bounds[4], below);
+          parent.bounds[1] = std::partition(parent.bounds[0], parent.bounds[2], left);
+          parent.bounds[3] = std::partition(parent.bounds[2], parent.bounds[4], left);
+          parent.split = true;
+        }
+        range.bounds[0] = parent.bounds[region.quadrant];
+        range.bounds[4] = parent.bounds[region.quadrant + 1];
+      }
+      range.split = false;
+      ranges.push_back(range);
+
+      if(range.bounds[0] == range.bounds[4])
+        return 0;
+      bounds.min_latitude = bounds.max_latitude = latitude(*range.bounds[0]);
+      bounds.min_longitude = bounds.max_longitude = longitude(*range.bounds[0]);
+      for(auto pos = range.bounds[0]; pos != range.bounds[4]; ++pos)
+      {
+        bounds.min_latitude = std::min(bounds.min_latitude, latitude(*pos));
+        bounds.max_latitude = std::max(bounds.max_latitude, latitude(*pos));
+        bounds.min_longitude = std::min(bounds.min_longitude, longitude(*pos));
+        bounds.max_longitude = std::max(bounds.max_longitude, longitude(*pos));
+      }
+      return uint64_t(range.bounds[4] - range.bounds[0]);
+    }
+
+    void leave(void) { ranges.pop_back(); }
+
+  private:
+    struct range_t
+    {
+      iterator_t bounds[5]; // first and last, in between the quadrants once split
+      bool split;
+    };
+
+    std::vector<T>& items;
+    std::vector<range_t> ranges;
+  };
+} // namespace garmin
+
+#endif // RECORD_WRITER_H
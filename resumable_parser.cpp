@@ -0,0 +1,54 @@
+#include "resumable_parser.h"
+#include "record_dispatch.h"
+
+namespace garmin
+{
+  static constexpr uint32_t steps_per_clock_check = 16;
+
+  resumable_parser_t::resumable_parser_t(std::istream& is)
+    : is(is),
+      parser(is, *this),
+      parsed(0)
+  {
+  }
+
+  bool resumable_parser_t::resume(std::chrono::microseconds budget)
+  {
+    auto deadline = std::chrono::steady_clock::now() + budget;
+    for(;;)
+    {
+      for(uint32_t i = 0; i < steps_per_clock_check; ++i)
+        if(!parser.step())
+          return false;
+      if(std::chrono::steady_clock::now() >= deadline)
+        return true;
+    }
+  }
+
+  bool resumable_parser_t::resume(uint32_t record_count)
+  {
+    uint64_t target = parsed + record_count;
+    while(parsed < target)
+      if(!parser.step())
+        return false;
+    return true;
+  }
+
+  void resumable_parser_t::record_content(any_record_t& data, uint32_t)
+  {
+    ++parsed;
+    record_header_t* record = nullptr;
+    if(open.empty())
+      record = &record_header(records.emplace_back(std::move(data)));
+    else if(open.back()->type == POIGroup && holds_record<area_t>(data)) // areas are kept apart
+      record = &static_cast<poi_group_t*>(open.back())->areas.emplace_back(std::move(get_record<area_t>(data)));
+    else
+      record = &record_header(open.back()->child_records.emplace_back(std::move(data)));
+    open.push_back(record);
+  }
+
+  void resumable_parser_t::leave_record(const record_header_t&, uint32_t)
+  {
+    open.pop_back();
+  }
+} // namespace garmin
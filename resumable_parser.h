@@ -0,0 +1,39 @@
+#ifndef RESUMABLE_PARSER_H
+#define RESUMABLE_PARSER_H
+
+#include "event_parser.h"
+
+#include <chrono>
+
+// Builds the same record tree as operator>> in slices, so loading can be interleaved with other work
+// on the same thread. The partially built tree stays valid between slices.
+
+namespace garmin
+{
+  class resumable_parser_t : private record_handler_t
+  {
+  public:
+    resumable_parser_t(std::istream& is);
+
+    // both return false once parsing finished or failed
+    bool resume(std::chrono::microseconds budget);
+    bool resume(uint32_t record_count);
+
+    bool finished(void) const { return parser.finished(); }
+    bool good(void) const { return !is.fail(); }
+    uint64_t records_parsed(void) const { return parsed; }
+
+    std::vector<any_record_t> records; // top level records, the last one is incomplete while parsing
+
+  private:
+    void record_content(any_record_t& data, uint32_t depth);
+    void leave_record(const record_header_t& header, uint32_t depth);
+
+    std::istream& is;
+    event_parser_t parser;
+    std::vector<record_header_t*> open; // records that still get subordinated records
+    uint64_t parsed;
+  };
+} // namespace garmin
+
+#endif // RESUMABLE_PARSER_H
@@ -0,0 +1,201 @@
+#include "skim.h"
+#include "obfuscation.h"
+#include "wire_types.h"
+
+#include <iterator>
+#include <cstring>
+#include <cstddef>
+
+namespace garmin
+{
+  static constexpr uint8_t skim_max_depth = 32;
+  static constexpr uint16_t extra_data_flag = 0x0008; // header flags bit3
+
+  template<typename T>
+  static T load(const uint8_t* pos)
+  {
+    T value;
+    std::memcpy(&value, pos, sizeof(T));
+    return wire::from_le(value);
+  }
+
+  template<typename T>
+  struct children_entry_t
+  {
+    static constexpr uint32_t function(void)
+    {
+      uint32_t mask = 0;
+      for(uint16_t child : T::children_types)
+      {
+        record_id_t type = record_id_t(child == End ? End : child & ~Multiple);
+        if(known_record_type(type))
+          mask |= uint32_t(1) << record_index(type);
+      }
+      return mask;
+    }
+  };
+
+  static_assert(record_type_count <= 32, "child masks hold one bit per record type");
+
+  template<std::size_t... indexes>
+  static constexpr std::array<uint32_t, record_type_count> make_children_masks(std::index_sequence<indexes...>)
+    { return { record_table<children_entry_t>[indexes]()... }; }
+
+  // built at compile time, so concurrent first calls do not race on its initialisation
+  static constexpr auto children_masks = make_children_masks(std::make_index_sequence<record_type_count>());
+
+  uint32_t allowed_children(record_id_t parent)
+  {
+    return known_record_type(parent) ? children_masks[record_index(parent)] : 0;
+  }
+
+  const char* skim_error_name(skim_error_t error)
+  {
+    switch(error)
+    {
+      case SkimOk:           return "ok";
+      case TruncatedHeader:  return "truncated header";
+      case InvalidExtent:    return "invalid extent";
+      case UnknownRecord:    return "unknown record";
+      case UnexpectedRecord: return "unexpected record";
+      case NestingTooDeep:   return "nesting too deep";
+      case MissingEnd:       return "missing end record";
+      case Obfuscated:       return "obfuscated";
+    }
+    return "unknown error";
+  }
+
+  struct skimmer_t
+  {
+    const uint8_t* data;
+    size_t size;
+    bool table_of_contents;
+    skim_result_t& result;
+
+    bool fail(skim_error_t error, uint32_t offset)
+    {
+      result.error = error;
+      result.error_offset = offset;
+      return false;
+    }
+
+    // checks the record at offset and its subordinated records, limit is the end of the parent
+    bool record(uint32_t offset, uint32_t limit, uint8_t depth, uint32_t allowed, uint32_t& record_end)
+    {
+      if(depth > skim_max_depth)
+        return fail(NestingTooDeep, offset);
+
+      if(limit - offset < 8)
+        return fail(TruncatedHeader, offset);
+
+      record_id_t type = record_id_t(load<uint16_t>(data + offset));
+      uint16_t flags = load<uint16_t>(data + offset + 2);
+      uint32_t end_of_record = load<uint32_t>(data + offset + 4);
+      uint32_t header_size = flags & extra_data_flag ? 12 : 8;
+
+      if(limit - offset < header_size)
+        return fail(TruncatedHeader, offset);
+
+      uint32_t data_size = flags & extra_data_flag ? load<uint32_t>(data + offset + 8) : end_of_record;
+      if(end_of_record > limit - offset - header_size ||
+         data_size > end_of_record)
+        return fail(InvalidExtent, offset);
+
+      if(!known_record_type(type))
+        return fail(UnknownRecord, offset);
+
+      if(!(allowed & (uint32_t(1) << record_index(type))))
+        return fail(UnexpectedRecord, offset);
+
+      ++result.counts[record_index(type)];
+      if(table_of_contents)
+        result.contents.push_back({ offset, data_size, header_size + end_of_record, type, depth, uint8_t(header_size) });
+
+      uint32_t data_begin = offset + header_size;
+      uint32_t data_end = data_begin + data_size;
+      record_end = data_begin + end_of_record;
+
+      if(type == POIGroup) // the areas follow the data source in the main data
+      {
+        if(data_size < sizeof(uint32_t))
+          return fail(InvalidExtent, offset);
+        uint32_t source_size = load<uint32_t>(data + data_begin);
+        if(source_size > data_size - sizeof(uint32_t))
+          return fail(InvalidExtent, offset);
+        if(!records(data_begin + sizeof(uint32_t) + source_size, data_end, depth + 1, uint32_t(1) << record_index(Area)))
+          return false;
+      }
+
+      uint32_t children = allowed_children(type);
+      if(children && data_end < record_end)
+        return records(data_end, record_end, depth + 1, children);
+      return true;
+    }
+
+    // checks a sequence of records filling [begin, end)
+    bool records(uint32_t begin, uint32_t end, uint8_t depth, uint32_t allowed)
+    {
+      while(begin < end)
+        if(!record(begin, end, depth, allowed, begin))
+          return false;
+      return true;
+    }
+
+    void file(void)
+    {
+      if(size > UINT32_MAX)
+        size = UINT32_MAX;
+
+      constexpr uint32_t any_record = ~uint32_t(0);
+      uint32_t offset = 0;
+      uint32_t next = 0;
+      uint32_t limit = uint32_t(size);
+
+      // the signature records come first
+      if(!record(offset, limit, 0, uint32_t(1) << record_index(GarminHeader), next))
+        return;
+      uint32_t header_size = load<uint16_t>(data + offset + 2) & extra_data_flag ? 12 : 8;
+      bool obfuscated = next - offset >= header_size + sizeof(wire::garmin_header_t) &&
+                        (load<uint16_t>(data + offset + header_size + offsetof(wire::garmin_header_t, flags)) & 0x0100);
+      offset = next;
+
+      if(!record(offset, limit, 0, uint32_t(1) << record_index(POIHeader), next))
+        return;
+      offset = next;
+
+      if(obfuscated)
+      {
+        fail(Obfuscated, offset);
+        return;
+      }
+
+      while(offset < limit)
+      {
+        if(!record(offset, limit, 0, any_record & ~((uint32_t(1) << record_index(GarminHeader)) |
+                                                   (uint32_t(1) << record_index(POIHeader))), next))
+          return;
+        if(load<uint16_t>(data + offset) == End)
+        {
+          result.end_offset = next;
+          return;
+        }
+        offset = next;
+      }
+      fail(MissingEnd, offset);
+    }
+  };
+
+  skim_result_t skim(const uint8_t* data, size_t size, bool table_of_contents)
+  {
+    skim_result_t result;
+    skimmer_t{ data, size, table_of_contents, result }.file();
+    return result;
+  }
+
+  skim_result_t skim(std::istream& is, bool table_of_contents)
+  {
+    std::vector<uint8_t> data(std::istreambuf_iterator<char>(is), {});
+    deobfuscate(data.data(), data.size()); // the copy is ours to change
+    return skim(data.data(), data.size(), table_of_contents);
+  }
+} // namespace garmin
@@ -0,0 +1,61 @@
+#ifndef SKIM_H
+#define SKIM_H
+
+#include "record_dispatch.h"
+
+#include <array>
+#include <vector>
+#include <iostream>
+
+// Structural validation that only looks at record headers. Nothing is decoded and no records are
+// allocated, so untrusted files can be checked before committing to a full parse.
+
+namespace garmin
+{
+  enum skim_error_t : uint8_t
+  {
+    SkimOk = 0,
+    TruncatedHeader,  // a record header runs past its parent or the end of the file
+    InvalidExtent,    // a record runs past its parent or its main data past its end
+    UnknownRecord,    // record type outside of record_id_t
+    UnexpectedRecord, // record type not allowed at its position
+    NestingTooDeep,
+    MissingEnd,       // the file ended before the End record
+    Obfuscated,       // records past the headers are obfuscated and can not be checked
+  };
+
+  const char* skim_error_name(skim_error_t error);
+
+  struct skim_entry_t
+  {
+    uint32_t offset;      // of the record header
+    uint32_t data_size;   // main data
+    uint32_t record_size; // header, main data and extra data
+    record_id_t type;
+    uint8_t depth;        // 0 for top level records
+    uint8_t header_size;
+  };
+  static_assert(sizeof(skim_entry_t) == 16, "packing failure");
+
+  struct skim_result_t
+  {
+    bool good(void) const { return error == SkimOk; }
+    uint32_t count(record_id_t type) const { return known_record_type(type) ? counts[record_index(type)] : 0; }
+
+    skim_error_t error = SkimOk;
+    uint32_t error_offset = 0; // header of the offending record
+    uint32_t end_offset = 0;   // first byte past the End record, the index table starts here
+    std::array<uint32_t, record_type_count> counts = {}; // indexed by record_index()
+    std::vector<skim_entry_t> contents; // all records in file order, when requested
+  };
+
+  // bit record_index(child) is set for every record type allowed in the extra data of parent
+  uint32_t allowed_children(record_id_t parent);
+
+  // Offsets are relative to data, or to the stream position on entry. Files read from a stream are
+  // deobfuscated, images have to go through deobfuscate() first.
+  skim_result_t skim(const uint8_t* data, size_t size, bool table_of_contents = true);
+  skim_result_t skim(std::istream& is, bool table_of_contents = true);
+} // namespace garmin
+
+#endif // SKIM_H
@@ -0,0 +1,453 @@
+#include "snapshot.h"
+#include "codepage.h"
+#include "merkle_diff.h"
+#include "record_dispatch.h"
+#include "spatial_order.h"
+#include "wire_types.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <unordered_map>
+
+namespace garmin
+{
+  static constexpr char snapshot_magic[8] = { 'G', 'P', 'I', 'S', 'N', 'A', 'P', '\0' };
+  static constexpr bool little_endian_host = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+  // file value of a coordinate, clamped where +180 degrees would wrap around
+  static int32_t raw_coordinate(double degrees)
+  {
+    double value = std::round(degrees * (uint64_t(1) << 32) / 360);
+    return int32_t(std::clamp(value, double(INT32_MIN), double(INT32_MAX)));
+  }
+
+  // first box of each level of the spatial index of a number of points, lowest level first, with one
+  // more for the end
+  static std::vector<size_t> spatial_levels(size_t point_count)
+  {
+    std::vector<size_t> levels(1, 0);
+    size_t boxes = (point_count + snapshot_block_size - 1) / snapshot_block_size;
+    while(boxes)
+    {
+      levels.push_back(levels.back() + boxes);
+      boxes = boxes > 1 ? (boxes + snapshot_node_size - 1) / snapshot_node_size : 0;
+    }
+    return levels;
+  }
+
+  static void extend(snapshot_block_t& block, const snapshot_block_t& other)
+  {
+    block.latitude_min = std::min(block.latitude_min, other.latitude_min);
+    block.longitude_min = std::min(block.longitude_min, other.longitude_min);
+    block.latitude_max = std::max(block.latitude_max, other.latitude_max);
+    block.longitude_max = std::max(block.longitude_max, other.longitude_max);
+  }
+
+  static bool overlaps(const snapshot_block_t& a, const snapshot_block_t& b)
+  {
+    return a.latitude_max >= b.latitude_min && a.latitude_min <= b.latitude_max &&
+           a.longitude_max >= b.longitude_min && a.longitude_min <= b.longitude_max;
+  }
+
+  struct snapshot_builder_t
+  {
+    std::vector<snapshot_file_t> files;
+    std::vector<snapshot_point_t> points;
+    std::vector<snapshot_text_t> texts;
+    std::string strings;
+    std::vector<snapshot_category_t> categories;
+    std::vector<uint32_t> category_links;
+    std::vector<uint32_t> handles;
+
+    std::unordered_map<std::string, uint32_t> string_offsets; // equal text is stored once
+    std::string scratch;
+
+    // appends the locales of names to the text section and returns the first
+    uint32_t names(const lstring_t& names, codepage_t codepage)
+    {
+      uint32_t first = uint32_t(texts.size());
+      for(const auto& pair : names)
+      {
+        scratch.clear();
+        to_utf8(codepage, pair.second.data(), pair.second.size(), scratch);
+        auto found = string_offsets.try_emplace(scratch, uint32_t(strings.size()));
+        if(found.second)
+          strings += scratch;
+        texts.push_back(snapshot_text_t { found.first->second, uint32_t(scratch.size()), pair.first, 0 });
+      }
+      return first;
+    }
+
+    // category rows of a file by their category id
+    void find_categories(const any_record_t& data, uint32_t file, codepage_t& codepage, std::map<uint16_t, uint32_t>& rows)
+    {
+      visit_record([&](const auto& record)
+      {
+        using record_t = std::decay_t<decltype(record)>;
+        if constexpr(std::is_same_v<record_t, poi_header_t>)
+          codepage = record.codepage;
+        if constexpr(std::is_same_v<record_t, category_t>)
+        {
+          rows.emplace(record.category_id, uint32_t(categories.size()));
+          uint32_t first = names(record.name, codepage);
+          categories.push_back(snapshot_category_t { file, first, uint16_t(texts.size() - first), record.category_id });
+        }
+        for(const any_record_t& child : record.child_records)
+          find_categories(child, file, codepage, rows);
+      }, data);
+    }
+
+    void file(const std::vector<any_record_t>& records)
+    {
+      uint32_t index = uint32_t(files.size());
+      snapshot_file_t& entry = files.emplace_back(snapshot_file_t { 0, uint32_t(points.size()), uint32_t(categories.size()), 0, Unicode, 0 });
+
+      codepage_t file_codepage = Unicode;
+      std::map<uint16_t, uint32_t> rows;
+      for(const any_record_t& record : records)
+        find_categories(record, index, file_codepage, rows);
+      entry.category_count = uint32_t(categories.size()) - entry.first_category;
+      entry.codepage = file_codepage;
+
+      visit_points(records, [&](const point_t& point, codepage_t codepage)
+      {
+        snapshot_point_t row = {};
+        row.latitude = raw_coordinate(point.coordinates.latitude);
+        row.longitude = raw_coordinate(point.coordinates.longitude);
+        row.file = index;
+        row.number = files[index].point_count++;
+        row.first_name = names(point.shortname, codepage);
+        row.name_count = uint16_t(texts.size() - row.first_name);
+        row.first_category = uint32_t(category_links.size());
+        for(const any_record_t& child : point.child_records)
+        {
+          if(auto reference = get_record_if<category_reference_t>(&child))
+          {
+            auto found = rows.find(reference->category_id);
+            if(found != rows.end())
+              category_links.push_back(found->second);
+          }
+          else if(auto alert = get_record_if<alert_t>(&child))
+          {
+            row.alert = 1;
+            row.alert_trigger = alert->trigger;
+            row.proximity = alert->proximity;
+            row.velocity = alert->velocity;
+          }
+        }
+        row.category_count = uint16_t(category_links.size() - row.first_category);
+        points.push_back(row);
+      });
+    }
+
+    // orders the points along the curve and returns the boxes of the spatial index, the points of
+    // the files come in handle order until then
+    std::vector<snapshot_block_t> spatial_index(void)
+    {
+      std::vector<uint64_t> keys(points.size());
+      for(size_t i = 0; i < points.size(); ++i)
+        keys[i] = hilbert_key(uint32_t(points[i].longitude) ^ 0x80000000, uint32_t(points[i].latitude) ^ 0x80000000);
+      std::vector<uint32_t> order(points.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+
+      std::vector<snapshot_point_t> sorted(points.size());
+      handles.resize(points.size());
+      for(size_t i = 0; i < order.size(); ++i)
+      {
+        sorted[i] = points[order[i]];
+        handles[order[i]] = uint32_t(i);
+      }
+      points.swap(sorted);
+
+      std::vector<size_t> levels = spatial_levels(points.size());
+      std::vector<snapshot_block_t> blocks(levels.back(), snapshot_block_t { INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN });
+      for(size_t i = 0; i < points.size(); ++i)
+        extend(blocks[i / snapshot_block_size], snapshot_block_t { points[i].latitude, points[i].longitude,
+                                                                   points[i].latitude, points[i].longitude });
+      for(size_t level = 1; level + 1 < levels.size(); ++level)
+        for(size_t i = levels[level - 1]; i < levels[level]; ++i)
+          extend(blocks[levels[level] + (i - levels[level - 1]) / snapshot_node_size], blocks[i]);
+      return blocks;
+    }
+  };
+
+  template<typename T>
+  static void append_section(std::vector<uint8_t>& image, snapshot_header_t& header, snapshot_section_id_t id, const T* data, size_t count)
+  {
+    image.resize((image.size() + 7) & ~size_t(7));
+    header.sections[id] = snapshot_section_t { image.size(), count * sizeof(T) };
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    image.insert(image.end(), bytes, bytes + count * sizeof(T));
+  }
+
+  std::vector<uint8_t> make_snapshot(const std::vector<const std::vector<any_record_t>*>& files)
+  {
+    if(!little_endian_host)
+      return {};
+
+    snapshot_builder_t builder;
+    for(const std::vector<any_record_t>* records : files)
+      builder.file(*records);
+    std::vector<snapshot_block_t> blocks = builder.spatial_index();
+
+    snapshot_header_t header = {};
+    std::memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+    header.version = snapshot_version;
+    header.header_size = sizeof(snapshot_header_t);
+
+    std::vector<uint8_t> image(sizeof(snapshot_header_t));
+    append_section(image, header, FileSection, builder.files.data(), builder.files.size());
+    append_section(image, header, PointSection, builder.points.data(), builder.points.size());
+    append_section(image, header, TextSection, builder.texts.data(), builder.texts.size());
+    append_section(image, header, StringSection, builder.strings.data(), builder.strings.size());
+    append_section(image, header, CategorySection, builder.categories.data(), builder.categories.size());
+    append_section(image, header, CategoryLinkSection, builder.category_links.data(), builder.category_links.size());
+    append_section(image, header, BlockSection, blocks.data(), blocks.size());
+    append_section(image, header, HandleSection, builder.handles.data(), builder.handles.size());
+
+    name_index_t index;
+    index.build(files);
+    const name_index_arrays_t& names = index.data();
+    append_section(image, header, NamePoolSection, names.pool.data, names.pool.size);
+    append_section(image, header, NameOffsetSection, names.name_offsets.data, names.name_offsets.size);
+    append_section(image, header, NameHandleOffsetSection, names.handle_offsets.data, names.handle_offsets.size);
+    append_section(image, header, NameHandleSection, names.handles.data, names.handles.size);
+    append_section(image, header, TrigramSection, names.trigrams.data, names.trigrams.size);
+    append_section(image, header, TrigramOffsetSection, names.trigram_offsets.data, names.trigram_offsets.size);
+    append_section(image, header, PostingSection, names.postings.data, names.postings.size);
+
+    header.image_size = image.size();
+    header.checksum = content_hash(image.data() + sizeof(header), image.size() - sizeof(header));
+    std::memcpy(image.data(), &header, sizeof(header));
+    return image;
+  }
+
+  // written beside the target and renamed over it, a reader never maps half a snapshot
+  bool write_snapshot(const std::filesystem::path& path, const std::vector<const std::vector<any_record_t>*>& files)
+  {
+    std::vector<uint8_t> image = make_snapshot(files);
+    if(image.empty())
+      return false;
+
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+      std::ofstream file(temporary, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+      file.write(reinterpret_cast<const char*>(image.data()), std::streamsize(image.size()));
+      if(!file.flush())
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+  }
+
+  const char* snapshot_error_name(snapshot_error_t error)
+  {
+    switch(error)
+    {
+      case SnapshotOk:         return "ok";
+      case SnapshotUnreadable: return "unreadable";
+      case NotASnapshot:       return "not a snapshot";
+      case UnsupportedVersion: return "unsupported version";
+      case SnapshotTruncated:  return "truncated";
+      case ChecksumMismatch:   return "checksum mismatch";
+    }
+    return "unknown error";
+  }
+
+  bool snapshot_t::fail(snapshot_error_t error)
+  {
+    *this = snapshot_t();
+    failure = error;
+    return false;
+  }
+
+  template<typename T>
+  bool snapshot_t::section(const uint8_t* image, const snapshot_header_t& header, snapshot_section_id_t id, array_t<T>& array)
+  {
+    const snapshot_section_t& section = header.sections[id];
+    if(section.offset % 8 ||
+       section.offset < header.header_size ||
+       section.offset > header.image_size ||
+       section.size > header.image_size - section.offset ||
+       section.size % sizeof(T))
+      return false;
+    array.data = reinterpret_cast<const T*>(image + section.offset);
+    array.size = size_t(section.size / sizeof(T));
+    return true;
+  }
+
+  bool snapshot_t::references(void) const
+  {
+    auto within = [](uint64_t first, uint64_t count, size_t size) { return first + count <= size; };
+
+    for(size_t i = 0; i < files.size; ++i)
+      if(!within(files.data[i].first_category, files.data[i].category_count, categories.size) ||
+         !within(files.data[i].first_handle, files.data[i].point_count, handles.size))
+        return false;
+    for(size_t i = 0; i < texts.size; ++i)
+      if(!within(texts.data[i].offset, texts.data[i].size, strings.size))
+        return false;
+    for(size_t i = 0; i < categories.size; ++i)
+      if(categories.data[i].file >= files.size ||
+         !within(categories.data[i].first_name, categories.data[i].name_count, texts.size))
+        return false;
+    for(size_t i = 0; i < category_links.size; ++i)
+      if(category_links.data[i] >= categories.size)
+        return false;
+    for(size_t i = 0; i < points.size; ++i)
+    {
+      const snapshot_point_t& point = points.data[i];
+      if(point.file >= files.size ||
+         !within(point.first_name, point.name_count, texts.size) ||
+         !within(point.first_category, point.category_count, category_links.size))
+        return false;
+    }
+    for(uint32_t file = 0; file < files.size; ++file)
+      for(uint32_t number = 0; number < files.data[file].point_count; ++number)
+      {
+        uint32_t row = handles.data[files.data[file].first_handle + number];
+        if(row >= points.size || points.data[row].file != file || points.data[row].number != number)
+          return false;
+      }
+    return name_references();
+  }
+
+  // offsets that rise up to the end of what they refer to
+  static bool offsets_within(const array_view_t<uint32_t>& offsets, size_t size)
+  {
+    for(size_t i = 1; i < offsets.size; ++i)
+      if(offsets[i] < offsets[i - 1])
+        return false;
+    return offsets.empty() || (offsets[0] == 0 && offsets[offsets.size - 1] == size);
+  }
+
+  bool snapshot_t::name_references(void) const
+  {
+    if(!offsets_within(name_arrays.name_offsets, name_arrays.pool.size) ||
+       !offsets_within(name_arrays.handle_offsets, name_arrays.handles.size) ||
+       !offsets_within(name_arrays.trigram_offsets, name_arrays.postings.size))
+      return false;
+    for(const point_handle_t& handle : name_arrays.handles)
+      if(row(handle) == UINT32_MAX)
+        return false;
+    size_t name_count = name_arrays.name_offsets.size - 1;
+    for(uint32_t id : name_arrays.postings)
+      if(id >= name_count)
+        return false;
+    return true;
+  }
+
+  bool snapshot_t::open(const std::filesystem::path& path, bool verify)
+  {
+    auto file = std::make_unique<mapped_file_t>(path);
+    if(!file->is_open())
+      return fail(SnapshotUnreadable);
+    if(!attach(reinterpret_cast<const uint8_t*>(file->data()), file->size(), verify))
+      return false;
+    mapping = std::move(file);
+    return true;
+  }
+
+  bool snapshot_t::attach(const uint8_t* data, size_t size, bool verify)
+  {
+    mapping.reset();
+    snapshot_header_t header;
+    if(size < sizeof(header) || std::memcmp(data, snapshot_magic, sizeof(snapshot_magic)))
+      return fail(NotASnapshot);
+    std::memcpy(&header, data, sizeof(header));
+
+    if(!little_endian_host ||
+       header.version != snapshot_version ||
+       header.header_size != sizeof(header))
+      return fail(UnsupportedVersion);
+
+    if(reinterpret_cast<uintptr_t>(data) % 8)
+      return fail(SnapshotUnreadable);
+
+    if(header.image_size != size ||
+       !section(data, header, FileSection, files) ||
+       !section(data, header, PointSection, points) ||
+       !section(data, header, TextSection, texts) ||
+       !section(data, header, StringSection, strings) ||
+       !section(data, header, CategorySection, categories) ||
+       !section(data, header, CategoryLinkSection, category_links) ||
+       !section(data, header, BlockSection, blocks) ||
+       !section(data, header, HandleSection, handles) ||
+       !section(data, header, NamePoolSection, name_arrays.pool) ||
+       !section(data, header, NameOffsetSection, name_arrays.name_offsets) ||
+       !section(data, header, NameHandleOffsetSection, name_arrays.handle_offsets) ||
+       !section(data, header, NameHandleSection, name_arrays.handles) ||
+       !section(data, header, TrigramSection, name_arrays.trigrams) ||
+       !section(data, header, TrigramOffsetSection, name_arrays.trigram_offsets) ||
+       !section(data, header, PostingSection, name_arrays.postings) ||
+       handles.size != points.size ||
+       name_arrays.name_offsets.empty() ||
+       name_arrays.handle_offsets.size != name_arrays.name_offsets.size ||
+       name_arrays.trigram_offsets.size != name_arrays.trigrams.size + 1)
+      return fail(SnapshotTruncated);
+
+    levels = spatial_levels(points.size);
+    if(blocks.size != levels.back())
+      return fail(SnapshotTruncated);
+
+    if(verify)
+    {
+      if(content_hash(data + sizeof(header), size - sizeof(header)) != header.checksum)
+        return fail(ChecksumMismatch);
+      if(!references())
+        return fail(SnapshotTruncated);
+    }
+
+    failure = SnapshotOk;
+    return true;
+  }
+
+  uint32_t snapshot_t::row(point_handle_t handle) const
+  {
+    if(handle.file >= files.size || handle.point >= files.data[handle.file].point_count)
+      return UINT32_MAX;
+    return handles.data[files.data[handle.file].first_handle + handle.point];
+  }
+
+  // the points below a box of a level that overlaps the query, in curve order
+  void snapshot_t::search(const snapshot_block_t& box, size_t level, size_t index, std::vector<uint32_t>& found) const
+  {
+    if(!overlaps(blocks.data[levels[level] + index], box))
+      return;
+
+    if(level)
+    {
+      size_t end = std::min((index + 1) * snapshot_node_size, levels[level] - levels[level - 1]);
+      for(size_t child = index * snapshot_node_size; child < end; ++child)
+        search(box, level - 1, child, found);
+      return;
+    }
+
+    size_t end = std::min((index + 1) * snapshot_block_size, points.size);
+    for(size_t i = index * snapshot_block_size; i < end; ++i)
+    {
+      const snapshot_point_t& point = points.data[i];
+      if(point.latitude >= box.latitude_min && point.latitude <= box.latitude_max &&
+         point.longitude >= box.longitude_min && point.longitude <= box.longitude_max)
+        found.push_back(uint32_t(i));
+    }
+  }
+
+  std::vector<uint32_t> snapshot_t::within(double latitude_min, double longitude_min, double latitude_max, double longitude_max) const
+  {
+    snapshot_block_t box = { raw_coordinate(latitude_min), raw_coordinate(longitude_min),
+                             raw_coordinate(latitude_max), raw_coordinate(longitude_max) };
+    std::vector<uint32_t> found;
+    if(levels.size() > 1) // the top level is a single box
+      search(box, levels.size() - 2, 0, found);
+    return found;
+  }
+} // namespace garmin
@@ -0,0 +1,194 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "mapped_file.h"
+#include "name_index.h"
+
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+// Flat image of the points of parsed files, so a restart maps a file instead of parsing the GPI
+// files again. All references are positions within the image and all fields are little endian
+// with natural alignment, so the image is used in place wherever it is mapped. Text is UTF-8,
+// category references are resolved to category rows and the points are stored along a Hilbert
+// curve. The spatial index is a packed tree of bounding boxes, one per block of points on the lowest
+// level and one per snapshot_node_size boxes of the level below above it. The handle section maps the
+// point handles of name_index_t to rows, and the arrays of the name index are stored as they are, so
+// name_index_t::attach() searches the image in place.
+
+namespace garmin
+{
+  constexpr uint32_t snapshot_version = 4;
+  constexpr uint32_t snapshot_block_size = 64; // points per bounding box of the lowest level
+  constexpr uint32_t snapshot_node_size = 64;  // boxes per bounding box of the levels above
+
+  enum snapshot_section_id_t : uint8_t
+  {
+    FileSection = 0,
+    PointSection,
+    TextSection,
+    StringSection,
+    CategorySection,
+    CategoryLinkSection,
+    BlockSection,         // the levels of the spatial index, lowest first, the top level has one box
+    HandleSection,
+    NamePoolSection,      // the sections of name_index_arrays_t
+    NameOffsetSection,
+    NameHandleOffsetSection,
+    NameHandleSection,
+    TrigramSection,
+    TrigramOffsetSection,
+    PostingSection,
+
+    SnapshotSectionCount,
+  };
+
+  struct snapshot_section_t
+  {
+    uint64_t offset; // from the start of the image, a multiple of 8
+    uint64_t size;   // bytes
+  };
+
+  struct snapshot_header_t
+  {
+    char magic[8];         // "GPISNAP\0"
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t image_size;
+    uint64_t checksum;     // content_hash of everything after the header
+    snapshot_section_t sections[SnapshotSectionCount];
+  };
+  static_assert(sizeof(snapshot_header_t) == 272, "packing failure");
+  static_assert(sizeof(point_handle_t) == 8, "packing failure");
+
+  struct snapshot_file_t
+  {
+    uint32_t point_count;
+    uint32_t first_handle; // into the handle section, which holds the rows of the points by number
+    uint32_t first_category;
+    uint32_t category_count;
+    uint16_t codepage;     // of the GPI file, the text of the image is UTF-8
+    uint16_t reserved;
+  };
+  static_assert(sizeof(snapshot_file_t) == 20, "packing failure");
+
+  struct snapshot_text_t
+  {
+    uint32_t offset;       // into the string section
+    uint32_t size;
+    uint16_t locale;
+    uint16_t reserved;
+  };
+  static_assert(sizeof(snapshot_text_t) == 12, "packing failure");
+
+  struct snapshot_category_t
+  {
+    uint32_t file;
+    uint32_t first_name;   // into the text section
+    uint16_t name_count;
+    uint16_t category_id;  // as in the GPI file
+  };
+  static_assert(sizeof(snapshot_category_t) == 12, "packing failure");
+
+  struct snapshot_point_t
+  {
+    int32_t latitude;      // degrees = value * 360 / 2^32
+    int32_t longitude;
+    uint32_t file;         // with number the point handle of name_index_t and dedup
+    uint32_t number;
+    uint32_t first_name;   // into the text section
+    uint32_t first_category; // into the category link section
+    uint16_t name_count;
+    uint16_t category_count;
+    uint16_t proximity;    // meters, alert records only
+    uint16_t velocity;     // 100x meters / second
+    uint8_t alert;         // 1 for points with an alert record
+    uint8_t alert_trigger;
+    uint8_t reserved[2];
+  };
+  static_assert(sizeof(snapshot_point_t) == 36, "packing failure");
+
+  struct snapshot_block_t
+  {
+    int32_t latitude_min;
+    int32_t longitude_min;
+    int32_t latitude_max;
+    int32_t longitude_max;
+  };
+  static_assert(sizeof(snapshot_block_t) == 16, "packing failure");
+
+  // builds the image of the files, points are numbered as by visit_points
+  std::vector<uint8_t> make_snapshot(const std::vector<const std::vector<any_record_t>*>& files);
+  bool write_snapshot(const std::filesystem::path& path, const std::vector<const std::vector<any_record_t>*>& files);
+
+  enum snapshot_error_t : uint8_t
+  {
+    SnapshotOk = 0,
+    SnapshotUnreadable,
+    NotASnapshot,
+    UnsupportedVersion, // also for big endian hosts
+    SnapshotTruncated,  // sizes and positions that do not fit the image
+    ChecksumMismatch,
+  };
+
+  const char* snapshot_error_name(snapshot_error_t error);
+
+  class snapshot_t
+  {
+  public:
+    // Checking the checksum and the references reads the whole image once, without it only the
+    // header and the section table are checked and the image has to be trusted.
+    bool open(const std::filesystem::path& path, bool verify = true);
+    bool attach(const uint8_t* data, size_t size, bool verify = true); // data has to stay valid
+    snapshot_error_t error(void) const { return failure; }
+
+    size_t file_count(void) const { return files.size; }
+    size_t point_count(void) const { return points.size; }
+    size_t category_count(void) const { return categories.size; }
+
+    const snapshot_file_t& file(uint32_t index) const { return files.data[index]; }
+    const snapshot_point_t& point(uint32_t index) const { return points.data[index]; }
+    const snapshot_category_t& category(uint32_t index) const { return categories.data[index]; }
+
+    const snapshot_text_t* names(const snapshot_point_t& point) const { return texts.data + point.first_name; }
+    const snapshot_text_t* names(const snapshot_category_t& category) const { return texts.data + category.first_name; }
+    const uint32_t* categories_of(const snapshot_point_t& point) const { return category_links.data + point.first_category; }
+    std::string_view text(const snapshot_text_t& text) const { return std::string_view(strings.data + text.offset, text.size); }
+
+    const name_index_arrays_t& name_index_arrays(void) const { return name_arrays; }
+
+    // row of the point of a handle, UINT32_MAX when there is none
+    uint32_t row(point_handle_t handle) const;
+
+    // points within the box, in curve order
+    std::vector<uint32_t> within(double latitude_min, double longitude_min, double latitude_max, double longitude_max) const;
+
+  private:
+    template<typename T>
+    using array_t = array_view_t<T>;
+
+    template<typename T>
+    bool section(const uint8_t* image, const snapshot_header_t& header, snapshot_section_id_t id, array_t<T>& array);
+    bool references(void) const;
+    bool name_references(void) const;
+    bool fail(snapshot_error_t error);
+    void search(const snapshot_block_t& box, size_t level, size_t index, std::vector<uint32_t>& found) const;
+
+    std::unique_ptr<mapped_file_t> mapping;
+    snapshot_error_t failure = SnapshotUnreadable;
+
+    array_t<snapshot_file_t> files;
+    array_t<snapshot_point_t> points;
+    array_t<snapshot_text_t> texts;
+    array_t<char> strings;
+    array_t<snapshot_category_t> categories;
+    array_t<uint32_t> category_links;
+    array_t<snapshot_block_t> blocks;
+    array_t<uint32_t> handles;
+    name_index_arrays_t name_arrays;
+    std::vector<size_t> levels; // first box of each level of the spatial index, one more for the end
+  };
+} // namespace garmin
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,170 @@
+#include "spatial_order.h"
+#include "record_dispatch.h"
+#include "wire_types.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace garmin
+{
+  // spreads the bits of value to the even bit positions
+  static inline uint64_t spread_bits(uint32_t value)
+  {
+    uint64_t bits = value;
+    bits = (bits | (bits << 16)) & 0x0000FFFF0000FFFF;
+    bits = (bits | (bits <<  8)) & 0x00FF00FF00FF00FF;
+    bits = (bits | (bits <<  4)) & 0x0F0F0F0F0F0F0F0F;
+    bits = (bits | (bits <<  2)) & 0x3333333333333333;
+    bits = (bits | (bits <<  1)) & 0x5555555555555555;
+    return bits;
+  }
+
+  uint64_t morton_key(uint32_t x, uint32_t y)
+  {
+    return (spread_bits(y) << 1) | spread_bits(x);
+  }
+
+  // The Hilbert curve is walked four levels at a time. A state is the orientation of the curve
+  // inside the current square: bit1 swaps x and y, bit0 mirrors both. An entry of the table holds
+  // the 8 key bits of a pair of 4 bit nibbles and the state for the next nibbles.
+  struct hilbert_table_t
+  {
+    std::array<std::array<uint16_t, 256>, 4> entries; // key bits << 2 | next state
+
+    hilbert_table_t(void)
+    {
+      for(uint32_t state = 0; state < 4; ++state)
+        for(uint32_t nibbles = 0; nibbles < 256; ++nibbles)
+        {
+          uint32_t next = state;
+          uint32_t key = 0;
+          for(int bit = 3; bit >= 0; --bit)
+          {
+            uint32_t x = (nibbles >> (4 + bit)) & 1;
+            uint32_t y = (nibbles >> bit) & 1;
+            if(next & 2)
+              std::swap(x, y);
+            x ^= next & 1;
+            y ^= next & 1;
+            key = (key << 2) | ((3 * x) ^ y);
+            if(!y)
+              next = (next ^ 2) ^ x;
+          }
+          entries[state][nibbles] = uint16_t((key << 2) | next);
+        }
+    }
+  };
+
+  static const hilbert_table_t hilbert_table;
+
+  uint64_t hilbert_key(uint32_t x, uint32_t y)
+  {
+    uint64_t key = 0;
+    uint32_t state = 0;
+    for(int shift = 28; shift >= 0; shift -= 4)
+    {
+      uint32_t nibbles = (((x >> shift) & 0xF) << 4) | ((y >> shift) & 0xF);
+      uint32_t entry = hilbert_table.entries[state][nibbles];
+      key = (key << 8) | (entry >> 2);
+      state = entry & 3;
+    }
+    return key;
+  }
+
+  // file values are signed, the offset keeps their order as unsigned values
+  static inline uint32_t curve_value(double degrees)
+  {
+    return wire::coord32_value(degrees) ^ 0x80000000;
+  }
+
+  uint64_t spatial_key(spatial_order_t order, double latitude, double longitude)
+  {
+    uint64_t key = 0;
+    spatial_keys(order, &latitude, &longitude, 1, &key);
+    return key;
+  }
+
+  void spatial_keys(spatial_order_t order, const double* latitudes, const double* longitudes, size_t count, uint64_t* keys)
+  {
+    switch(order)
+    {
+      case InputOrder:
+        for(size_t i = 0; i < count; ++i)
+          keys[i] = i;
+        break;
+      case MortonOrder:
+        for(size_t i = 0; i < count; ++i)
+          keys[i] = morton_key(curve_value(longitudes[i]), curve_value(latitudes[i]));
+        break;
+      case HilbertOrder:
+        for(size_t i = 0; i < count; ++i)
+          keys[i] = hilbert_key(curve_value(longitudes[i]), curve_value(latitudes[i]));
+        break;
+    }
+  }
+
+  static inline uint64_t area_key(spatial_order_t order, const area_t& area)
+  {
+    return spatial_key(order,
+                       (double(area.coordinates_min.latitude) + double(area.coordinates_max.latitude)) / 2,
+                       (double(area.coordinates_min.longitude) + double(area.coordinates_max.longitude)) / 2);
+  }
+
+  // stable sort of [first, last) by the keys of the records, moved instead of swapped
+  template<typename T, typename Key>
+  static void sort_by_key(typename std::vector<T>::iterator first, typename std::vector<T>::iterator last, Key key)
+  {
+    std::vector<std::pair<uint64_t, size_t>> keys;
+    keys.reserve(size_t(last - first));
+    for(auto pos = first; pos != last; ++pos)
+      keys.emplace_back(key(*pos), size_t(pos - first));
+    if(std::is_sorted(keys.begin(), keys.end()))
+      return;
+    std::stable_sort(keys.begin(), keys.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::vector<T> sorted;
+    sorted.reserve(keys.size());
+    for(const auto& entry : keys)
+      sorted.push_back(std::move(first[std::ptrdiff_t(entry.second)]));
+    std::move(sorted.begin(), sorted.end(), first);
+  }
+
+  void spatial_sort(poi_group_t& group, spatial_order_t order)
+  {
+    if(order == InputOrder)
+      return;
+    for(area_t& area : group.areas)
+      spatial_sort(area, order);
+    sort_by_key<area_t>(group.areas.begin(), group.areas.end(),
+                        [order](const area_t& area) { return area_key(order, area); });
+  }
+
+  void spatial_sort(area_t& area, spatial_order_t order)
+  {
+    if(order == InputOrder)
+      return;
+
+    // runs of areas or of points are sorted, the records around them keep their place
+    auto& records = area.child_records;
+    for(auto first = records.begin(); first != records.end();)
+    {
+      record_id_t type = record_header(*first).type;
+      auto last = std::find_if(first, records.end(), [type](const any_record_t& record) { return record_header(record).type != type; });
+      if(type == Area)
+      {
+        for(auto pos = first; pos != last; ++pos)
+          spatial_sort(get_record<area_t>(*pos), order);
+        sort_by_key<any_record_t>(first, last,
+                                  [order](const any_record_t& record) { return area_key(order, get_record<area_t>(record)); });
+      }
+      else if(type == Point)
+        sort_by_key<any_record_t>(first, last, [order](const any_record_t& record)
+        {
+          const point_t& point = get_record<point_t>(record);
+          return spatial_key(order, point.coordinates.latitude, point.coordinates.longitude);
+        });
+      first = last;
+    }
+  }
+} // namespace garmin
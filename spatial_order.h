@@ -0,0 +1,35 @@
+#ifndef SPATIAL_ORDER_H
+#define SPATIAL_ORDER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Keys along space filling curves, so points near each other on the map end up near each other in
+// a file. Coordinates enter as their 32 bit file values, longitude as x and latitude as y.
+
+namespace garmin
+{
+  enum spatial_order_t : uint8_t
+  {
+    InputOrder = 0,
+    MortonOrder,  // Z curve, bits of x and y interleaved
+    HilbertOrder, // no jumps between neighboring keys, better locality
+  };
+
+  uint64_t morton_key(uint32_t x, uint32_t y);
+  uint64_t hilbert_key(uint32_t x, uint32_t y);
+
+  uint64_t spatial_key(spatial_order_t order, double latitude, double longitude);
+  void spatial_keys(spatial_order_t order, const double* latitudes, const double* longitudes, size_t count, uint64_t* keys);
+
+  struct area_t;
+  struct poi_group_t;
+
+  // Reorders a parsed or edited tree the way the builders write it: sibling areas by the keys of their
+  // centers and the points of an area by the keys of their coordinates. Records of other types stay
+  // where they are and records with equal keys keep their order.
+  void spatial_sort(poi_group_t& group, spatial_order_t order);
+  void spatial_sort(area_t& area, spatial_order_t order);
+} // namespace garmin
+
+#endif // SPATIAL_ORDER_H
@@ -0,0 +1,334 @@
+#include "sqlite_export.h"
+#include "codepage.h"
+#include "record_dispatch.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace garmin
+{
+  static constexpr const char* schema =
+      "CREATE TABLE IF NOT EXISTS files ("
+      " file_id INTEGER PRIMARY KEY, path TEXT, name TEXT, version TEXT, codepage INTEGER);"
+      "CREATE TABLE IF NOT EXISTS categories ("
+      " file_id INTEGER NOT NULL, category_id INTEGER NOT NULL, locale TEXT NOT NULL, name TEXT,"
+      " PRIMARY KEY (file_id, category_id, locale)) WITHOUT ROWID;"
+      "CREATE TABLE IF NOT EXISTS points ("
+      " point_id INTEGER PRIMARY KEY, file_id INTEGER NOT NULL, category_id INTEGER,"
+      " latitude REAL NOT NULL, longitude REAL NOT NULL, flags INTEGER NOT NULL);"
+      "CREATE TABLE IF NOT EXISTS point_names ("
+      " point_id INTEGER NOT NULL, locale TEXT NOT NULL, name TEXT,"
+      " PRIMARY KEY (point_id, locale)) WITHOUT ROWID;"
+      "CREATE TABLE IF NOT EXISTS alerts ("
+      " point_id INTEGER PRIMARY KEY, proximity INTEGER, velocity INTEGER," // meters, 100x meters / second
+      " enabled INTEGER, trigger INTEGER, source INTEGER, sound_id INTEGER);"
+      "CREATE TABLE IF NOT EXISTS addresses ("
+      " point_id INTEGER NOT NULL, locale TEXT, city TEXT, country TEXT, state TEXT,"
+      " street_name TEXT, postal_code TEXT, building_id TEXT);"
+      "CREATE INDEX IF NOT EXISTS addresses_point ON addresses (point_id);"
+      "CREATE TABLE IF NOT EXISTS contacts ("
+      " point_id INTEGER PRIMARY KEY, phone1 TEXT, phone2 TEXT, fax TEXT, email TEXT, url TEXT);"
+      "CREATE VIRTUAL TABLE IF NOT EXISTS point_locations USING rtree("
+      " point_id, min_latitude, max_latitude, min_longitude, max_longitude);";
+
+  static std::string locale_name(uint16_t locale)
+  {
+    return std::string { char(locale >> 8), char(locale & 0xFF) };
+  }
+
+  // text in the codepage of the file bound as UTF-8, converted text is copied by SQLite
+  static void bind_text(sqlite3_stmt* statement, int column, const vector16_t& text, codepage_t codepage, std::string& scratch)
+  {
+    if(codepage == Unicode)
+    {
+      sqlite3_bind_text(statement, column, reinterpret_cast<const char*>(text.data()), int(text.size()), SQLITE_STATIC);
+      return;
+    }
+    scratch.clear();
+    to_utf8(codepage, text.data(), text.size(), scratch);
+    sqlite3_bind_text(statement, column, scratch.data(), int(scratch.size()), SQLITE_TRANSIENT);
+  }
+
+  template<typename type>
+  static void bind_text(sqlite3_stmt* statement, int column, const std::optional<type>& text, codepage_t codepage, std::string& scratch)
+  {
+    if(text)
+      bind_text(statement, column, *text, codepage, scratch);
+    else
+      sqlite3_bind_null(statement, column);
+  }
+
+  // text of a localized field in a locale, when it has one
+  static void bind_text(sqlite3_stmt* statement, int column, const std::optional<lstring_t>& text, uint16_t locale,
+                        codepage_t codepage, std::string& scratch)
+  {
+    auto pos = text ? text->find(locale) : lstring_t::const_iterator();
+    if(text && pos != text->end())
+      bind_text(statement, column, pos->second, codepage, scratch);
+    else
+      sqlite3_bind_null(statement, column);
+  }
+
+  sqlite_exporter_t::sqlite_exporter_t(sqlite3* db, uint32_t batch_size)
+    : db(db),
+      batch_size(batch_size ? batch_size : 1),
+      batch_rows(0),
+      in_transaction(false),
+      failed(false),
+      insert_file(nullptr),
+      insert_category(nullptr),
+      insert_point(nullptr),
+      insert_point_name(nullptr),
+      insert_alert(nullptr),
+      insert_address(nullptr),
+      insert_contact(nullptr),
+      insert_location(nullptr),
+      file_id(0),
+      codepage(Unicode)
+  {
+    assert(db != nullptr);
+    // WAL keeps commits cheap, a crash loses at most the batch in progress
+    execute("PRAGMA journal_mode = WAL;") &&
+    execute("PRAGMA synchronous = NORMAL;") &&
+    execute("PRAGMA cache_size = -65536;") &&
+    execute(schema) &&
+    prepare(insert_file, "INSERT INTO files (path, name, version, codepage) VALUES (?, ?, ?, ?);") &&
+    prepare(insert_category, "INSERT OR REPLACE INTO categories VALUES (?, ?, ?, ?);") &&
+    prepare(insert_point, "INSERT INTO points (file_id, category_id, latitude, longitude, flags) VALUES (?, ?, ?, ?, ?);") &&
+    prepare(insert_point_name, "INSERT OR REPLACE INTO point_names VALUES (?, ?, ?);") &&
+    prepare(insert_alert, "INSERT OR REPLACE INTO alerts VALUES (?, ?, ?, ?, ?, ?, ?);") &&
+    prepare(insert_address, "INSERT INTO addresses VALUES (?, ?, ?, ?, ?, ?, ?, ?);") &&
+    prepare(insert_contact, "INSERT OR REPLACE INTO contacts VALUES (?, ?, ?, ?, ?, ?);") &&
+    prepare(insert_location, "INSERT INTO point_locations VALUES (?, ?, ?, ?, ?);");
+  }
+
+  sqlite_exporter_t::~sqlite_exporter_t(void)
+  {
+    commit();
+    for(sqlite3_stmt* statement : { insert_file, insert_category, insert_point, insert_point_name,
+                                    insert_alert, insert_address, insert_contact, insert_location })
+      sqlite3_finalize(statement);
+  }
+
+  bool sqlite_exporter_t::fail(void)
+  {
+    if(!failed)
+      message = sqlite3_errmsg(db);
+    failed = true;
+    return false;
+  }
+
+  bool sqlite_exporter_t::execute(const char* sql)
+  {
+    return sqlite3_exec(db, sql, nullptr, nullptr, nullptr) == SQLITE_OK || fail();
+  }
+
+  bool sqlite_exporter_t::prepare(sqlite3_stmt*& statement, const char* sql)
+  {
+    return sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &statement, nullptr) == SQLITE_OK || fail();
+  }
+
+  bool sqlite_exporter_t::step(sqlite3_stmt* statement)
+  {
+    int result = sqlite3_step(statement);
+    sqlite3_reset(statement);
+    return result == SQLITE_DONE || fail();
+  }
+
+  bool sqlite_exporter_t::commit(void)
+  {
+    if(!in_transaction)
+      return !failed;
+    in_transaction = false;
+    batch_rows = 0;
+    return execute("COMMIT;");
+  }
+
+  bool sqlite_exporter_t::export_file(std::istream& is, const std::string& file_path)
+  {
+    if(failed)
+      return false;
+
+    path = file_path;
+    version.clear();
+    name.clear();
+    file_id = 0;
+    codepage = Unicode;
+    point.reset();
+
+    // the rows of a file, including its row in files, are kept or dropped together
+    if(!in_transaction && execute("BEGIN;"))
+      in_transaction = true;
+    if(!execute("SAVEPOINT file;"))
+      return false;
+
+    event_parser_t parser(is, *this);
+    while(!failed && parser.step());
+    bool good = !failed && !is.fail();
+    if(!good)
+      execute("ROLLBACK TO file;");
+    execute("RELEASE file;");
+
+    if(good && batch_rows >= batch_size)
+      commit();
+    return good && !failed;
+  }
+
+  void sqlite_exporter_t::record_data(const garmin_header_t& data, uint32_t)
+  {
+    version.assign(data.version, sizeof(data.version));
+    name.assign(std::begin(data.name), std::end(data.name));
+  }
+
+  void sqlite_exporter_t::record_data(const poi_header_t& data, uint32_t)
+  {
+    codepage = data.codepage;
+    sqlite3_bind_text(insert_file, 1, path.data(), int(path.size()), SQLITE_STATIC);
+    sqlite3_bind_text(insert_file, 2, name.data(), int(name.size()), SQLITE_STATIC);
+    sqlite3_bind_text(insert_file, 3, version.data(), int(version.size()), SQLITE_STATIC);
+    sqlite3_bind_int(insert_file, 4, data.codepage);
+    if(step(insert_file))
+      file_id = sqlite3_last_insert_rowid(db);
+  }
+
+  void sqlite_exporter_t::record_data(const category_t& data, uint32_t)
+  {
+    for(const auto& pair : data.name)
+    {
+      std::string locale = locale_name(pair.first);
+      sqlite3_bind_int64(insert_category, 1, file_id);
+      sqlite3_bind_int(insert_category, 2, data.category_id);
+      sqlite3_bind_text(insert_category, 3, locale.data(), int(locale.size()), SQLITE_STATIC);
+      bind_text(insert_category, 4, pair.second, codepage, scratch);
+      step(insert_category);
+    }
+  }
+
+  bool sqlite_exporter_t::enter_record(const record_header_t& header, uint32_t)
+  {
+    // media is not exported, skipping it saves decoding it
+    return header.type != Bitmap && header.type != ImageFile && header.type != AudioFile;
+  }
+
+  // the records of a point are kept until it is left, they are taken over instead of copied
+  void sqlite_exporter_t::record_content(any_record_t& data, uint32_t depth)
+  {
+    if(point_t* record = get_record_if<point_t>(&data))
+    {
+      point.emplace(std::move(*record));
+      category_id.reset();
+      alert.reset();
+      address.reset();
+      contact.reset();
+    }
+    else if(alert_t* record = get_record_if<alert_t>(&data))
+      alert.emplace(std::move(*record));
+    else if(address_t* record = get_record_if<address_t>(&data))
+      address.emplace(std::move(*record));
+    else if(contact_t* record = get_record_if<contact_t>(&data))
+      contact.emplace(std::move(*record));
+    else
+      record_handler_t::record_content(data, depth);
+  }
+
+  void sqlite_exporter_t::record_data(const category_reference_t& data, uint32_t)
+  {
+    category_id = data.category_id;
+  }
+
+  void sqlite_exporter_t::leave_record(const record_header_t& header, uint32_t)
+  {
+    if(header.type == Point && point)
+    {
+      write_point();
+      point.reset();
+    }
+  }
+
+  void sqlite_exporter_t::write_point(void)
+  {
+    double latitude = point->coordinates.latitude;
+    double longitude = point->coordinates.longitude;
+    sqlite3_bind_int64(insert_point, 1, file_id);
+    if(category_id)
+      sqlite3_bind_int(insert_point, 2, *category_id);
+    else
+      sqlite3_bind_null(insert_point, 2);
+    sqlite3_bind_double(insert_point, 3, latitude);
+    sqlite3_bind_double(insert_point, 4, longitude);
+    sqlite3_bind_int(insert_point, 5, point->flags.byte0 | (point->flags.byte1 << 8));
+    if(!step(insert_point))
+      return;
+    sqlite3_int64 point_id = sqlite3_last_insert_rowid(db);
+
+    sqlite3_bind_int64(insert_location, 1, point_id);
+    sqlite3_bind_double(insert_location, 2, latitude);
+    sqlite3_bind_double(insert_location, 3, latitude);
+    sqlite3_bind_double(insert_location, 4, longitude);
+    sqlite3_bind_double(insert_location, 5, longitude);
+    step(insert_location);
+
+    for(const auto& pair : point->shortname)
+    {
+      std::string locale = locale_name(pair.first);
+      sqlite3_bind_int64(insert_point_name, 1, point_id);
+      sqlite3_bind_text(insert_point_name, 2, locale.data(), int(locale.size()), SQLITE_STATIC);
+      bind_text(insert_point_name, 3, pair.second, codepage, scratch);
+      step(insert_point_name);
+    }
+
+    if(alert)
+    {
+      sqlite3_bind_int64(insert_alert, 1, point_id);
+      sqlite3_bind_int(insert_alert, 2, alert->proximity);
+      sqlite3_bind_int(insert_alert, 3, alert->velocity);
+      sqlite3_bind_int(insert_alert, 4, alert->enabled);
+      sqlite3_bind_int(insert_alert, 5, alert->trigger);
+      sqlite3_bind_int(insert_alert, 6, alert->source);
+      sqlite3_bind_int(insert_alert, 7, alert->symbol_id);
+      step(insert_alert);
+    }
+
+    if(address)
+    {
+      // one row per locale of the localized fields, the others repeat on every row
+      std::vector<uint16_t> locales;
+      for(const auto* field : { &address->city, &address->country, &address->state, &address->street_name })
+        if(*field)
+          for(const auto& pair : **field)
+            if(std::find(std::begin(locales), std::end(locales), pair.first) == std::end(locales))
+              locales.push_back(pair.first);
+      if(locales.empty())
+        locales.push_back(0);
+
+      for(uint16_t locale : locales)
+      {
+        std::string locale_text = locale_name(locale);
+        sqlite3_bind_int64(insert_address, 1, point_id);
+        if(locale)
+          sqlite3_bind_text(insert_address, 2, locale_text.data(), int(locale_text.size()), SQLITE_STATIC);
+        else
+          sqlite3_bind_null(insert_address, 2);
+        bind_text(insert_address, 3, address->city, locale, codepage, scratch);
+        bind_text(insert_address, 4, address->country, locale, codepage, scratch);
+        bind_text(insert_address, 5, address->state, locale, codepage, scratch);
+        bind_text(insert_address, 6, address->street_name, locale, codepage, scratch);
+        bind_text(insert_address, 7, address->postal_code, codepage, scratch);
+        bind_text(insert_address, 8, address->building_id, codepage, scratch);
+        step(insert_address);
+      }
+    }
+
+    if(contact)
+    {
+      sqlite3_bind_int64(insert_contact, 1, point_id);
+      bind_text(insert_contact, 2, contact->phone1, codepage, scratch);
+      bind_text(insert_contact, 3, contact->phone2, codepage, scratch);
+      bind_text(insert_contact, 4, contact->fax, codepage, scratch);
+      bind_text(insert_contact, 5, contact->email, codepage, scratch);
+      bind_text(insert_contact, 6, contact->URL, codepage, scratch);
+      step(insert_contact);
+    }
+    ++batch_rows;
+  }
+} // namespace garmin
@@ -0,0 +1,89 @@
+#ifndef SQLITE_EXPORT_H
+#define SQLITE_EXPORT_H
+
+#include "event_parser.h"
+
+#include <string>
+
+#include <sqlite3.h>
+
+// Streams the points of GPI files into a normalized SQLite schema. Records are written as they are
+// parsed, so the size of the input is not limited by memory.
+//
+//   files           (file_id, path, name, version, codepage)
+//   categories      (file_id, category_id, locale, name)
+//   points          (point_id, file_id, category_id, latitude, longitude, flags)
+//   point_names     (point_id, locale, name)
+//   alerts          (point_id, proximity, velocity, enabled, trigger, source, sound_id)
+//   addresses       (point_id, locale, city, country, state, street_name, postal_code, building_id)
+//   contacts        (point_id, phone1, phone2, fax, email, url)
+//   point_locations R*Tree (point_id, min_latitude, max_latitude, min_longitude, max_longitude)
+//
+// Locales are the two letter keys of localized strings. Text is stored as UTF-8, files keeps the
+// codepage the text had in the GPI file.
+
+namespace garmin
+{
+  class sqlite_exporter_t : private record_handler_t
+  {
+  public:
+    // Creates the schema when missing. Files are committed together in one transaction once they
+    // hold batch_size points, so a batch may be larger by the points of its last file.
+    sqlite_exporter_t(sqlite3* db, uint32_t batch_size = 100000);
+    ~sqlite_exporter_t(void);
+
+    // returns false when the file could not be parsed or the database refused a row, none of the
+    // rows of the file are kept then
+    bool export_file(std::istream& is, const std::string& path);
+    bool commit(void);
+
+    bool good(void) const { return !failed; }
+    const std::string& error(void) const { return message; }
+
+  private:
+    bool enter_record(const record_header_t& header, uint32_t depth);
+    void record_content(any_record_t& data, uint32_t depth);
+    void record_data(const garmin_header_t& data, uint32_t depth);
+    void record_data(const poi_header_t& data, uint32_t depth);
+    void record_data(const category_t& data, uint32_t depth);
+    void record_data(const category_reference_t& data, uint32_t depth);
+    void leave_record(const record_header_t& header, uint32_t depth);
+
+    bool execute(const char* sql);
+    bool prepare(sqlite3_stmt*& statement, const char* sql);
+    bool step(sqlite3_stmt* statement);
+    bool fail(void);
+    void write_point(void);
+
+    sqlite3* db;
+    uint32_t batch_size;
+    uint32_t batch_rows;
+    bool in_transaction;
+    bool failed;
+    std::string message;
+
+    sqlite3_stmt* insert_file;
+    sqlite3_stmt* insert_category;
+    sqlite3_stmt* insert_point;
+    sqlite3_stmt* insert_point_name;
+    sqlite3_stmt* insert_alert;
+    sqlite3_stmt* insert_address;
+    sqlite3_stmt* insert_contact;
+    sqlite3_stmt* insert_location;
+
+    // state of the file being exported
+    std::string path;
+    std::string version;
+    std::string name;
+    sqlite3_int64 file_id;
+    codepage_t codepage;
+    std::string scratch; // text converted to UTF-8
+    std::optional<point_t> point; // written with its subordinated records when it is left
+    std::optional<uint16_t> category_id;
+    std::optional<alert_t> alert;
+    std::optional<address_t> address;
+    std::optional<contact_t> contact;
+  };
+} // namespace garmin
+
+#endif // SQLITE_EXPORT_H
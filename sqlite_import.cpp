@@ -0,0 +1,319 @@
+#include "sqlite_import.h"
+#include "codepage.h"
+#include "record_dispatch.h"
+#include "record_writer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <map>
+
+namespace garmin
+{
+  static uint16_t locale_key(sqlite3_stmt* statement, int column)
+  {
+    const unsigned char* text = sqlite3_column_text(statement, column);
+    return text && text[0] && text[1] ? uint16_t((text[0] << 8) | text[1]) : 0;
+  }
+
+  // stored UTF-8 text converted to codepage
+  static void column_text(sqlite3_stmt* statement, int column, codepage_t codepage, vector16_t& text)
+  {
+    const char* data = static_cast<const char*>(sqlite3_column_blob(statement, column));
+    from_utf8(codepage, std::string_view(data, size_t(sqlite3_column_bytes(statement, column))), text);
+  }
+
+  template<typename type>
+  static void column_text(sqlite3_stmt* statement, int column, codepage_t codepage, std::optional<type>& text)
+  {
+    if(sqlite3_column_type(statement, column) != SQLITE_NULL)
+      column_text(statement, column, codepage, text.emplace());
+  }
+
+  static void column_text(sqlite3_stmt* statement, int column, codepage_t codepage, uint16_t locale, std::optional<lstring_t>& text)
+  {
+    if(locale && sqlite3_column_type(statement, column) != SQLITE_NULL)
+    {
+      if(!text)
+        text.emplace();
+      column_text(statement, column, codepage, (*text)[locale]);
+    }
+  }
+
+  struct sqlite_builder_t : area_builder_t
+  {
+    sqlite_builder_t(sqlite3* db, std::ostream& os, const sqlite_build_options_t& options)
+      : area_builder_t(options.area_points, max_area_depth, options.order),
+        db(db),
+        writer(os),
+        options(options),
+        failed(false),
+        region_stats(nullptr),
+        region_points(nullptr),
+        point_names(nullptr),
+        point_alert(nullptr),
+        point_address(nullptr),
+        point_contact(nullptr),
+        used_categories(nullptr),
+        categories(nullptr),
+        current()
+    {
+      // regions partition the points by their (rounded) R*Tree coordinates, so every point is in one of them
+      const std::string region =
+          " FROM points WHERE point_id IN (SELECT point_id FROM point_locations"
+          " WHERE min_latitude >= ?1 AND min_latitude < ?2 AND min_longitude >= ?3 AND min_longitude < ?4)"
+          " AND (" + options.condition + ")";
+      prepare(region_stats, "SELECT count(*), min(latitude), max(latitude), min(longitude), max(longitude)" + region) &&
+      prepare(region_points, "SELECT point_id, file_id, category_id, latitude, longitude, flags" + region + " ORDER BY point_id") &&
+      prepare(point_names, "SELECT locale, name FROM point_names WHERE point_id = ?") &&
+      prepare(point_alert, "SELECT proximity, velocity, enabled, trigger, source, sound_id FROM alerts WHERE point_id = ?") &&
+      prepare(point_address, "SELECT locale, city, country, state, street_name, postal_code, building_id FROM addresses WHERE point_id = ?") &&
+      prepare(point_contact, "SELECT phone1, phone2, fax, email, url FROM contacts WHERE point_id = ?") &&
+      prepare(used_categories, "SELECT DISTINCT file_id, category_id FROM points"
+                               " WHERE category_id IS NOT NULL AND (" + options.condition + ") ORDER BY file_id, category_id") &&
+      prepare(categories, "SELECT file_id, category_id, locale, name FROM categories WHERE (file_id, category_id) IN"
+                          " (SELECT DISTINCT file_id, category_id FROM points WHERE " + options.condition + ")"
+                          " ORDER BY file_id, category_id");
+    }
+
+    ~sqlite_builder_t(void)
+    {
+      for(sqlite3_stmt* statement : { region_stats, region_points, point_names, point_alert, point_address, point_contact,
+                                      used_categories, categories })
+        sqlite3_finalize(statement);
+    }
+
+    bool fail(void)
+    {
+      if(!failed)
+        message = sqlite3_errmsg(db);
+      failed = true;
+      return false;
+    }
+
+    bool prepare(sqlite3_stmt*& statement, const std::string& sql)
+    {
+      return sqlite3_prepare_v2(db, sql.c_str(), int(sql.size()), &statement, nullptr) == SQLITE_OK || fail();
+    }
+
+    // steps a cursor, false once it is done or failed
+    bool row(sqlite3_stmt* statement)
+    {
+      int result = sqlite3_step(statement);
+      if(result == SQLITE_ROW)
+        return true;
+      if(result != SQLITE_DONE)
+        fail();
+      sqlite3_reset(statement);
+      return false;
+    }
+
+    void bind_region(sqlite3_stmt* statement, const region_t& region)
+    {
+      sqlite3_bind_double(statement, 1, region.min_latitude);
+      sqlite3_bind_double(statement, 2, region.max_latitude);
+      sqlite3_bind_double(statement, 3, region.min_longitude);
+      sqlite3_bind_double(statement, 4, region.max_longitude);
+    }
+
+    void file(void)
+    {
+      file_description_t description;
+      std::copy(options.version, options.version + 2, description.version);
+      description.timestamp = options.timestamp;
+      description.name = options.name;
+      description.codepage = options.codepage;
+      description.source = make_lstring(options.name);
+      description.copyright_notice = description.source;
+      writer.begin_file(description);
+      number_categories();
+      build();
+      category_records();
+      writer.end_file();
+    }
+
+    uint64_t enter(const region_t& region, area_bounds_t& bounds)
+    {
+      current = region;
+      bind_region(region_stats, region);
+      if(failed || !row(region_stats))
+        return 0;
+      int64_t count = sqlite3_column_int64(region_stats, 0);
+      bounds.min_latitude = sqlite3_column_double(region_stats, 1);
+      bounds.max_latitude = sqlite3_column_double(region_stats, 2);
+      bounds.min_longitude = sqlite3_column_double(region_stats, 3);
+      bounds.max_longitude = sqlite3_column_double(region_stats, 4);
+      sqlite3_reset(region_stats);
+      return uint64_t(count);
+    }
+
+    void open_area(const area_bounds_t& bounds) { writer.open(make_area(bounds)); }
+    void close_area(void) { writer.close(); }
+
+    struct region_point_t
+    {
+      uint64_t key;
+      sqlite3_int64 point_id;
+      double latitude;
+      double longitude;
+      int flags;
+      int category_id; // in the output, -1 for none
+    };
+
+    void points(void)
+    {
+      // the rows of one area are few, they are taken off the cursor to be put in spatial order
+      std::vector<region_point_t> found;
+      bind_region(region_points, current);
+      while(row(region_points))
+      {
+        double latitude = sqlite3_column_double(region_points, 3);
+        double longitude = sqlite3_column_double(region_points, 4);
+        int category_id = -1;
+        if(sqlite3_column_type(region_points, 2) != SQLITE_NULL)
+        {
+          auto pos = category_ids.find({ sqlite3_column_int64(region_points, 1), sqlite3_column_int(region_points, 2) });
+          if(pos != category_ids.end())
+            category_id = pos->second;
+        }
+        found.push_back(region_point_t { spatial_key(options.order, latitude, longitude),
+                                         sqlite3_column_int64(region_points, 0),
+                                         latitude,
+                                         longitude,
+                                         sqlite3_column_int(region_points, 5),
+                                         category_id });
+      }
+      if(options.order != InputOrder)
+        std::stable_sort(found.begin(), found.end(), [](const region_point_t& a, const region_point_t& b) { return a.key < b.key; });
+
+      for(const region_point_t& data : found)
+      {
+        point_t point;
+        point.coordinates.latitude = data.latitude;
+        point.coordinates.longitude = data.longitude;
+        point.reserved = 0;
+        point.flags.byte0 = uint8_t(data.flags);
+        point.flags.byte1 = uint8_t(data.flags >> 8);
+
+        sqlite3_bind_int64(point_names, 1, data.point_id);
+        while(row(point_names))
+          if(uint16_t locale = locale_key(point_names, 0))
+            column_text(point_names, 1, options.codepage, point.shortname[locale]);
+
+        if(data.category_id >= 0)
+          add_record<category_reference_t>(point.child_records).category_id =
+              uint16_t(data.category_id);
+        point_children(point, data.point_id);
+        writer.write(point);
+      }
+    }
+
+    void point_children(point_t& point, sqlite3_int64 point_id)
+    {
+      sqlite3_bind_int64(point_alert, 1, point_id);
+      if(row(point_alert))
+      {
+        alert_t& alert = add_record<alert_t>(point.child_records);
+        alert.proximity = uint16_t(sqlite3_column_int(point_alert, 0));
+        alert.velocity = uint16_t(sqlite3_column_int(point_alert, 1));
+        alert.Unknown6 = 0x100;
+        alert.Unknown7 = 0x100;
+        alert.enabled = bool_t(sqlite3_column_int(point_alert, 2));
+        alert.trigger = alert_trigger_t(sqlite3_column_int(point_alert, 3));
+        alert.source = alert_source_t(sqlite3_column_int(point_alert, 4));
+        alert.symbol_id = uint8_t(sqlite3_column_int(point_alert, 5));
+        sqlite3_reset(point_alert);
+      }
+
+      sqlite3_bind_int64(point_address, 1, point_id);
+      if(row(point_address))
+      {
+        address_t& address = add_record<address_t>(point.child_records);
+        column_text(point_address, 5, options.codepage, address.postal_code);
+        column_text(point_address, 6, options.codepage, address.building_id);
+        do
+        {
+          uint16_t locale = locale_key(point_address, 0);
+          column_text(point_address, 1, options.codepage, locale, address.city);
+          column_text(point_address, 2, options.codepage, locale, address.country);
+          column_text(point_address, 3, options.codepage, locale, address.state);
+          column_text(point_address, 4, options.codepage, locale, address.street_name);
+        } while(row(point_address));
+      }
+
+      sqlite3_bind_int64(point_contact, 1, point_id);
+      if(row(point_contact))
+      {
+        contact_t& contact = add_record<contact_t>(point.child_records);
+        column_text(point_contact, 0, options.codepage, contact.phone1);
+        column_text(point_contact, 1, options.codepage, contact.phone2);
+        column_text(point_contact, 2, options.codepage, contact.fax);
+        column_text(point_contact, 3, options.codepage, contact.email);
+        column_text(point_contact, 4, options.codepage, contact.URL);
+        sqlite3_reset(point_contact);
+      }
+    }
+
+    // Category ids are unique within a file only, the categories used by the points are numbered
+    // by file and id. Categories beyond the last category id are left out.
+    void number_categories(void)
+    {
+      while(row(used_categories))
+        if(category_ids.size() < UINT16_MAX)
+          category_ids.emplace(std::make_pair(sqlite3_column_int64(used_categories, 0), sqlite3_column_int(used_categories, 1)),
+                               uint16_t(category_ids.size()));
+    }
+
+    // the categories used by the points under their new ids
+    void category_records(void)
+    {
+      std::optional<category_t> category;
+      while(row(categories))
+      {
+        auto pos = category_ids.find({ sqlite3_column_int64(categories, 0), sqlite3_column_int(categories, 1) });
+        if(pos == category_ids.end())
+          continue;
+        if(category && category->category_id != pos->second)
+        {
+          writer.write(*category);
+          category.reset();
+        }
+        if(!category)
+          category.emplace().category_id = pos->second;
+        if(uint16_t locale = locale_key(categories, 2))
+          column_text(categories, 3, options.codepage, category->name[locale]);
+      }
+      if(category)
+        writer.write(*category);
+    }
+
+    sqlite3* db;
+    record_writer_t writer;
+    const sqlite_build_options_t& options;
+    bool failed;
+    std::string message;
+
+    sqlite3_stmt* region_stats;
+    sqlite3_stmt* region_points;
+    sqlite3_stmt* point_names;
+    sqlite3_stmt* point_alert;
+    sqlite3_stmt* point_address;
+    sqlite3_stmt* point_contact;
+    sqlite3_stmt* used_categories;
+    sqlite3_stmt* categories;
+    region_t current; // entered last
+    std::map<std::pair<sqlite3_int64, int>, uint16_t> category_ids; // by file_id and category_id
+  };
+
+  bool build_from_sqlite(sqlite3* db, std::ostream& os, const sqlite_build_options_t& options, std::string* error)
+  {
+    assert(db != nullptr);
+    assert(options.version[0] == '0' && (options.version[1] == '0' || options.version[1] == '1'));
+
+    sqlite_builder_t builder(db, os, options);
+    if(!builder.failed)
+      builder.file();
+    if(error)
+      *error = builder.message;
+    return !builder.failed && os.good();
+  }
+} // namespace garmin
@@ -0,0 +1,32 @@
+#ifndef SQLITE_IMPORT_H
+#define SQLITE_IMPORT_H
+
+#include "record_types.h"
+#include "spatial_order.h"
+
+#include <string>
+
+#include <sqlite3.h>
+
+// Builds a GPI file from points held in the schema written by sqlite_exporter_t. Points are read
+// through cursors region by region and written as they are read, the records kept in memory are
+// bounded by the nesting of the areas.
+
+namespace garmin
+{
+  struct sqlite_build_options_t
+  {
+    std::string condition = "1";  // SQL expression over the columns of points selecting the points to build from
+    std::string name = "POI";     // file name in the garmin header and data source
+    char version[2] = { '0', '1' };
+    codepage_t codepage = Unicode; // the stored UTF-8 text is converted to
+    uint32_t area_points = 256;   // areas with more points are split into quadrants
+    spatial_order_t order = InputOrder; // of the points in an area and of sibling areas
+    uint64_t timestamp = unix_time_offset; // UNIX time, not before the Garmin epoch
+  };
+
+  // returns false when a query failed, error holds the message of the database then
+  bool build_from_sqlite(sqlite3* db, std::ostream& os, const sqlite_build_options_t& options, std::string* error = nullptr);
+} // namespace garmin
+
+#endif // SQLITE_IMPORT_H
@@ -0,0 +1,311 @@
+#include "text_export.h"
+#include "codepage.h"
+#include "record_filter.h"
+
+#include <charconv>
+#include <cassert>
+
+namespace garmin
+{
+  static constexpr size_t flush_size = 1 << 16;
+
+  text_exporter_t::text_exporter_t(std::ostream& os, text_format_t format, const char locale[2])
+    : os(os),
+      format(format),
+      locale(uint16_t((locale[0] << 8) | locale[1])),
+      started(false),
+      finished(false),
+      points(0),
+      codepage(Unicode),
+      in_point(false),
+      latitude(0),
+      longitude(0),
+      proximity(0),
+      velocity(0)
+  {
+    buffer.reserve(flush_size * 2);
+  }
+
+  text_exporter_t::~text_exporter_t(void)
+  {
+    finish();
+  }
+
+  void text_exporter_t::flush(bool force)
+  {
+    if(force || buffer.size() >= flush_size)
+    {
+      os.write(buffer.data(), std::streamsize(buffer.size()));
+      buffer.clear();
+    }
+  }
+
+  bool text_exporter_t::export_file(std::istream& is)
+  {
+    assert(!finished);
+    if(!started)
+    {
+      started = true;
+      switch(format)
+      {
+        case GPXFormat:
+          buffer += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                    "<gpx version=\"1.1\" creator=\"libgarminpoi\""
+                    " xmlns=\"http://www.topografix.com/GPX/1/1\""
+                    " xmlns:gpxx=\"http://www.garmin.com/xmlschemas/GpxExtensions/v3\""
+                    " xmlns:poi=\"urn:libgarminpoi:alert\">\n";
+          break;
+        case GeoJSONFormat:
+          buffer += "{\"type\":\"FeatureCollection\",\"features\":[\n";
+          break;
+        case CSVFormat:
+          buffer += "name,latitude,longitude,category,proximity,speed\n";
+          break;
+      }
+    }
+
+    codepage = Unicode;
+    categories.clear();
+    in_point = false;
+
+    std::streampos start = is.tellg();
+    if(start != std::streampos(std::streamoff(-1)))
+    {
+      read_filtered(is, record_filter_t { Category }, [this](any_record_t& record)
+      {
+        category_t& category = get_record<category_t>(record);
+        categories.emplace(uint16_t(category.category_id), std::move(category.name));
+      });
+      is.clear();
+      is.seekg(start);
+    }
+
+    event_parser_t parser(is, *this);
+    while(parser.step());
+    flush(false);
+    return !is.fail() && os.good();
+  }
+
+  std::ostream& text_exporter_t::finish(void)
+  {
+    if(finished)
+      return os;
+    finished = true;
+    if(started)
+    {
+      if(format == GPXFormat)
+        buffer += "</gpx>\n";
+      else if(format == GeoJSONFormat)
+        buffer += "\n]}\n";
+    }
+    flush(true);
+    return os.flush();
+  }
+
+  void text_exporter_t::record_data(const poi_header_t& data, uint32_t)
+  {
+    codepage = data.codepage;
+  }
+
+  void text_exporter_t::record_data(const point_t& data, uint32_t)
+  {
+    in_point = true;
+    latitude = data.coordinates.latitude;
+    longitude = data.coordinates.longitude;
+    name = data.shortname;
+    category_id.reset();
+    proximity = 0;
+    velocity = 0;
+  }
+
+  void text_exporter_t::record_data(const category_reference_t& data, uint32_t)
+  {
+    category_id = data.category_id;
+  }
+
+  void text_exporter_t::record_data(const alert_t& data, uint32_t)
+  {
+    proximity = data.proximity;
+    velocity = data.velocity;
+  }
+
+  void text_exporter_t::leave_record(const record_header_t& header, uint32_t)
+  {
+    if(header.type == Point && in_point)
+    {
+      write_point();
+      in_point = false;
+      flush(false);
+    }
+  }
+
+  void text_exporter_t::number(double value, int precision)
+  {
+    char digits[32];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed, precision);
+    buffer.append(digits, result.ptr);
+  }
+
+  // text in the wanted locale as UTF-8
+  void text_exporter_t::text(const lstring_t& data)
+  {
+    if(data.empty())
+      return;
+    auto pos = data.find(locale);
+    const vector16_t& value = pos != data.end() ? pos->second : data.begin()->second;
+
+    scratch.clear();
+    to_utf8(codepage, value.data(), value.size(), scratch);
+    escaped(scratch);
+  }
+
+  void text_exporter_t::escaped(std::string_view data)
+  {
+    switch(format)
+    {
+      case GPXFormat:
+        for(char c : data)
+          switch(c)
+          {
+            case '&': buffer += "&amp;"; break;
+            case '<': buffer += "&lt;"; break;
+            case '>': buffer += "&gt;"; break;
+            case '"': buffer += "&quot;"; break;
+            case '\t': case '\n': case '\r': buffer.push_back(c); break;
+            default:
+              if(static_cast<unsigned char>(c) < 0x20) // XML 1.0 has no way to write these
+                buffer += "\xEF\xBF\xBD"; // U+FFFD
+              else
+                buffer.push_back(c);
+              break;
+          }
+        break;
+
+      case GeoJSONFormat:
+        for(char c : data)
+        {
+          if(c == '"' || c == '\\')
+            buffer.append({ '\\', c });
+          else if(static_cast<unsigned char>(c) < 0x20)
+          {
+            static constexpr char hex[] = "0123456789abcdef";
+            buffer.append({ '\\', 'u', '0', '0', hex[(c >> 4) & 0xF], hex[c & 0xF] });
+          }
+          else
+            buffer.push_back(c);
+        }
+        break;
+
+      case CSVFormat:
+        if(data.find_first_of(",\"\r\n") == std::string_view::npos)
+          buffer.append(data);
+        else
+        {
+          buffer.push_back('"');
+          for(char c : data)
+          {
+            if(c == '"')
+              buffer.push_back('"');
+            buffer.push_back(c);
+          }
+          buffer.push_back('"');
+        }
+        break;
+    }
+  }
+
+  void text_exporter_t::write_point(void)
+  {
+    // alerts hold 100x meters / second
+    double speed = velocity * 0.036;
+    auto category = [this]()
+    {
+      auto pos = categories.find(*category_id);
+      if(pos != categories.end())
+        text(pos->second);
+      else
+        buffer += std::to_string(*category_id);
+    };
+
+    switch(format)
+    {
+      case GPXFormat:
+        buffer += "<wpt lat=\"";
+        number(latitude, 7);
+        buffer += "\" lon=\"";
+        number(longitude, 7);
+        buffer += "\"><name>";
+        text(name);
+        buffer += "</name>";
+        if(category_id)
+        {
+          buffer += "<type>";
+          category();
+          buffer += "</type>";
+        }
+        if(proximity || velocity)
+        {
+          buffer += "<extensions><gpxx:WaypointExtension><gpxx:Proximity>";
+          buffer += std::to_string(proximity);
+          buffer += "</gpxx:Proximity></gpxx:WaypointExtension>";
+          if(velocity)
+          {
+            buffer += "<poi:Speed>";
+            number(speed, 0);
+            buffer += "</poi:Speed>";
+          }
+          buffer += "</extensions>";
+        }
+        buffer += "</wpt>\n";
+        break;
+
+      case GeoJSONFormat:
+        if(points)
+          buffer += ",\n";
+        buffer += "{\"type\":\"Feature\",\"geometry\":{\"type\":\"Point\",\"coordinates\":[";
+        number(longitude, 7);
+        buffer.push_back(',');
+        number(latitude, 7);
+        buffer += "]},\"properties\":{\"name\":\"";
+        text(name);
+        buffer.push_back('"');
+        if(category_id)
+        {
+          buffer += ",\"category\":\"";
+          category();
+          buffer.push_back('"');
+        }
+        if(proximity || velocity)
+        {
+          buffer += ",\"proximity\":";
+          buffer += std::to_string(proximity);
+          buffer += ",\"speed\":";
+          number(speed, 0);
+        }
+        buffer += "}}";
+        break;
+
+      case CSVFormat:
+        text(name);
+        buffer.push_back(',');
+        number(latitude, 7);
+        buffer.push_back(',');
+        number(longitude, 7);
+        buffer.push_back(',');
+        if(category_id)
+          category();
+        buffer.push_back(',');
+        if(proximity || velocity)
+        {
+          buffer += std::to_string(proximity);
+          buffer.push_back(',');
+          number(speed, 0);
+        }
+        else
+          buffer.push_back(',');
+        buffer.push_back('\n');
+        break;
+    }
+    ++points;
+  }
+} // namespace garmin
@@ -0,0 +1,70 @@
+#ifndef TEXT_EXPORT_H
+#define TEXT_EXPORT_H
+
+#include "event_parser.h"
+
+#include <string>
+#include <unordered_map>
+
+// Writes the points of GPI files as GPX waypoints, GeoJSON features or CSV rows straight from the
+// parse events, without building the record tree. Several files can go into one document.
+// Each point gets its name, coordinates, category name and the proximity and speed (km/h) of its
+// alert. Text is converted from the codepage of the file to UTF-8.
+
+namespace garmin
+{
+  enum text_format_t : uint8_t
+  {
+    GPXFormat = 0,
+    GeoJSONFormat,
+    CSVFormat,
+  };
+
+  class text_exporter_t : private record_handler_t
+  {
+  public:
+    // text in locale is preferred, other text falls back to the first locale present
+    text_exporter_t(std::ostream& os, text_format_t format, const char locale[2] = "EN");
+    ~text_exporter_t(void);
+
+    // Category names come after the points in a file, they are read ahead when the stream can
+    // seek, otherwise categories are written as their ids.
+    bool export_file(std::istream& is);
+    std::ostream& finish(void); // ends the document
+
+  private:
+    void record_data(const poi_header_t& data, uint32_t depth);
+    void record_data(const point_t& data, uint32_t depth);
+    void record_data(const category_reference_t& data, uint32_t depth);
+    void record_data(const alert_t& data, uint32_t depth);
+    void leave_record(const record_header_t& header, uint32_t depth);
+
+    void write_point(void);
+    void text(const lstring_t& data);
+    void escaped(std::string_view data);
+    void number(double value, int precision);
+    void flush(bool force);
+
+    std::ostream& os;
+    text_format_t format;
+    uint16_t locale;
+    bool started;
+    bool finished;
+    uint64_t points;
+    std::string buffer;
+
+    // state of the file being exported
+    codepage_t codepage;
+    std::unordered_map<uint16_t, lstring_t> categories;
+    bool in_point;
+    double latitude;
+    double longitude;
+    lstring_t name;
+    std::optional<uint16_t> category_id;
+    uint16_t proximity;
+    uint16_t velocity;
+    std::string scratch;
+  };
+} // namespace garmin
+
+#endif // TEXT_EXPORT_H
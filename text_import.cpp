@@ -0,0 +1,602 @@
+#include "text_import.h"
+#include "codepage.h"
+#include "geojson_import.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+
+namespace garmin
+{
+  static bool same_text(std::string_view a, std::string_view b)
+  {
+    return a.size() == b.size() &&
+        std::equal(std::begin(a), std::end(a), std::begin(b),
+                   [](char x, char y) { return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y)); });
+  }
+
+  static const char* skip_bom(const char* pos, const char* end)
+  {
+    return end - pos >= 3 && !std::memcmp(pos, "\xEF\xBB\xBF", 3) ? pos + 3 : pos;
+  }
+
+// CSV
+
+  struct csv_reader_t
+  {
+    char delimiter;
+    std::vector<int> columns; // field of each column, -1 when unused
+    std::string scratch;
+
+    // reads one field, value refers to the input unless quotes had to be undone
+    const char* field(const char* pos, const char* end, std::string_view& value)
+    {
+      if(pos < end && *pos == '"')
+      {
+        const char* start = ++pos;
+        bool doubled = false;
+        while(pos < end)
+        {
+          if(*pos == '"')
+          {
+            if(pos + 1 < end && pos[1] == '"')
+            {
+              doubled = true;
+              pos += 2;
+              continue;
+            }
+            break;
+          }
+          ++pos;
+        }
+        value = std::string_view(start, size_t(pos - start));
+        if(doubled)
+        {
+          scratch.clear();
+          for(const char* c = start; c < pos; ++c)
+          {
+            scratch.push_back(*c);
+            if(*c == '"') // keep one of each doubled quote
+              ++c;
+          }
+          value = scratch;
+        }
+        if(pos < end)
+          ++pos; // closing quote
+        while(pos < end && *pos != delimiter && *pos != '\n') // text after the closing quote is dropped
+          ++pos;
+        return pos;
+      }
+
+      const char* start = pos;
+      while(pos < end && *pos != delimiter && *pos != '\n')
+        ++pos;
+      const char* stop = pos;
+      if(stop > start && stop[-1] == '\r')
+        --stop;
+      value = std::string_view(start, size_t(stop - start));
+      return pos;
+    }
+
+    // reads one line into the batch
+    const char* record(const char* pos, const char* end, import_batch_t& batch)
+    {
+      if(*pos == '\n' || (*pos == '\r' && pos + 1 < end && pos[1] == '\n')) // empty line
+        return pos + (*pos == '\r' ? 2 : 1);
+
+      batch.begin_point();
+      bool good = true;
+      for(size_t column = 0; pos <= end; ++column)
+      {
+        std::string_view value;
+        pos = field(pos, end, value);
+        if(column < columns.size() && columns[column] >= 0 && !value.empty())
+        {
+          import_field_t type = import_field_t(columns[column]);
+          if(type >= ImportFieldCount && delimiter != ',' && value.find(',') != std::string_view::npos)
+          {
+            scratch.assign(value); // decimal comma
+            std::replace(std::begin(scratch), std::end(scratch), ',', '.');
+            value = scratch;
+          }
+          good = batch.set_field(type, value) && good;
+        }
+        if(pos >= end || *pos == '\n')
+          break;
+        ++pos; // delimiter
+      }
+      if(good)
+        batch.end_point();
+      else
+      {
+        batch.points.pop_back();
+        ++batch.skipped;
+      }
+      return pos < end ? pos + 1 : end;
+    }
+
+    void records(const char* pos, const char* end, import_batch_t& batch)
+    {
+      while(pos < end)
+        pos = record(pos, end, batch);
+    }
+  };
+
+  // Quotes only open at the start of a field, the way csv_reader_t::field reads them, so whether a
+  // line break ends a record depends on more than the parity of the quotes before it. It depends on
+  // the state the reader is in at the line break, which is one of a few.
+  enum csv_state_t : uint8_t
+  {
+    FieldStart = 0,
+    Unquoted,
+    Quoted,
+    QuoteSeen, // in a quoted field after a quote that closes it unless another one follows
+    CSVStateCount,
+  };
+
+  static inline csv_state_t csv_step(csv_state_t state, char c, char delimiter)
+  {
+    switch(state)
+    {
+      case Quoted:
+        return c == '"' ? QuoteSeen : Quoted;
+      case QuoteSeen:
+        if(c == '"') // doubled quote
+          return Quoted;
+        [[fallthrough]];
+      case Unquoted: // text after a closing quote is dropped like that of an unquoted field
+        return c == delimiter || c == '\n' ? FieldStart : Unquoted;
+      default:
+        return c == '"' ? Quoted : c == delimiter || c == '\n' ? FieldStart : Unquoted;
+    }
+  }
+
+  // state at the end of a piece of text for each state at its start, the pieces of a large input are
+  // summarized in parallel and combined in order afterwards
+  using csv_transitions_t = std::array<csv_state_t, CSVStateCount>;
+
+  static csv_transitions_t csv_transitions(const char* pos, const char* end, char delimiter)
+  {
+    csv_transitions_t states = { FieldStart, Unquoted, Quoted, QuoteSeen };
+    for(; pos < end; ++pos)
+      for(auto& state : states)
+        state = csv_step(state, *pos, delimiter);
+    return states;
+  }
+
+  // start of the record after the first line break outside quotes at or after pos, or end
+  static const char* csv_record_end(const char* pos, const char* end, csv_state_t state, char delimiter)
+  {
+    for(; pos < end; ++pos)
+    {
+      if(*pos == '\n' && state != Quoted)
+        return pos + 1;
+      state = csv_step(state, *pos, delimiter);
+    }
+    return end;
+  }
+
+  std::vector<import_batch_t> import_csv(const char* data, size_t size, const import_options_t& options)
+  {
+    const char* end = data + size;
+    const char* pos = skip_bom(data, end);
+    const char* line_end = std::find(pos, end, '\n');
+
+    // the delimiter found most often outside quotes in the header line
+    csv_reader_t reader;
+    size_t counts[3] = { 0, 0, 0 };
+    bool quoted = false;
+    for(const char* c = pos; c < line_end; ++c)
+    {
+      if(*c == '"')
+        quoted = !quoted;
+      else if(!quoted)
+        counts[0] += *c == ',', counts[1] += *c == ';', counts[2] += *c == '\t';
+    }
+    reader.delimiter = counts[1] > counts[0] && counts[1] >= counts[2] ? ';' : counts[2] > counts[0] ? '\t' : ',';
+
+    for(;;)
+    {
+      std::string_view name;
+      pos = reader.field(pos, end, name);
+      import_field_t field;
+      reader.columns.push_back(import_field(name, field) ? int(field) : -1);
+      if(pos >= end || *pos == '\n')
+        break;
+      ++pos;
+    }
+    if(pos < end)
+      ++pos;
+
+    const char* body = pos;
+    auto find_boundaries = [body, end, &reader, &options](std::vector<size_t>& bounds)
+    {
+      size_t chunks = bounds.size() - 1;
+      std::vector<csv_transitions_t> transitions(chunks);
+      run_parallel(chunks, options.threads, [&](size_t i)
+      {
+        transitions[i] = csv_transitions(body + bounds[i], body + bounds[i + 1], reader.delimiter);
+      });
+
+      std::vector<csv_state_t> states(chunks, FieldStart); // at the chunk starts
+      for(size_t i = 1; i < chunks; ++i)
+        states[i] = transitions[i - 1][states[i - 1]];
+
+      run_parallel(chunks - 1, options.threads, [&](size_t i)
+      {
+        bounds[i + 1] = size_t(csv_record_end(body + bounds[i + 1], end, states[i + 1], reader.delimiter) - body);
+      });
+    };
+
+    return parse_chunks(body, size_t(end - body), options, find_boundaries,
+                        [&reader](const char* first, const char* last, import_batch_t& batch)
+                        {
+                          csv_reader_t local { reader.delimiter, reader.columns, std::string() };
+                          local.records(first, last, batch);
+                        });
+  }
+
+// GPX
+
+  struct gpx_reader_t
+  {
+    std::string text;
+
+    static bool name_end(char c) { return std::isspace(static_cast<unsigned char>(c)) || c == '>' || c == '/'; }
+
+    // a start tag of the element at pos, which follows "<"
+    static bool is_tag(const char* pos, const char* end, std::string_view name)
+    {
+      return size_t(end - pos) > name.size() && !std::memcmp(pos, name.data(), name.size()) && name_end(pos[name.size()]);
+    }
+
+    // element name without its namespace prefix
+    static std::string_view local_name(std::string_view name)
+    {
+      size_t colon = name.find(':');
+      return colon == std::string_view::npos ? name : name.substr(colon + 1);
+    }
+
+    static std::string_view attribute(std::string_view tag, std::string_view name)
+    {
+      for(size_t pos = tag.find(name); pos != std::string_view::npos; pos = tag.find(name, pos + 1))
+      {
+        if(!pos || !std::isspace(static_cast<unsigned char>(tag[pos - 1])))
+          continue;
+        size_t equals = pos + name.size();
+        while(equals < tag.size() && std::isspace(static_cast<unsigned char>(tag[equals])))
+          ++equals;
+        if(equals >= tag.size() || tag[equals] != '=')
+          continue;
+        size_t quote = tag.find_first_of("\"'", equals);
+        if(quote == std::string_view::npos)
+          break;
+        size_t close = tag.find(tag[quote], quote + 1);
+        if(close == std::string_view::npos)
+          break;
+        return tag.substr(quote + 1, close - quote - 1);
+      }
+      return std::string_view();
+    }
+
+    // appends character data, decoding entities
+    void append_text(std::string_view data)
+    {
+      for(size_t amp = data.find('&'); amp != std::string_view::npos; amp = data.find('&'))
+      {
+        text.append(data.substr(0, amp));
+        size_t semicolon = data.find(';', amp);
+        std::string_view entity = data.substr(amp + 1, semicolon == std::string_view::npos ? 0 : semicolon - amp - 1);
+        if(entity == "amp") text.push_back('&');
+        else if(entity == "lt") text.push_back('<');
+        else if(entity == "gt") text.push_back('>');
+        else if(entity == "quot") text.push_back('"');
+        else if(entity == "apos") text.push_back('\'');
+        else if(entity.size() > 1 && entity[0] == '#')
+        {
+          bool hex = entity[1] == 'x' || entity[1] == 'X';
+          uint32_t code = uint32_t(std::strtoul(std::string(entity.substr(hex ? 2 : 1)).c_str(), nullptr, hex ? 16 : 10));
+          append_utf8(text, code);
+        }
+        else
+        {
+          text.push_back('&'); // not an entity
+          data.remove_prefix(amp + 1);
+          continue;
+        }
+        data.remove_prefix(semicolon + 1);
+      }
+      text.append(data);
+    }
+
+    // End of a comment, CDATA section, processing instruction or declaration starting at open, which
+    // is a "<", nullptr for other tags. data receives the text of a CDATA section.
+    static const char* markup_end(const char* open, const char* end, std::string_view& data)
+    {
+      if(end - open >= 9 && !std::memcmp(open, "<![CDATA[", 9))
+      {
+        const char* close = std::search(open + 9, end, "]]>", "]]>" + 3);
+        data = std::string_view(open + 9, size_t(close - open - 9));
+        return close + (close < end ? 3 : 0);
+      }
+      if(end - open >= 4 && !std::memcmp(open, "<!--", 4))
+      {
+        const char* close = std::search(open + 4, end, "-->", "-->" + 3);
+        return close + (close < end ? 3 : 0);
+      }
+      if(end - open >= 2 && (open[1] == '?' || open[1] == '!'))
+      {
+        const char* close = std::find(open, end, '>');
+        return close + (close < end ? 1 : 0);
+      }
+      return nullptr;
+    }
+
+    // reads a wpt element starting at its "<", returns the position after it
+    const char* waypoint(const char* pos, const char* end, import_batch_t& batch)
+    {
+      const char* tag_end = std::find(pos, end, '>');
+      if(tag_end == end)
+        return end;
+      std::string_view tag(pos, size_t(tag_end - pos));
+      batch.begin_point();
+      bool good = batch.set_field(LatitudeField, attribute(tag, "lat")) &&
+                  batch.set_field(LongitudeField, attribute(tag, "lon"));
+      pos = tag_end + 1;
+
+      if(tag_end[-1] != '/')
+      {
+        std::string_view current; // innermost element whose text is collected
+        text.clear();
+        while(pos < end)
+        {
+          const char* open = std::find(pos, end, '<');
+          if(!current.empty())
+            append_text(std::string_view(pos, size_t(open - pos)));
+          if(open == end)
+          {
+            pos = end;
+            break;
+          }
+
+          std::string_view data;
+          if(const char* after = markup_end(open, end, data))
+          {
+            if(!current.empty())
+              text.append(data);
+            pos = after;
+            continue;
+          }
+
+          const char* close = std::find(open, end, '>');
+          std::string_view element(open + 1, size_t(close - open - (close < end ? 1 : 0)));
+          pos = close + (close < end ? 1 : 0);
+          if(element.empty())
+            continue;
+
+          if(element[0] == '/')
+          {
+            std::string_view name = local_name(element.substr(1, element.find_first_of(" \t\r\n>", 1) - 1));
+            if(name == "wpt")
+              break;
+            import_field_t field;
+            if(!current.empty() && same_text(name, current) && import_field(name, field))
+            {
+              size_t first = text.find_first_not_of(" \t\r\n");
+              size_t last = text.find_last_not_of(" \t\r\n");
+              if(first != std::string::npos)
+                good = batch.set_field(field, std::string_view(text).substr(first, last - first + 1)) && good;
+            }
+            current = std::string_view();
+            text.clear();
+            continue;
+          }
+
+          size_t name_size = 0;
+          while(name_size < element.size() && !name_end(element[name_size]))
+            ++name_size;
+          std::string_view name = local_name(element.substr(0, name_size));
+          if(name == "link")
+          {
+            std::string_view href = attribute(element, "href");
+            if(!href.empty())
+              batch.set_field(URLField, href);
+          }
+          current = element.back() == '/' ? std::string_view() : name;
+          text.clear();
+        }
+      }
+
+      if(good)
+        batch.end_point();
+      else
+      {
+        batch.points.pop_back();
+        ++batch.skipped;
+      }
+      return pos;
+    }
+
+    void waypoints(const char* pos, const char* end, import_batch_t& batch)
+    {
+      while(pos < end)
+      {
+        pos = std::find(pos, end, '<');
+        if(pos == end)
+          break;
+        std::string_view ignored;
+        if(const char* after = markup_end(pos, end, ignored))
+          pos = after;
+        else if(is_tag(pos + 1, end, "wpt"))
+          pos = waypoint(pos, end, batch);
+        else
+          ++pos;
+      }
+    }
+  };
+
+  // Where the reader is relative to markup that may hide a "<wpt": comments, CDATA sections, and
+  // processing instructions and declarations, which end at the next '>' as markup_end() reads them.
+  // The states follow that one byte at a time, so pieces of a large input can be summarized apart.
+  enum gpx_state_t : uint8_t
+  {
+    GPXText = 0,
+    GPXOpen,            // "<"
+    GPXBang,            // "<!"
+    GPXBangDash,        // "<!-"
+    GPXCDATAStart,      // "<![", followed by a state for each character of "CDATA[" but the last
+    GPXComment = GPXCDATAStart + 6,
+    GPXCommentDash,
+    GPXCommentDashes,
+    GPXCDATA,
+    GPXCDATABracket,
+    GPXCDATABrackets,
+    GPXMarkup,          // processing instruction or declaration
+    GPXStateCount,
+  };
+
+  static gpx_state_t gpx_step(gpx_state_t state, char c)
+  {
+    static constexpr char cdata[] = "CDATA[";
+    switch(state)
+    {
+      case GPXText:          return c == '<' ? GPXOpen : GPXText;
+      case GPXOpen:          return c == '!' ? GPXBang : c == '?' ? GPXMarkup : c == '<' ? GPXOpen : GPXText;
+      case GPXBang:          return c == '-' ? GPXBangDash : c == '[' ? GPXCDATAStart : c == '>' ? GPXText : GPXMarkup;
+      case GPXBangDash:      return c == '-' ? GPXComment : c == '>' ? GPXText : GPXMarkup;
+      case GPXComment:       return c == '-' ? GPXCommentDash : GPXComment;
+      case GPXCommentDash:   return c == '-' ? GPXCommentDashes : GPXComment;
+      case GPXCommentDashes: return c == '>' ? GPXText : c == '-' ? GPXCommentDashes : GPXComment;
+      case GPXCDATA:         return c == ']' ? GPXCDATABracket : GPXCDATA;
+      case GPXCDATABracket:  return c == ']' ? GPXCDATABrackets : GPXCDATA;
+      case GPXCDATABrackets: return c == '>' ? GPXText : c == ']' ? GPXCDATABrackets : GPXCDATA;
+      case GPXMarkup:        return c == '>' ? GPXText : GPXMarkup;
+      default: // a prefix of "<![CDATA["
+      {
+        size_t matched = size_t(state - GPXCDATAStart);
+        if(c == cdata[matched])
+          return matched + 1 == sizeof(cdata) - 1 ? GPXCDATA : gpx_state_t(state + 1);
+        return c == '>' ? GPXText : GPXMarkup;
+      }
+    }
+  }
+
+  // state at the end of a piece of text for each state at its start
+  using gpx_transitions_t = std::array<gpx_state_t, GPXStateCount>;
+
+  static gpx_transitions_t gpx_transitions(const char* pos, const char* end)
+  {
+    // the starts are followed together and share a slot once they reach the same state, which most
+    // of them do within a few bytes
+    gpx_transitions_t slots;
+    std::array<uint8_t, GPXStateCount> slot_of;
+    for(uint8_t i = 0; i < GPXStateCount; ++i)
+    {
+      slots[i] = gpx_state_t(i);
+      slot_of[i] = i;
+    }
+    size_t count = GPXStateCount;
+    while(pos < end)
+    {
+      const char* stop = pos + std::min<size_t>(4096, size_t(end - pos));
+      for(; pos < stop; ++pos)
+        for(size_t slot = 0; slot < count; ++slot)
+          slots[slot] = gpx_step(slots[slot], *pos);
+
+      std::array<uint8_t, GPXStateCount> merged;
+      std::array<uint8_t, GPXStateCount> moved;
+      merged.fill(UINT8_MAX);
+      size_t live = 0;
+      for(size_t slot = 0; slot < count; ++slot)
+      {
+        gpx_state_t state = slots[slot];
+        if(merged[state] == UINT8_MAX)
+        {
+          merged[state] = uint8_t(live);
+          slots[live++] = state;
+        }
+        moved[slot] = merged[state];
+      }
+      for(auto& slot : slot_of)
+        slot = moved[slot];
+      count = live;
+    }
+
+    gpx_transitions_t states;
+    for(size_t i = 0; i < GPXStateCount; ++i)
+      states[i] = slots[slot_of[i]];
+    return states;
+  }
+
+  // the first wpt start tag outside markup at or after pos, which is in state, or end
+  static const char* gpx_waypoint_start(const char* pos, const char* end, gpx_state_t state)
+  {
+    if(state == GPXOpen && gpx_reader_t::is_tag(pos, end, "wpt")) // the "<" ends the previous piece
+      return pos - 1;
+    for(; pos < end; ++pos)
+    {
+      if(state == GPXText)
+      {
+        pos = static_cast<const char*>(std::memchr(pos, '<', size_t(end - pos)));
+        if(!pos)
+          return end;
+        if(gpx_reader_t::is_tag(pos + 1, end, "wpt"))
+          return pos;
+      }
+      state = gpx_step(state, *pos);
+    }
+    return end;
+  }
+
+  std::vector<import_batch_t> import_gpx(const char* data, size_t size, const import_options_t& options)
+  {
+    // waypoints belong to the chunk holding their start tag
+    auto find_boundaries = [data, size, &options](std::vector<size_t>& bounds)
+    {
+      size_t chunks = bounds.size() - 1;
+      std::vector<gpx_transitions_t> transitions(chunks);
+      run_parallel(chunks, options.threads, [&](size_t i)
+      {
+        transitions[i] = gpx_transitions(data + bounds[i], data + bounds[i + 1]);
+      });
+
+      std::vector<gpx_state_t> states(chunks, GPXText); // at the chunk starts
+      for(size_t i = 1; i < chunks; ++i)
+        states[i] = transitions[i - 1][states[i - 1]];
+
+      run_parallel(chunks - 1, options.threads, [&](size_t i)
+      {
+        bounds[i + 1] = size_t(gpx_waypoint_start(data + bounds[i + 1], data + size, states[i + 1]) - data);
+      });
+    };
+
+    return parse_chunks(data, size, options, find_boundaries,
+                        [](const char* first, const char* last, import_batch_t& batch)
+                        {
+                          gpx_reader_t().waypoints(first, last, batch);
+                        });
+  }
+
+
+  bool import_file(const std::filesystem::path& input, std::ostream& os, const import_options_t& options)
+  {
+    mapped_file_t file(input);
+    if(!file.is_open())
+      return false;
+
+    std::string extension = input.extension().string();
+    std::vector<import_batch_t> batches;
+    if(same_text(extension, ".gpx"))
+      batches = import_gpx(file.data(), file.size(), options);
+    else if(same_text(extension, ".csv") || same_text(extension, ".txt"))
+      batches = import_csv(file.data(), file.size(), options);
+    else if(same_text(extension, ".geojson") || same_text(extension, ".json"))
+      batches = import_geojson(file.data(), file.size(), options);
+    else
+      return false;
+
+    return write_imported(os, batches, options).good();
+  }
+} // namespace garmin
@@ -0,0 +1,24 @@
+#ifndef TEXT_IMPORT_H
+#define TEXT_IMPORT_H
+
+#include "point_import.h"
+
+// Readers for CSV tables and GPX waypoints. Both tokenize the input in place and only copy field
+// text into the batches, large inputs are split on record boundaries and read on several threads.
+//
+// CSV: the first line names the columns (see import_field), the delimiter is the one of ',', ';' and
+// tab found most often in it. Quoted fields may hold delimiters, line breaks and doubled quotes.
+// GPX: wpt elements outside comments, CDATA sections and processing instructions, with the Garmin
+// extension elements for addresses, phone numbers and proximity.
+
+namespace garmin
+{
+  std::vector<import_batch_t> import_csv(const char* data, size_t size, const import_options_t& options);
+  std::vector<import_batch_t> import_gpx(const char* data, size_t size, const import_options_t& options);
+
+  // converts a file to GPI choosing the reader by its extension (including GeoJSON), false when it
+  // could not be read
+  bool import_file(const std::filesystem::path& input, std::ostream& os, const import_options_t& options);
+} // namespace garmin
+
+#endif // TEXT_IMPORT_H
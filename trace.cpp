@@ -0,0 +1,100 @@
+#include "trace.h"
+
+#include <algorithm>
+
+namespace garmin
+{
+  static thread_local trace_sink_t* current_sink = nullptr;
+
+  void set_trace_sink(trace_sink_t* sink) { current_sink = sink; }
+  trace_sink_t* get_trace_sink(void) { return current_sink; }
+
+  void parse_profile_t::record_parsed(const trace_event_t& event)
+  {
+    totals_t& total = totals[event.type];
+    ++total.records;
+    total.self_bytes += event.self_bytes;
+    total.unparsed_bytes += event.unparsed_bytes;
+    total.self_time += event.self_time;
+    if(keep_events)
+      events.push_back(event);
+  }
+
+  std::ostream& parse_profile_t::write_summary(std::ostream& os) const
+  {
+    for(const auto& pair : totals)
+      os << record_name(pair.first)
+         << ": records " << pair.second.records
+         << ", self bytes " << pair.second.self_bytes
+         << ", unparsed " << pair.second.unparsed_bytes
+         << ", self time " << std::chrono::duration_cast<std::chrono::microseconds>(pair.second.self_time).count() << " us"
+         << std::endl;
+    return os;
+  }
+
+  // Trace Event Format, loadable by chrome://tracing and Perfetto
+  std::ostream& parse_profile_t::write_chrome_trace(std::ostream& os) const
+  {
+    auto origin = events.empty() ? std::chrono::steady_clock::time_point() : events.front().begin;
+    for(const auto& event : events)
+      origin = std::min(origin, event.begin);
+
+    os << "{\"traceEvents\":[";
+    bool first = true;
+    for(const auto& event : events)
+    {
+      if(!first)
+        os << ',';
+      first = false;
+      os << "\n{\"name\":\"" << record_name(event.type) << "\""
+         << ",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+         << ",\"ts\":" << std::chrono::duration<double, std::micro>(event.begin - origin).count()
+         << ",\"dur\":" << std::chrono::duration<double, std::micro>(event.end - event.begin).count()
+         << ",\"args\":{\"depth\":" << event.depth
+         << ",\"bytes\":" << event.bytes
+         << ",\"self_bytes\":" << event.self_bytes
+         << ",\"unparsed\":" << event.unparsed_bytes
+         << "}}";
+    }
+    return os << "\n],\"displayTimeUnit\":\"ns\"}" << std::endl;
+  }
+
+#ifdef GARMIN_TRACE
+  static thread_local record_trace_t* current_trace = nullptr;
+
+  record_trace_t::record_trace_t(const record_header_t& header)
+    : parent(current_trace),
+      children_time(std::chrono::nanoseconds::zero()),
+      children_bytes(0)
+  {
+    event.type = header.type;
+    event.depth = parent ? parent->event.depth + 1 : 0;
+    event.bytes = header.header_size() + header.end_of_record;
+    event.unparsed_bytes = 0;
+    current_trace = this;
+    event.begin = std::chrono::steady_clock::now();
+  }
+
+  record_trace_t::~record_trace_t(void)
+  {
+    event.end = std::chrono::steady_clock::now();
+    auto total_time = std::chrono::duration_cast<std::chrono::nanoseconds>(event.end - event.begin);
+    event.self_time = total_time - children_time;
+    event.self_bytes = event.bytes - std::min(children_bytes, event.bytes); // malformed children may claim more
+    current_trace = parent;
+    if(parent)
+    {
+      parent->children_time += total_time;
+      parent->children_bytes += event.bytes;
+    }
+    if(current_sink)
+      current_sink->record_parsed(event);
+  }
+
+  void record_trace_t::unparsed(uint32_t bytes)
+  {
+    if(current_trace)
+      current_trace->event.unparsed_bytes += bytes;
+  }
+#endif
+} // namespace garmin
@@ -0,0 +1,84 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "record_types.h"
+
+#include <chrono>
+#include <map>
+#include <vector>
+#include <iostream>
+
+// Parse tracing is compiled in with -DGARMIN_TRACE, otherwise every hook is an empty inline function.
+
+namespace garmin
+{
+  struct trace_event_t
+  {
+    record_id_t type;
+    uint32_t depth;                     // 0 for top level records
+    uint32_t bytes;                     // header, data and extra data, including subordinated records
+    uint32_t self_bytes;                // bytes excluding subordinated records
+    uint32_t unparsed_bytes;            // data the record reader left over and that was skipped
+    std::chrono::steady_clock::time_point begin;
+    std::chrono::steady_clock::time_point end;
+    std::chrono::nanoseconds self_time; // time spent excluding subordinated records
+  };
+
+  // receives an event for every record once it and its subordinated records have been parsed
+  struct trace_sink_t
+  {
+    virtual ~trace_sink_t(void) = default;
+    virtual void record_parsed(const trace_event_t& event) = 0;
+  };
+
+  // the sink is per thread so that concurrent parses are traced independently
+  void set_trace_sink(trace_sink_t* sink);
+  trace_sink_t* get_trace_sink(void);
+
+  // accumulates totals per record type and optionally the timeline of a parse
+  struct parse_profile_t : trace_sink_t
+  {
+    struct totals_t
+    {
+      uint64_t records = 0;
+      uint64_t self_bytes = 0;
+      uint64_t unparsed_bytes = 0;
+      std::chrono::nanoseconds self_time = std::chrono::nanoseconds::zero();
+    };
+
+    parse_profile_t(bool keep_events = false) : keep_events(keep_events) { }
+
+    void record_parsed(const trace_event_t& event);
+
+    std::ostream& write_summary(std::ostream& os) const;
+    std::ostream& write_chrome_trace(std::ostream& os) const; // needs keep_events
+
+    bool keep_events;
+    std::map<record_id_t, totals_t> totals;
+    std::vector<trace_event_t> events;
+  };
+
+#ifdef GARMIN_TRACE
+  // spans the parse of one record including its subordinated records
+  struct record_trace_t
+  {
+    record_trace_t(const record_header_t& header);
+    ~record_trace_t(void);
+
+    static void unparsed(uint32_t bytes);
+
+    record_trace_t* parent;
+    std::chrono::nanoseconds children_time;
+    uint32_t children_bytes;
+    trace_event_t event;
+  };
+#else
+  struct record_trace_t
+  {
+    record_trace_t(const record_header_t&) { }
+    static void unparsed(uint32_t) { }
+  };
+#endif
+} // namespace garmin
+
+#endif // TRACE_H
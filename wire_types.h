@@ -0,0 +1,151 @@
+#ifndef WIRE_TYPES_H
+#define WIRE_TYPES_H
+
+#include <cstdint>
+#include <cmath>
+#include <type_traits>
+
+// Byte exact layouts of the fixed size portions of records. Each is read or written with a single
+// stream call and converted field by field afterwards. Multibyte fields hold the raw little endian
+// values and must go through from_le/to_le.
+
+namespace garmin
+{
+  namespace wire
+  {
+#ifndef __BYTE_ORDER__
+#error compiler does not define endianness macros
+#elif __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    constexpr uint8_t  from_le(uint8_t  value) { return value; }
+    constexpr uint16_t from_le(uint16_t value) { return value; }
+    constexpr uint32_t from_le(uint32_t value) { return value; }
+    constexpr uint64_t from_le(uint64_t value) { return value; }
+#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    constexpr uint8_t  from_le(uint8_t  value) { return value; }
+    constexpr uint16_t from_le(uint16_t value) { return __builtin_bswap16(value); }
+    constexpr uint32_t from_le(uint32_t value) { return __builtin_bswap32(value); }
+    constexpr uint64_t from_le(uint64_t value) { return __builtin_bswap64(value); }
+#else
+# error are you compiling for a PDP?!
+#endif
+
+    template<typename T>
+    constexpr T to_le(T value) { return from_le(value); }
+
+    // coordinates are stored as signed fractions of a full circle: degrees = value * 360 / 2^32
+    constexpr double coord32_degrees(uint32_t value)
+      { return double(int32_t(value)) * 360 / (uint64_t(1) << 32); }
+
+    inline uint32_t coord32_value(double degrees)
+      { return uint32_t(int32_t(std::llround(degrees * (uint64_t(1) << 32) / 360))); }
+
+    struct [[gnu::packed]] coords32_t
+    {
+      uint32_t latitude;
+      uint32_t longitude;
+    };
+    static_assert(sizeof(coords32_t) == 8, "packing failure");
+
+    struct [[gnu::packed]] garmin_header_t
+    {
+      char magic[6];
+      char version[2];
+      uint32_t timestamp;
+      uint16_t flags;
+    };
+    static_assert(sizeof(garmin_header_t) == 14, "packing failure");
+
+    struct [[gnu::packed]] poi_header_t
+    {
+      char magic[6];
+      char version[2];
+      uint16_t codepage;
+      uint16_t auxiliary_type;
+    };
+    static_assert(sizeof(poi_header_t) == 12, "packing failure");
+
+    struct [[gnu::packed]] point_t
+    {
+      coords32_t coordinates;
+      uint8_t reserved;
+      uint16_t flags;
+    };
+    static_assert(sizeof(point_t) == 11, "packing failure");
+
+    struct [[gnu::packed]] alert_t
+    {
+      uint16_t proximity;
+      uint16_t velocity;
+      uint16_t Unknown6;
+      uint16_t Unknown7;
+      uint8_t enabled;
+      uint8_t trigger;
+      uint8_t symbol_id;
+      uint8_t source;
+    };
+    static_assert(sizeof(alert_t) == 12, "packing failure");
+
+    struct [[gnu::packed]] bitmap_t
+    {
+      uint16_t bitmap_id;
+      uint16_t height;
+      uint16_t width;
+      uint16_t line_length;
+      uint16_t bits_per_pixel;
+      uint16_t reserved0;
+      uint32_t image_byte_length;
+      uint32_t image_offset;
+      uint32_t palette_size;
+      uint32_t transparent_color;
+      uint16_t reserved1;
+      uint16_t flags;
+      uint32_t palette_offset;
+    };
+    static_assert(sizeof(bitmap_t) == 36, "packing failure");
+
+    struct [[gnu::packed]] area_t
+    {
+      coords32_t coordinates_max;
+      coords32_t coordinates_min;
+      uint32_t reserved;
+      uint16_t flags;
+      uint8_t unknown;
+    };
+    static_assert(sizeof(area_t) == 23, "packing failure");
+
+    struct [[gnu::packed]] record15_t
+    {
+      uint16_t map_id;
+      uint8_t product_id;
+      uint8_t region_id;
+      uint8_t vendor_id;
+    };
+    static_assert(sizeof(record15_t) == 5, "packing failure");
+
+    struct [[gnu::packed]] point3d_t
+    {
+      coords32_t location;
+      uint32_t unknown;
+    };
+    static_assert(sizeof(point3d_t) == 12, "packing failure");
+
+    struct [[gnu::packed]] copyright_t
+    {
+      uint32_t have;
+      uint16_t unknown0;
+      uint16_t unknown1;
+    };
+    static_assert(sizeof(copyright_t) == 8, "packing failure");
+
+    struct [[gnu::packed]] audio_file_t
+    {
+      uint16_t audio_id;
+      uint8_t format;
+    };
+    static_assert(sizeof(audio_file_t) == 3, "packing failure");
+
+    static_assert(std::is_trivially_copyable_v<bitmap_t>, "wire types must be copyable as bytes");
+  }
+} // namespace garmin
+
+#endif // WIRE_TYPES_H